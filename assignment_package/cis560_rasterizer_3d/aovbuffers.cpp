@@ -0,0 +1,204 @@
+#include "aovbuffers.h"
+#include <QFile>
+#include <QtGlobal>
+#include <cstdint>
+#include <cstring>
+
+//both file formats are little-endian, and the buffers are written to them byte for byte
+static_assert(Q_BYTE_ORDER == Q_LITTLE_ENDIAN, "AOV files are written straight from memory, which assumes a little-endian CPU");
+
+AOVBuffers::AOVBuffers()
+    : m_flags(AOV_NONE), m_frameWidth(0), m_frameHeight(0), m_region(),
+      m_depth(), m_objectID(), m_triangleID(), m_normalX(), m_normalY(), m_normalZ()
+{}
+
+//assign() keeps the memory of a buffer that is already big enough, so steady state frames do not allocate
+template <typename T>
+static void ResetBuffer(std::vector<T>& buffer, bool enabled, size_t size, T value)
+{
+    if(enabled)
+    {
+        buffer.assign(size, value);
+    }
+    else
+    {
+        std::vector<T>().swap(buffer);
+    }
+}
+
+void AOVBuffers::Reset(unsigned int flags, int frameWidth, int frameHeight, const QRect& region, float emptyDepth)
+{
+    m_flags = flags;
+    m_frameWidth = frameWidth;
+    m_frameHeight = frameHeight;
+    m_region = region;
+
+    size_t size = static_cast<size_t>(region.width()) * region.height();
+    ResetBuffer(m_depth, (flags & AOV_DEPTH) != 0, size, emptyDepth);
+    ResetBuffer(m_objectID, (flags & AOV_OBJECT_ID) != 0, size, glm::uint(0));
+    ResetBuffer(m_triangleID, (flags & AOV_TRIANGLE_ID) != 0, size, glm::uint(0));
+    ResetBuffer(m_normalX, (flags & AOV_NORMAL) != 0, size, 0.0f);
+    ResetBuffer(m_normalY, (flags & AOV_NORMAL) != 0, size, 0.0f);
+    ResetBuffer(m_normalZ, (flags & AOV_NORMAL) != 0, size, 0.0f);
+}
+
+//** OpenEXR **
+
+template <typename T>
+static void AppendValue(QByteArray* out, T value)
+{
+    out->append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+static void AppendAttribute(QByteArray* out, const char* name, const char* type, const QByteArray& value)
+{
+    out->append(name, std::strlen(name) + 1);
+    out->append(type, std::strlen(type) + 1);
+    AppendValue<int32_t>(out, value.size());
+    out->append(value);
+}
+
+static QByteArray Box2i(const QRect& box)
+{
+    QByteArray value;
+    AppendValue<int32_t>(&value, box.left());
+    AppendValue<int32_t>(&value, box.top());
+    AppendValue<int32_t>(&value, box.right());
+    AppendValue<int32_t>(&value, box.bottom());
+    return value;
+}
+
+//one channel of the file, pointing at the AOV buffer holding it
+struct EXRChannel
+{
+    const char* name;
+    //EXR pixel type: 0 is UINT, 2 is FLOAT
+    int32_t pixelType;
+    const char* data;
+};
+
+bool SaveAOVsEXR(const AOVBuffers& aovs, const QString& filename)
+{
+    //channels must be listed in alphabetical order, and are stored in that order within each scanline
+    std::vector<EXRChannel> channels;
+    if(aovs.m_flags & AOV_NORMAL)
+    {
+        channels.push_back({"N.X", 2, reinterpret_cast<const char*>(aovs.m_normalX.data())});
+        channels.push_back({"N.Y", 2, reinterpret_cast<const char*>(aovs.m_normalY.data())});
+        channels.push_back({"N.Z", 2, reinterpret_cast<const char*>(aovs.m_normalZ.data())});
+    }
+    if(aovs.m_flags & AOV_DEPTH)
+    {
+        channels.push_back({"Z", 2, reinterpret_cast<const char*>(aovs.m_depth.data())});
+    }
+    if(aovs.m_flags & AOV_OBJECT_ID)
+    {
+        channels.push_back({"objectID", 0, reinterpret_cast<const char*>(aovs.m_objectID.data())});
+    }
+    if(aovs.m_flags & AOV_TRIANGLE_ID)
+    {
+        channels.push_back({"triangleID", 0, reinterpret_cast<const char*>(aovs.m_triangleID.data())});
+    }
+    if(channels.empty() || aovs.m_region.isEmpty())
+    {
+        return false;
+    }
+
+    QByteArray channelList;
+    for(const EXRChannel& channel : channels)
+    {
+        channelList.append(channel.name, std::strlen(channel.name) + 1);
+        AppendValue<int32_t>(&channelList, channel.pixelType);
+        //pLinear and 3 reserved bytes
+        AppendValue<int32_t>(&channelList, 0);
+        //x and y sampling
+        AppendValue<int32_t>(&channelList, 1);
+        AppendValue<int32_t>(&channelList, 1);
+    }
+    channelList.append('\0');
+
+    QByteArray header;
+    //magic number, then version 2 of a single part scanline file
+    AppendValue<int32_t>(&header, 20000630);
+    AppendValue<int32_t>(&header, 2);
+    AppendAttribute(&header, "channels", "chlist", channelList);
+    AppendAttribute(&header, "compression", "compression", QByteArray(1, '\0'));
+    AppendAttribute(&header, "dataWindow", "box2i", Box2i(aovs.m_region));
+    AppendAttribute(&header, "displayWindow", "box2i", Box2i(QRect(0, 0, aovs.m_frameWidth, aovs.m_frameHeight)));
+    AppendAttribute(&header, "lineOrder", "lineOrder", QByteArray(1, '\0'));
+    QByteArray one;
+    AppendValue<float>(&one, 1.0f);
+    AppendAttribute(&header, "pixelAspectRatio", "float", one);
+    AppendAttribute(&header, "screenWindowCenter", "v2f", QByteArray(8, '\0'));
+    AppendAttribute(&header, "screenWindowWidth", "float", one);
+    header.append('\0');
+
+    //every scanline is a block of its own: y, the byte count, then the row of each channel in turn
+    const int width = aovs.m_region.width();
+    const int height = aovs.m_region.height();
+    const int32_t rowBytes = width * 4;
+    const int32_t blockBytes = 8 + rowBytes * static_cast<int32_t>(channels.size());
+
+    //the offset table gives the position of every block in the file
+    uint64_t firstBlock = header.size() + 8 * static_cast<uint64_t>(height);
+    for(int y = 0; y < height; y++)
+    {
+        AppendValue<uint64_t>(&header, firstBlock + static_cast<uint64_t>(y) * blockBytes);
+    }
+
+    QFile file(filename);
+    if(!file.open(QIODevice::WriteOnly))
+    {
+        return false;
+    }
+    bool written = file.write(header) == header.size();
+    for(int y = 0; y < height && written; y++)
+    {
+        int32_t blockStart[2] = {aovs.m_region.top() + y, rowBytes * static_cast<int32_t>(channels.size())};
+        written = file.write(reinterpret_cast<const char*>(blockStart), 8) == 8;
+        for(const EXRChannel& channel : channels)
+        {
+            //straight from the AOV buffer, without an intermediate copy
+            written = written && file.write(channel.data + static_cast<size_t>(y) * rowBytes, rowBytes) == rowBytes;
+        }
+    }
+    return written;
+}
+
+//** PFM **
+
+bool SaveDepthPFM(const AOVBuffers& aovs, const QString& filename)
+{
+    if(!(aovs.m_flags & AOV_DEPTH) || aovs.m_region.isEmpty())
+    {
+        return false;
+    }
+    const int width = aovs.m_region.width();
+    const int height = aovs.m_region.height();
+
+    QFile file(filename);
+    if(!file.open(QIODevice::WriteOnly))
+    {
+        return false;
+    }
+    //a negative scale marks little-endian data
+    QByteArray header = QString("Pf\n%1 %2\n-1.0\n").arg(width).arg(height).toUtf8();
+    bool written = file.write(header) == header.size();
+    //PFM stores the bottom row first
+    const qint64 rowBytes = width * sizeof(float);
+    for(int y = height - 1; y >= 0 && written; y--)
+    {
+        written = file.write(reinterpret_cast<const char*>(aovs.m_depth.data() + static_cast<size_t>(y) * width), rowBytes) == rowBytes;
+    }
+    return written;
+}
+
+QString AOVFileExtension(AOVFileFormat format)
+{
+    return format == AOVFileFormat::Pfm ? QString("pfm") : QString("exr");
+}
+
+bool SaveAOVs(const AOVBuffers& aovs, AOVFileFormat format, const QString& filename)
+{
+    return format == AOVFileFormat::Pfm ? SaveDepthPFM(aovs, filename) : SaveAOVsEXR(aovs, filename);
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <QRect>
+#include <QString>
+#include <vector>
+#include <glm/glm.hpp>
+
+// The auxiliary per-pixel outputs ("AOVs") RenderScene can keep besides the color image.
+// Combine them with | to enable several at once.
+enum AOVFlags : unsigned int
+{
+    AOV_NONE = 0,
+    // Post-projection depth: 0 on the near clip plane and 1 on the far one,
+    // or the other way around with a reversed-Z DepthFormat
+    AOV_DEPTH = 1,
+    // Index of the drawn Instance plus one
+    AOV_OBJECT_ID = 2,
+    // Index of the drawn Triangle within its Polygon plus one
+    AOV_TRIANGLE_ID = 4,
+    // Interpolated world space normal
+    AOV_NORMAL = 8,
+    AOV_ALL = AOV_DEPTH | AOV_OBJECT_ID | AOV_TRIANGLE_ID | AOV_NORMAL
+};
+
+// The file formats AOVs can be written in
+enum class AOVFileFormat
+{
+    // Every enabled AOV as a channel of one OpenEXR file
+    Exr,
+    // The depth AOV alone, as a PFM image most image tools can open
+    Pfm
+};
+
+// The AOVs of the last frame rendered. Each buffer covers the region that was drawn,
+// row by row, and is empty unless its AOV is enabled. Pixels nothing was drawn on hold
+// IDs of 0, a normal of (0, 0, 0) and a depth of float max (0 with reversed-Z).
+//
+// Every buffer is a single channel (normals are split into X, Y and Z planes) because that is
+// exactly how EXR stores a scanline, so the files below are written straight from these buffers.
+struct AOVBuffers
+{
+    unsigned int m_flags;
+    // Size of the full frame, and the part of it the buffers cover
+    int m_frameWidth;
+    int m_frameHeight;
+    QRect m_region;
+
+    // The depth buffer doubles as the z-buffer while the frame is rendered
+    std::vector<float> m_depth;
+    std::vector<glm::uint> m_objectID;
+    std::vector<glm::uint> m_triangleID;
+    std::vector<float> m_normalX;
+    std::vector<float> m_normalY;
+    std::vector<float> m_normalZ;
+
+    AOVBuffers();
+
+    // Sizes the enabled buffers for a region of a frame and clears them to the values
+    // of an empty pixel, with emptyDepth for depth. Buffers of disabled AOVs are released.
+    void Reset(unsigned int flags, int frameWidth, int frameHeight, const QRect& region, float emptyDepth);
+};
+
+// Writes every enabled AOV as a channel of one uncompressed OpenEXR file:
+// Z (float), objectID (uint), triangleID (uint), N.X, N.Y and N.Z (float).
+// The file's data window is the region that was drawn within the full frame.
+bool SaveAOVsEXR(const AOVBuffers& aovs, const QString& filename);
+
+// Writes the depth AOV as a single channel 32-bit float PFM image
+bool SaveDepthPFM(const AOVBuffers& aovs, const QString& filename);
+
+// The file extension used for an AOV file format, without the dot
+QString AOVFileExtension(AOVFileFormat format);
+
+// Writes the AOVs in the given format (see SaveAOVsEXR and SaveDepthPFM)
+bool SaveAOVs(const AOVBuffers& aovs, AOVFileFormat format, const QString& filename);
@@ -0,0 +1,81 @@
+#include "batchrender.h"
+#include "framewriter.h"
+#include <QDir>
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+bool RenderSequence(const Rasterizer& prototype, const CameraPath& path, const QString& outputDir,
+                    const EncoderSettings& settings, unsigned int threadCount, AOVFileFormat aovFormat)
+{
+    if(threadCount == 0)
+    {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    bool streaming = outputDir == QString("-");
+    //AOVs always go to files, in the working directory when the images are streamed
+    QDir dir(streaming ? QString(".") : outputDir);
+    if(!streaming && !dir.exists() && !dir.mkpath(QString(".")))
+    {
+        std::cout << "Could not create " << outputDir.toStdString() << std::endl;
+        return false;
+    }
+
+    //a couple of finished frames per thread may wait to be written before rendering stalls
+    FrameWriter writer(2 * threadCount);
+    //each thread claims the next frame nobody has started yet
+    std::atomic<int> nextFrame(0);
+    std::atomic<int> framesDone(0);
+    std::atomic<int> aovFailures(0);
+
+    std::vector<std::thread> threads;
+    for(unsigned int t = 0; t < threadCount; t++)
+    {
+        threads.emplace_back([&]() {
+            //per-thread camera, arena and color buffers; the scene itself is shared and read-only
+            Rasterizer rasterizer(prototype);
+            //frames already keep every core busy, so each one is post-processed on its own thread
+            if(threadCount > 1)
+            {
+                PostProcessChain postProcess = prototype.GetPostProcess();
+                postProcess.SetThreadCount(1);
+                rasterizer.SetPostProcess(postProcess);
+            }
+            for(int frame = nextFrame++; frame < path.frameCount; frame = nextFrame++)
+            {
+                rasterizer.getCamera() = path.cameraAt(frame, prototype.getCamera());
+                QImage image = rasterizer.RenderScene();
+                if(streaming)
+                {
+                    writer.Stream(image, frame, settings);
+                }
+                else
+                {
+                    QString filename = QString("frame_%1.%2").arg(frame, 4, 10, QChar('0')).arg(ImageFormatExtension(settings.m_format));
+                    writer.Write(image, dir.filePath(filename), settings);
+                }
+                //AOVs are written straight from the rasterizer's buffers before the next frame reuses them
+                if(rasterizer.GetAOVs().m_flags != AOV_NONE)
+                {
+                    QString aovFilename = dir.filePath(QString("frame_%1.%2").arg(frame, 4, 10, QChar('0')).arg(AOVFileExtension(aovFormat)));
+                    if(!SaveAOVs(rasterizer.GetAOVs(), aovFormat, aovFilename))
+                    {
+                        std::cerr << "Could not write " << aovFilename.toStdString() << std::endl;
+                        aovFailures++;
+                    }
+                }
+                //progress goes to standard error, so it never mixes with frames streamed to standard output
+                std::cerr << "Rendered frame " << ++framesDone << "/" << path.frameCount << std::endl;
+            }
+        });
+    }
+    for(std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    writer.Finish();
+    return writer.GetFailureCount() == 0 && aovFailures == 0;
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include <QString>
+#include <rasterizer.h>
+#include <camerapath.h>
+#include <imageencoder.h>
+
+// Renders every frame of a camera path to numbered images (frame_0000.png, frame_0001.png, ...)
+// in the output folder, encoded as the settings say. An output folder of "-" instead streams
+// the frames, in order, to standard output.
+// Frames are rendered in parallel on threadCount threads (0 picks one per core),
+// each drawing with its own copy of the prototype Rasterizer that shares the prototype's scene.
+// Images are encoded and saved by a separate writer thread while rendering continues.
+// If the prototype keeps AOVs, each frame's are also saved to frame_0000.exr, frame_0001.exr, ...
+// (or .pfm, for the depth alone, with AOVFileFormat::Pfm).
+// Returns false if any frame could not be written.
+bool RenderSequence(const Rasterizer& prototype, const CameraPath& path, const QString& outputDir,
+                    const EncoderSettings& settings, unsigned int threadCount,
+                    AOVFileFormat aovFormat = AOVFileFormat::Exr);
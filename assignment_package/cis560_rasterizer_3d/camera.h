@@ -90,6 +90,17 @@ public:
         return projectionMatrix;
     }
 
+    // The same projection with depth reversed: z/w is 1 on the near clip plane and 0 on the far one.
+    // Computing it this way, rather than as 1 - z afterwards, keeps the precision reversing is meant to gain.
+    glm::mat4 getReversedProjectionMatrix() {
+        glm::mat4 projectionMatrix = getProjectionMatrix();
+
+        projectionMatrix[2][2] = -nearClip / (farClip - nearClip);
+        projectionMatrix[3][2] = (farClip * nearClip)/(farClip - nearClip);
+
+        return projectionMatrix;
+    }
+
     //Three functions that translate the camera along each of its local axes, both forward and backward.
     //The amount of translation should be determined by an input to the function.
 
@@ -0,0 +1,88 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+#include <cmath>
+#include <camera.h>
+
+// The pose of a Camera at one point along a CameraPath
+struct CameraKeyframe {
+    glm::vec3 position;
+    glm::vec3 forward;
+    glm::vec3 up;
+};
+
+// A sequence of camera poses to render a scene from, one image per frame.
+// The path is either a list of keyframes spread evenly over the frames and blended
+// linearly between, or a turntable orbit around a point.
+class CameraPath {
+public:
+    int frameCount;
+
+    std::vector<CameraKeyframe> keyframes;
+
+    bool turntable;
+    glm::vec3 orbitCenter; //the point the camera circles and looks at
+    float orbitRadius;     //horizontal distance from the center
+    float orbitHeight;     //height above the center
+    float orbitDegrees;    //how far the camera travels over the whole path; 360 for a full spin
+
+public:
+    CameraPath() :
+        frameCount(0),
+        keyframes(),
+        turntable(false),
+        orbitCenter(0.0f),
+        orbitRadius(10.0f),
+        orbitHeight(0.0f),
+        orbitDegrees(360.0f) {
+    }
+
+    // Returns a copy of the base camera (keeping its fov, clip planes and aspect ratio)
+    // moved to this path's pose at the given frame
+    Camera cameraAt(int frame, const Camera& base) const {
+        CameraKeyframe pose = poseAt(frame);
+
+        Camera camera = base;
+        glm::vec3 forward = glm::normalize(pose.forward);
+        //rebuild an orthonormal basis in case blending keyframes skewed forward and up
+        glm::vec3 right = glm::normalize(glm::cross(forward, pose.up));
+        glm::vec3 up = glm::cross(right, forward);
+
+        camera.position = glm::vec4(pose.position, 1.0f);
+        camera.forward = glm::vec4(forward, 0.0f);
+        camera.right = glm::vec4(right, 0.0f);
+        camera.up = glm::vec4(up, 0.0f);
+        return camera;
+    }
+
+private:
+    CameraKeyframe poseAt(int frame) const {
+        //fraction of the way along the path
+        float t = frameCount > 1 ? static_cast<float>(frame) / frameCount : 0.0f;
+
+        if (turntable) {
+            //a full spin should not repeat its first frame at the end, so t never reaches 1
+            float angle = glm::radians(orbitDegrees * t);
+            glm::vec3 position = orbitCenter + glm::vec3(orbitRadius * std::sin(angle), orbitHeight, orbitRadius * std::cos(angle));
+            return CameraKeyframe{position, orbitCenter - position, glm::vec3(0.0f, 1.0f, 0.0f)};
+        }
+
+        if (keyframes.empty()) {
+            return CameraKeyframe{glm::vec3(0.0f, 0.0f, 10.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f)};
+        }
+        if (keyframes.size() == 1) {
+            return keyframes[0];
+        }
+
+        //keyframes land on the first and last frames, with the rest spread evenly in between
+        float segment = frameCount > 1 ? static_cast<float>(frame) / (frameCount - 1) * (keyframes.size() - 1) : 0.0f;
+        unsigned int i = glm::min(static_cast<unsigned int>(segment), static_cast<unsigned int>(keyframes.size() - 2));
+        float blend = glm::clamp(segment - i, 0.0f, 1.0f);
+
+        const CameraKeyframe& a = keyframes[i];
+        const CameraKeyframe& b = keyframes[i + 1];
+        return CameraKeyframe{glm::mix(a.position, b.position, blend),
+                              glm::mix(glm::normalize(a.forward), glm::normalize(b.forward), blend),
+                              glm::mix(glm::normalize(a.up), glm::normalize(b.up), blend)};
+    }
+};
@@ -0,0 +1,80 @@
+#pragma once
+#include <cstdint>
+#include <limits>
+#include <glm/glm.hpp>
+#include <camera.h>
+
+// How the Rasterizer's z-buffer stores depth
+enum class DepthFormat
+{
+    // Post-projection z as a float: 0 on the near clip plane, 1 on the far one
+    Float32,
+    // Reversed-Z: 1 on the near plane, 0 on the far one. Floats are densest near 0, which
+    // reversing puts in the distance where the projection squeezes depth the most, so this
+    // has far more usable precision than Float32 and avoids z-fighting between distant surfaces
+    ReversedFloat32,
+    // z quantized to 24 or 16 bits, stored in 3 or 2 bytes, for 3/4 or 1/2 the memory traffic of
+    // the float formats on large frames. Fixed point spends its precision evenly, so these need a
+    // near plane that is not much closer than the scene
+    Unorm24,
+    Unorm16
+};
+
+// Everything the rasterizer needs to know about a depth format. Each one is a type, so the
+// raster loop is compiled separately for each and the depth test and clear are inlined.
+//   Value         what one z-buffer element holds
+//   Clear()       what the z-buffer holds where nothing has been drawn
+//   Encode(z)     converts the z of a fragment, as produced by Projection(), to a Value
+//   Passes(a, b)  whether a fragment with depth a is in front of a stored depth b
+//   Projection()  the camera's projection matrix for the format
+struct DepthFloat32
+{
+    typedef float Value;
+    static Value Clear() { return std::numeric_limits<float>::max(); }
+    static Value Encode(float z) { return z; }
+    static bool Passes(Value incoming, Value stored) { return incoming < stored; }
+    static glm::mat4 Projection(Camera& camera) { return camera.getProjectionMatrix(); }
+};
+
+struct DepthReversedFloat32
+{
+    typedef float Value;
+    static Value Clear() { return 0.0f; }
+    static Value Encode(float z) { return z; }
+    static bool Passes(Value incoming, Value stored) { return incoming > stored; }
+    static glm::mat4 Projection(Camera& camera) { return camera.getReversedProjectionMatrix(); }
+};
+
+// A 24-bit unsigned integer packed into 3 bytes, so a buffer of them takes 3/4 of the memory of
+// one of 32-bit integers. It converts to and from std::uint32_t, which does the arithmetic
+struct PackedUint24
+{
+    std::uint8_t m_bytes[3];
+
+    PackedUint24() = default;
+    PackedUint24(std::uint32_t value)
+        : m_bytes{static_cast<std::uint8_t>(value), static_cast<std::uint8_t>(value >> 8), static_cast<std::uint8_t>(value >> 16)}
+    {}
+    operator std::uint32_t() const {
+        return m_bytes[0] | (static_cast<std::uint32_t>(m_bytes[1]) << 8) | (static_cast<std::uint32_t>(m_bytes[2]) << 16);
+    }
+};
+static_assert(sizeof(PackedUint24) == 3, "PackedUint24 must not be padded");
+
+struct DepthUnorm24
+{
+    typedef PackedUint24 Value;
+    static Value Clear() { return 0xffffffu; }
+    static Value Encode(float z) { return static_cast<std::uint32_t>(glm::clamp(z, 0.0f, 1.0f) * 16777215.0f + 0.5f); }
+    static bool Passes(Value incoming, Value stored) { return static_cast<std::uint32_t>(incoming) < static_cast<std::uint32_t>(stored); }
+    static glm::mat4 Projection(Camera& camera) { return camera.getProjectionMatrix(); }
+};
+
+struct DepthUnorm16
+{
+    typedef std::uint16_t Value;
+    static Value Clear() { return 0xffff; }
+    static Value Encode(float z) { return static_cast<Value>(glm::clamp(z, 0.0f, 1.0f) * 65535.0f + 0.5f); }
+    static bool Passes(Value incoming, Value stored) { return incoming < stored; }
+    static glm::mat4 Projection(Camera& camera) { return camera.getProjectionMatrix(); }
+};
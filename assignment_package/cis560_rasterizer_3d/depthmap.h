@@ -0,0 +1,20 @@
+#pragma once
+#include <vector>
+
+// Post-projection depth of every pixel of an image, as drawn by Rasterizer::RenderDepth.
+// Depth is 0 on the near clip plane and 1 on the far one; pixels nothing was drawn on hold float max.
+struct DepthMap
+{
+    int m_width;
+    int m_height;
+    // Row by row, from the top left pixel
+    std::vector<float> m_depth;
+
+    DepthMap()
+        : m_width(0), m_height(0), m_depth()
+    {}
+
+    float At(int x, int y) const {
+        return m_depth[y * m_width + x];
+    }
+};
@@ -0,0 +1,95 @@
+#include "framearena.h"
+#include <algorithm>
+
+Arena::Arena(size_t blockSize)
+    : m_blocks(), m_block(0), m_offset(0), m_blockSize(blockSize)
+{}
+
+void* Arena::Allocate(size_t bytes, size_t alignment)
+{
+    //try the current block, then any later blocks kept from earlier frames
+    while(m_block < m_blocks.size())
+    {
+        Block& block = m_blocks[m_block];
+        size_t aligned = (m_offset + alignment - 1) & ~(alignment - 1);
+        if(aligned + bytes <= block.size)
+        {
+            m_offset = aligned + bytes;
+            return block.data.get() + aligned;
+        }
+        //a kept block that is too small is skipped rather than freed, so it can be used again next frame
+        m_block++;
+        m_offset = 0;
+    }
+
+    //out of room: grow by one block large enough for this request
+    Block block;
+    block.size = std::max(m_blockSize, bytes + alignment);
+    block.data.reset(new char[block.size]);
+    m_blocks.push_back(std::move(block));
+    m_block = m_blocks.size() - 1;
+    m_offset = 0;
+    return Allocate(bytes, alignment);
+}
+
+Arena::Marker Arena::Mark() const
+{
+    return Marker{m_block, m_offset};
+}
+
+void Arena::Rewind(const Marker& marker)
+{
+    m_block = marker.block;
+    m_offset = marker.offset;
+}
+
+void Arena::Reset()
+{
+    m_block = 0;
+    m_offset = 0;
+}
+
+size_t Arena::GetCapacity() const
+{
+    size_t capacity = 0;
+    for(const Block& block : m_blocks)
+    {
+        capacity += block.size;
+    }
+    return capacity;
+}
+
+FrameArena::FrameArena(unsigned int threadCount)
+    : m_arenas(std::max(threadCount, 1u))
+{}
+
+FrameArena::FrameArena(const FrameArena& other)
+    : m_arenas(other.m_arenas.size())
+{}
+
+FrameArena& FrameArena::operator=(const FrameArena& other)
+{
+    if(this != &other)
+    {
+        m_arenas = std::vector<Arena>(other.m_arenas.size());
+    }
+    return *this;
+}
+
+Arena& FrameArena::ForThread(unsigned int thread)
+{
+    return m_arenas[thread];
+}
+
+unsigned int FrameArena::ThreadCount() const
+{
+    return m_arenas.size();
+}
+
+void FrameArena::Reset()
+{
+    for(Arena& arena : m_arenas)
+    {
+        arena.Reset();
+    }
+}
@@ -0,0 +1,107 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// A bump allocator for data that only lives while one frame is being rendered.
+// Allocating moves a pointer forward through large blocks of memory, and nothing is
+// freed individually: Reset() makes all of the memory available again in constant time.
+// Blocks are kept across resets, so once the arena has grown to fit a frame, rendering
+// further frames of similar size does not touch the heap at all.
+class Arena
+{
+public:
+    // A position in the arena that can be returned to with Rewind(),
+    // releasing everything allocated after it was taken
+    struct Marker
+    {
+        size_t block;
+        size_t offset;
+    };
+
+    explicit Arena(size_t blockSize = 4 << 20);
+
+    // Returns uninitialized memory that stays valid until the arena is reset or rewound past it
+    void* Allocate(size_t bytes, size_t alignment);
+
+    template <typename T>
+    T* AllocateArray(size_t count)
+    {
+        return static_cast<T*>(Allocate(count * sizeof(T), alignof(T)));
+    }
+
+    Marker Mark() const;
+    void Rewind(const Marker& marker);
+
+    // Makes all of the arena's memory available again
+    void Reset();
+
+    // The total number of bytes the arena has obtained from the heap
+    size_t GetCapacity() const;
+
+private:
+    struct Block
+    {
+        std::unique_ptr<char[]> data;
+        size_t size;
+    };
+
+    std::vector<Block> m_blocks;
+    // The block currently being allocated from, and the first free byte in it
+    size_t m_block;
+    size_t m_offset;
+    size_t m_blockSize;
+};
+
+// One Arena per rendering thread, so threads can allocate without locking.
+// Copying a FrameArena gives an empty arena with the same number of threads,
+// since the contents of a frame's scratch memory are never worth copying.
+class FrameArena
+{
+public:
+    explicit FrameArena(unsigned int threadCount = 1);
+    FrameArena(const FrameArena& other);
+    FrameArena& operator=(const FrameArena& other);
+
+    // The sub-arena reserved for the thread with the given index
+    Arena& ForThread(unsigned int thread);
+    unsigned int ThreadCount() const;
+
+    // Resets every sub-arena. Called once at the end of each frame.
+    void Reset();
+
+private:
+    std::vector<Arena> m_arenas;
+};
+
+// Lets standard containers allocate from an Arena.
+// Deallocation does nothing; the memory is reclaimed when the arena is reset.
+template <typename T>
+class ArenaAllocator
+{
+public:
+    typedef T value_type;
+
+    explicit ArenaAllocator(Arena& arena) : mp_arena(&arena) {}
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : mp_arena(other.mp_arena) {}
+
+    T* allocate(size_t count)
+    {
+        return mp_arena->AllocateArray<T>(count);
+    }
+
+    void deallocate(T*, size_t) {}
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const { return mp_arena == other.mp_arena; }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const { return mp_arena != other.mp_arena; }
+
+    Arena* mp_arena;
+};
+
+// A std::vector whose storage lives in an Arena
+template <typename T>
+using FrameVector = std::vector<T, ArenaAllocator<T>>;
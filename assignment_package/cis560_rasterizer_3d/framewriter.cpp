@@ -0,0 +1,140 @@
+#include "framewriter.h"
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+FrameWriter::FrameWriter(size_t maxQueued)
+    : m_queue(), m_maxQueued(std::max<size_t>(maxQueued, 1)), m_finishing(false), m_failures(0),
+      m_mutex(), m_queueChanged(), m_heldFrames(), m_nextStreamFrame(0), m_streamStarted(false), m_thread()
+{
+    //started last, once every member it reads has been initialized
+    m_thread = std::thread(&FrameWriter::Run, this);
+}
+
+FrameWriter::~FrameWriter()
+{
+    Finish();
+}
+
+void FrameWriter::Write(const QImage& image, const QString& filename, const EncoderSettings& settings)
+{
+    Queue(Job{image, filename, 0, settings});
+}
+
+void FrameWriter::Stream(const QImage& image, int frame, const EncoderSettings& settings)
+{
+    Queue(Job{image, QString(), frame, settings});
+}
+
+void FrameWriter::Queue(Job job)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_queueChanged.wait(lock, [this]() { return m_queue.size() < m_maxQueued; });
+    //QImage is implicitly shared, so queuing it does not copy the pixels
+    m_queue.push_back(std::move(job));
+    m_queueChanged.notify_all();
+}
+
+void FrameWriter::Finish()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_finishing = true;
+    }
+    m_queueChanged.notify_all();
+    if(m_thread.joinable())
+    {
+        m_thread.join();
+    }
+}
+
+int FrameWriter::GetFailureCount() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_failures;
+}
+
+bool FrameWriter::WriteToStream(const Job& job)
+{
+    QByteArray data;
+    if(!m_streamStarted && job.settings.m_format == ImageFormat::Y4m)
+    {
+        data = Y4MStreamHeader(job.image.width(), job.image.height(), job.settings.m_frameRate);
+    }
+    m_streamStarted = true;
+    if(!EncodeImage(job.image, job.settings, &data))
+    {
+        return false;
+    }
+    bool written = std::fwrite(data.constData(), 1, data.size(), stdout) == static_cast<size_t>(data.size());
+    std::fflush(stdout);
+    return written;
+}
+
+void FrameWriter::Run()
+{
+    while(true)
+    {
+        Job job;
+        bool finished = false;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_queueChanged.wait(lock, [this]() { return !m_queue.empty() || m_finishing; });
+            if(m_queue.empty())
+            {
+                finished = true;
+            }
+            else
+            {
+                job = std::move(m_queue.front());
+                m_queue.pop_front();
+            }
+        }
+
+        //the frames that can be written now
+        std::vector<Job> ready;
+        if(finished)
+        {
+            //nothing more is coming, so frames still waiting for a missing one go out as they are
+            for(auto& held : m_heldFrames)
+            {
+                ready.push_back(std::move(held.second));
+            }
+            m_heldFrames.clear();
+        }
+        else if(job.filename.isEmpty())
+        {
+            m_heldFrames[job.frame] = std::move(job);
+            for(auto next = m_heldFrames.find(m_nextStreamFrame); next != m_heldFrames.end();
+                next = m_heldFrames.find(m_nextStreamFrame))
+            {
+                ready.push_back(std::move(next->second));
+                m_heldFrames.erase(next);
+                m_nextStreamFrame++;
+            }
+        }
+        else
+        {
+            ready.push_back(std::move(job));
+        }
+        //wake a renderer that may be waiting for room in the queue
+        m_queueChanged.notify_all();
+
+        //encode and write without holding the lock so renderers can keep queuing
+        for(const Job& r : ready)
+        {
+            bool written = r.filename.isEmpty() ? WriteToStream(r) : SaveImage(r.image, r.filename, r.settings);
+            if(!written)
+            {
+                std::cerr << "Could not write " << (r.filename.isEmpty() ? std::string("frame to standard output") : r.filename.toStdString()) << std::endl;
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_failures++;
+            }
+        }
+        if(finished)
+        {
+            return;
+        }
+    }
+}
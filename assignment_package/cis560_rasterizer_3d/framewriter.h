@@ -0,0 +1,65 @@
+#pragma once
+#include <QImage>
+#include <QString>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <imageencoder.h>
+
+// Encodes and saves images on a thread of its own, so the threads rendering them never wait
+// for encoding or disk I/O. Images are queued in the order Write() is called.
+// If the queue is full, Write() blocks until the writer catches up, which bounds
+// the number of finished frames held in memory.
+//
+// Frames can also be streamed to standard output (e.g. to pipe Y4M or raw RGBA into a video
+// encoder). Streamed frames are written in frame order, whatever order they are queued in.
+class FrameWriter
+{
+public:
+    explicit FrameWriter(size_t maxQueued = 8);
+    // Waits for every queued image to be written
+    ~FrameWriter();
+
+    // Queues an image to be saved to the given file
+    void Write(const QImage& image, const QString& filename, const EncoderSettings& settings);
+
+    // Queues frame number frame (counting from 0) of the stream written to standard output
+    void Stream(const QImage& image, int frame, const EncoderSettings& settings);
+
+    // Waits for every queued image to be written, then stops the writer thread
+    void Finish();
+
+    // The number of images that could not be saved
+    int GetFailureCount() const;
+
+private:
+    struct Job
+    {
+        QImage image;
+        // Empty for frames of the standard output stream
+        QString filename;
+        int frame;
+        EncoderSettings settings;
+    };
+
+    void Queue(Job job);
+    void Run();
+    // Writes one frame to standard output, starting the stream first if needed
+    bool WriteToStream(const Job& job);
+
+    std::deque<Job> m_queue;
+    size_t m_maxQueued;
+    bool m_finishing;
+    int m_failures;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_queueChanged;
+
+    // Only used by the writer thread: streamed frames that arrived ahead of their turn
+    std::map<int, Job> m_heldFrames;
+    int m_nextStreamFrame;
+    bool m_streamStarted;
+
+    std::thread m_thread;
+};
@@ -0,0 +1,47 @@
+#pragma once
+#include <glm/glm.hpp>
+
+// The six planes bounding the region of space a camera can see.
+// Planes are extracted from a combined projection * view (* model) matrix, so they live in
+// whatever space that matrix takes as input. Each plane is stored as (normal.xyz, distance)
+// with the normal pointing into the visible region.
+class Frustum {
+public:
+    glm::vec4 planes[6];
+
+public:
+    // Extracts the planes of the clip volume -w <= x <= w, -w <= y <= w, 0 <= z <= w
+    // which is the volume produced by Camera::getProjectionMatrix
+    explicit Frustum(const glm::mat4& m) {
+        //rows of the matrix (glm stores matrices column-major)
+        glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+        glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+        glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+        glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+        planes[0] = row3 + row0; // left
+        planes[1] = row3 - row0; // right
+        planes[2] = row3 + row1; // bottom
+        planes[3] = row3 - row1; // top
+        planes[4] = row2;        // near
+        planes[5] = row3 - row2; // far
+
+        //normalize so distances to the planes are measured in the input space's units
+        for (glm::vec4& plane : planes) {
+            float length = glm::length(glm::vec3(plane));
+            if (length > 0.0f) {
+                plane /= length;
+            }
+        }
+    }
+
+    // Returns false if the sphere lies entirely outside of the frustum
+    bool intersectsSphere(const glm::vec3& center, float radius) const {
+        for (const glm::vec4& plane : planes) {
+            if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
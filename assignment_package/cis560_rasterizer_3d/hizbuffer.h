@@ -0,0 +1,177 @@
+#pragma once
+#include <algorithm>
+#include <framearena.h>
+
+// A two level depth pyramid kept alongside a z-buffer, so hidden triangles can be thrown
+// away before any of their pixels are shaded. Level 0 holds the nearest and farthest depth
+// of each 8x8 tile of pixels, level 1 the farthest depth of each block of 8x8 tiles.
+//
+// Depths only ever move closer, so a farthest depth that has not caught up with the z-buffer
+// is still a safe bound. While a tile still has empty pixels its farthest depth is the clear
+// value; after that it is only recomputed when the pixel holding it was drawn over, and not
+// until it is next needed. Nearest depths are kept exact.
+//
+// Depth is one of the formats in depthformat.h; values are compared in its encoding.
+template <typename Depth>
+class HiZBuffer
+{
+public:
+    typedef typename Depth::Value Value;
+    static const int TILE_SHIFT = 3;
+    static const int TILE_SIZE = 1 << TILE_SHIFT;
+    static const int BLOCK_SHIFT = 3;
+
+    // Covers a width x height z-buffer, cleared to Depth::Clear()
+    HiZBuffer(const Value* zBuffer, int width, int height, Arena& arena)
+        : mp_zBuffer(zBuffer), m_width(width), m_height(height),
+          m_tilesX((width + TILE_SIZE - 1) >> TILE_SHIFT), m_tilesY((height + TILE_SIZE - 1) >> TILE_SHIFT),
+          m_blocksX((m_tilesX + (1 << BLOCK_SHIFT) - 1) >> BLOCK_SHIFT), m_blocksY((m_tilesY + (1 << BLOCK_SHIFT) - 1) >> BLOCK_SHIFT),
+          m_tileNearest(m_tilesX * m_tilesY, Depth::Clear(), ArenaAllocator<Value>(arena)),
+          m_tileFarthest(m_tilesX * m_tilesY, Depth::Clear(), ArenaAllocator<Value>(arena)),
+          m_tileEmpty(m_tilesX * m_tilesY, TILE_SIZE * TILE_SIZE, ArenaAllocator<unsigned short>(arena)),
+          m_tileStale(m_tilesX * m_tilesY, 0, ArenaAllocator<unsigned char>(arena)),
+          m_blockFarthest(m_blocksX * m_blocksY, Depth::Clear(), ArenaAllocator<Value>(arena)),
+          m_blockStale(m_blocksX * m_blocksY, 0, ArenaAllocator<unsigned char>(arena))
+    {
+        //tiles along the right and bottom edges may be cut short
+        for (int ty = 0; ty < m_tilesY; ty++) {
+            for (int tx = 0; tx < m_tilesX; tx++) {
+                int w = std::min(TILE_SIZE, width - (tx << TILE_SHIFT));
+                int h = std::min(TILE_SIZE, height - (ty << TILE_SHIFT));
+                m_tileEmpty[ty * m_tilesX + tx] = static_cast<unsigned short>(w * h);
+            }
+        }
+    }
+
+    // The tile holding pixel (x, y)
+    int TileAt(int x, int y) const {
+        return (y >> TILE_SHIFT) * m_tilesX + (x >> TILE_SHIFT);
+    }
+
+    // Whether every pixel of the tile already holds something at least as close as nearest,
+    // so no fragment that far away can be drawn there
+    bool TileHidden(int tile, Value nearest) {
+        if (m_tileStale[tile]) {
+            RefreshTile(tile);
+        }
+        return !Depth::Passes(nearest, m_tileFarthest[tile]);
+    }
+
+    // Whether a fragment no farther than farthest is in front of everything in the tile,
+    // so its depth test is sure to pass
+    bool TileExposed(int tile, Value farthest) const {
+        return Depth::Passes(farthest, m_tileNearest[tile]);
+    }
+
+    // Whether the pixels from (minX, minY) to (maxX, maxY) all hold something at least as close
+    // as nearest. Whole blocks are tested first, and only partly hidden blocks tile by tile.
+    bool RectHidden(int minX, int minY, int maxX, int maxY, Value nearest) {
+        int tileMinX = minX >> TILE_SHIFT, tileMaxX = maxX >> TILE_SHIFT;
+        int tileMinY = minY >> TILE_SHIFT, tileMaxY = maxY >> TILE_SHIFT;
+        //most triangles touch a tile or two, where refreshing whole blocks would cost more than it saves
+        if ((tileMaxX - tileMinX + 1) * (tileMaxY - tileMinY + 1) <= 4) {
+            return TilesHidden(tileMinX, tileMinY, tileMaxX, tileMaxY, nearest);
+        }
+        for (int by = tileMinY >> BLOCK_SHIFT; by <= tileMaxY >> BLOCK_SHIFT; by++) {
+            for (int bx = tileMinX >> BLOCK_SHIFT; bx <= tileMaxX >> BLOCK_SHIFT; bx++) {
+                int block = by * m_blocksX + bx;
+                if (m_blockStale[block]) {
+                    RefreshBlock(bx, by);
+                }
+                if (!Depth::Passes(nearest, m_blockFarthest[block])) {
+                    continue;
+                }
+                //partly visible block: look at the tiles it shares with the rectangle
+                int ty0 = std::max(tileMinY, by << BLOCK_SHIFT), ty1 = std::min(tileMaxY, ((by + 1) << BLOCK_SHIFT) - 1);
+                int tx0 = std::max(tileMinX, bx << BLOCK_SHIFT), tx1 = std::min(tileMaxX, ((bx + 1) << BLOCK_SHIFT) - 1);
+                if (!TilesHidden(tx0, ty0, tx1, ty1, nearest)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // Records that the pixel (x, y) of tile, which held previous, was given the depth value
+    void Written(int tile, int x, int y, Value previous, Value value) {
+        if (Depth::Passes(value, m_tileNearest[tile])) {
+            m_tileNearest[tile] = value;
+        }
+        bool farthestMoved;
+        if (previous == Depth::Clear()) {
+            //the tile's farthest depth stays the clear value until its last empty pixel is drawn
+            farthestMoved = --m_tileEmpty[tile] == 0;
+        } else {
+            //only drawing over the farthest pixel can bring the farthest depth closer
+            farthestMoved = !Depth::Passes(previous, m_tileFarthest[tile]);
+        }
+        if (farthestMoved) {
+            m_tileStale[tile] = 1;
+            m_blockStale[((y >> TILE_SHIFT) >> BLOCK_SHIFT) * m_blocksX + ((x >> TILE_SHIFT) >> BLOCK_SHIFT)] = 1;
+        }
+    }
+
+private:
+    bool TilesHidden(int tx0, int ty0, int tx1, int ty1, Value nearest) {
+        for (int ty = ty0; ty <= ty1; ty++) {
+            for (int tx = tx0; tx <= tx1; tx++) {
+                if (!TileHidden(ty * m_tilesX + tx, nearest)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    static Value Farther(Value a, Value b) {
+        return Depth::Passes(a, b) ? b : a;
+    }
+
+    void RefreshTile(int tile) {
+        int x0 = (tile % m_tilesX) << TILE_SHIFT, y0 = (tile / m_tilesX) << TILE_SHIFT;
+        int x1 = std::min(x0 + TILE_SIZE, m_width), y1 = std::min(y0 + TILE_SIZE, m_height);
+        Value farthest = mp_zBuffer[y0 * m_width + x0];
+        for (int y = y0; y < y1; y++) {
+            const Value* row = mp_zBuffer + y * m_width;
+            for (int x = x0; x < x1; x++) {
+                farthest = Farther(farthest, row[x]);
+            }
+        }
+        m_tileFarthest[tile] = farthest;
+        m_tileStale[tile] = 0;
+    }
+
+    void RefreshBlock(int bx, int by) {
+        int tx0 = bx << BLOCK_SHIFT, ty0 = by << BLOCK_SHIFT;
+        int tx1 = std::min(tx0 + (1 << BLOCK_SHIFT), m_tilesX), ty1 = std::min(ty0 + (1 << BLOCK_SHIFT), m_tilesY);
+        Value farthest = Depth::Clear();
+        bool first = true;
+        for (int ty = ty0; ty < ty1; ty++) {
+            for (int tx = tx0; tx < tx1; tx++) {
+                int tile = ty * m_tilesX + tx;
+                if (m_tileStale[tile]) {
+                    RefreshTile(tile);
+                }
+                farthest = first ? m_tileFarthest[tile] : Farther(farthest, m_tileFarthest[tile]);
+                first = false;
+            }
+        }
+        m_blockFarthest[by * m_blocksX + bx] = farthest;
+        m_blockStale[by * m_blocksX + bx] = 0;
+    }
+
+    const Value* mp_zBuffer;
+    int m_width;
+    int m_height;
+    int m_tilesX;
+    int m_tilesY;
+    int m_blocksX;
+    int m_blocksY;
+    FrameVector<Value> m_tileNearest;
+    FrameVector<Value> m_tileFarthest;
+    //Pixels of each tile nothing has been drawn on yet
+    FrameVector<unsigned short> m_tileEmpty;
+    FrameVector<unsigned char> m_tileStale;
+    FrameVector<Value> m_blockFarthest;
+    FrameVector<unsigned char> m_blockStale;
+};
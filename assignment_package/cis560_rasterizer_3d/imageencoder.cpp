@@ -0,0 +1,268 @@
+#include "imageencoder.h"
+#include <QBuffer>
+#include <QFile>
+#include <algorithm>
+
+bool ImageFormatFromName(const QString& name, ImageFormat* format)
+{
+    QString lower = name.toLower();
+    if(lower == QString("png"))
+    {
+        *format = ImageFormat::Png;
+    }
+    else if(lower == QString("bmp"))
+    {
+        *format = ImageFormat::Bmp;
+    }
+    else if(lower == QString("qoi"))
+    {
+        *format = ImageFormat::Qoi;
+    }
+    else if(lower == QString("rgba") || lower == QString("raw"))
+    {
+        *format = ImageFormat::RawRgba;
+    }
+    else if(lower == QString("y4m"))
+    {
+        *format = ImageFormat::Y4m;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+QString ImageFormatExtension(ImageFormat format)
+{
+    switch(format)
+    {
+    case ImageFormat::Png: return QString("png");
+    case ImageFormat::Bmp: return QString("bmp");
+    case ImageFormat::Qoi: return QString("qoi");
+    case ImageFormat::RawRgba: return QString("rgba");
+    case ImageFormat::Y4m: return QString("y4m");
+    }
+    return QString();
+}
+
+//encodes through Qt's own image writers
+static bool EncodeWithQt(const QImage& image, const char* format, int quality, QByteArray* out)
+{
+    QBuffer buffer(out);
+    buffer.open(QIODevice::WriteOnly | QIODevice::Append);
+    return image.save(&buffer, format, quality);
+}
+
+static void AppendBigEndian32(QByteArray* out, unsigned int value)
+{
+    out->append(static_cast<char>(value >> 24));
+    out->append(static_cast<char>(value >> 16));
+    out->append(static_cast<char>(value >> 8));
+    out->append(static_cast<char>(value));
+}
+
+//QOI encoder following the specification at qoiformat.org.
+//Renders have no transparency, so the image is stored with 3 channels.
+static void EncodeQOI(const QImage& image, QByteArray* out)
+{
+    const int width = image.width();
+    const int height = image.height();
+    out->reserve(out->size() + 14 + width * height * 4 + 8);
+
+    out->append("qoif", 4);
+    AppendBigEndian32(out, width);
+    AppendBigEndian32(out, height);
+    out->append(static_cast<char>(3)); //channels: RGB
+    out->append(static_cast<char>(0)); //colorspace: sRGB with linear alpha
+
+    //previously seen colors, indexed by a hash of the color
+    QRgb index[64] = {};
+    QRgb previous = qRgba(0, 0, 0, 255);
+    int run = 0;
+
+    for(int y = 0; y < height; y++)
+    {
+        const QRgb* row = reinterpret_cast<const QRgb*>(image.constScanLine(y));
+        for(int x = 0; x < width; x++)
+        {
+            QRgb pixel = row[x] | 0xff000000;
+            bool last = (y == height - 1) && (x == width - 1);
+
+            if(pixel == previous)
+            {
+                run++;
+                if(run == 62 || last)
+                {
+                    out->append(static_cast<char>(0xc0 | (run - 1)));
+                    run = 0;
+                }
+                continue;
+            }
+            if(run > 0)
+            {
+                out->append(static_cast<char>(0xc0 | (run - 1)));
+                run = 0;
+            }
+
+            int r = qRed(pixel), g = qGreen(pixel), b = qBlue(pixel);
+            int hash = (r * 3 + g * 5 + b * 7 + 255 * 11) % 64;
+            if(index[hash] == pixel)
+            {
+                out->append(static_cast<char>(hash));
+            }
+            else
+            {
+                index[hash] = pixel;
+
+                //channel differences wrap around, as in the specification
+                signed char dr = static_cast<signed char>(r - qRed(previous));
+                signed char dg = static_cast<signed char>(g - qGreen(previous));
+                signed char db = static_cast<signed char>(b - qBlue(previous));
+                int drg = dr - dg;
+                int dbg = db - dg;
+
+                if(dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+                {
+                    out->append(static_cast<char>(0x40 | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2)));
+                }
+                else if(dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7)
+                {
+                    out->append(static_cast<char>(0x80 | (dg + 32)));
+                    out->append(static_cast<char>(((drg + 8) << 4) | (dbg + 8)));
+                }
+                else
+                {
+                    out->append(static_cast<char>(0xfe));
+                    out->append(static_cast<char>(r));
+                    out->append(static_cast<char>(g));
+                    out->append(static_cast<char>(b));
+                }
+            }
+            previous = pixel;
+        }
+    }
+
+    //end marker
+    out->append(7, '\0');
+    out->append(static_cast<char>(1));
+}
+
+static void EncodeRawRGBA(const QImage& image, QByteArray* out)
+{
+    QImage rgba = image.convertToFormat(QImage::Format_RGBA8888);
+    const int rowBytes = rgba.width() * 4;
+    out->reserve(out->size() + rowBytes * rgba.height());
+    for(int y = 0; y < rgba.height(); y++)
+    {
+        out->append(reinterpret_cast<const char*>(rgba.constScanLine(y)), rowBytes);
+    }
+}
+
+QByteArray Y4MStreamHeader(int width, int height, int frameRate)
+{
+    //C420jpeg: chroma sits between each 2x2 block of luma samples, which is what averaging the block gives
+    return QString("YUV4MPEG2 W%1 H%2 F%3:1 Ip A1:1 C420jpeg\n").arg(width).arg(height).arg(frameRate).toUtf8();
+}
+
+//one 4:2:0 frame: full resolution luma, then chroma planes averaged over 2x2 blocks.
+//Uses the BT.601 studio-range conversion video encoders assume for Y4M input.
+static void EncodeY4MFrame(const QImage& image, QByteArray* out)
+{
+    const int width = image.width();
+    const int height = image.height();
+    const int chromaWidth = (width + 1) / 2;
+    const int chromaHeight = (height + 1) / 2;
+
+    out->append("FRAME\n", 6);
+    int lumaStart = out->size();
+    out->resize(lumaStart + width * height + 2 * chromaWidth * chromaHeight);
+    unsigned char* luma = reinterpret_cast<unsigned char*>(out->data()) + lumaStart;
+    unsigned char* u = luma + width * height;
+    unsigned char* v = u + chromaWidth * chromaHeight;
+
+    for(int y = 0; y < height; y++)
+    {
+        const QRgb* row = reinterpret_cast<const QRgb*>(image.constScanLine(y));
+        for(int x = 0; x < width; x++)
+        {
+            int r = qRed(row[x]), g = qGreen(row[x]), b = qBlue(row[x]);
+            luma[y * width + x] = static_cast<unsigned char>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+        }
+    }
+
+    for(int cy = 0; cy < chromaHeight; cy++)
+    {
+        const QRgb* row0 = reinterpret_cast<const QRgb*>(image.constScanLine(2 * cy));
+        //the last row and column repeat for odd sizes
+        const QRgb* row1 = reinterpret_cast<const QRgb*>(image.constScanLine(std::min(2 * cy + 1, height - 1)));
+        for(int cx = 0; cx < chromaWidth; cx++)
+        {
+            int x0 = 2 * cx;
+            int x1 = std::min(2 * cx + 1, width - 1);
+            int r = qRed(row0[x0]) + qRed(row0[x1]) + qRed(row1[x0]) + qRed(row1[x1]);
+            int g = qGreen(row0[x0]) + qGreen(row0[x1]) + qGreen(row1[x0]) + qGreen(row1[x1]);
+            int b = qBlue(row0[x0]) + qBlue(row0[x1]) + qBlue(row1[x0]) + qBlue(row1[x1]);
+            //sums of 4 samples, so divide by 4 along with the fixed point shift
+            u[cy * chromaWidth + cx] = static_cast<unsigned char>(((-38 * r - 74 * g + 112 * b + 512) >> 10) + 128);
+            v[cy * chromaWidth + cx] = static_cast<unsigned char>(((112 * r - 94 * g - 18 * b + 512) >> 10) + 128);
+        }
+    }
+}
+
+bool EncodeImage(const QImage& image, const EncoderSettings& settings, QByteArray* out)
+{
+    if(image.isNull())
+    {
+        return false;
+    }
+    //the encoders below read pixels as 32-bit RGB, which is what the Rasterizer draws
+    QImage rgb = image.format() == QImage::Format_RGB32 ? image : image.convertToFormat(QImage::Format_RGB32);
+
+    switch(settings.m_format)
+    {
+    case ImageFormat::Png:
+    {
+        //Qt's PNG writer takes the zlib level as a quality from 100 (level 0) down to 0 (level 9)
+        int quality = -1;
+        if(settings.m_pngLevel >= 0)
+        {
+            int level = std::min(settings.m_pngLevel, 9);
+            quality = 100 - (level * 91 + 8) / 9;
+        }
+        return EncodeWithQt(rgb, "PNG", quality, out);
+    }
+    case ImageFormat::Bmp:
+        return EncodeWithQt(rgb, "BMP", -1, out);
+    case ImageFormat::Qoi:
+        EncodeQOI(rgb, out);
+        return true;
+    case ImageFormat::RawRgba:
+        EncodeRawRGBA(rgb, out);
+        return true;
+    case ImageFormat::Y4m:
+        EncodeY4MFrame(rgb, out);
+        return true;
+    }
+    return false;
+}
+
+bool SaveImage(const QImage& image, const QString& filename, const EncoderSettings& settings)
+{
+    QByteArray data;
+    if(settings.m_format == ImageFormat::Y4m)
+    {
+        data = Y4MStreamHeader(image.width(), image.height(), settings.m_frameRate);
+    }
+    if(!EncodeImage(image, settings, &data))
+    {
+        return false;
+    }
+
+    QFile file(filename);
+    if(!file.open(QIODevice::WriteOnly))
+    {
+        return false;
+    }
+    return file.write(data) == data.size();
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <QByteArray>
+#include <QImage>
+#include <QString>
+
+// The file formats rendered images can be written in
+enum class ImageFormat
+{
+    Png,
+    Bmp,
+    // The "Quite OK Image" format: lossless, and several times faster to encode than PNG
+    Qoi,
+    // Bare 8-bit R, G, B, A bytes, row by row, with no header at all
+    RawRgba,
+    // YUV4MPEG2 video frames (4:2:0), the format video encoders such as ffmpeg read from a pipe
+    Y4m
+};
+
+// How rendered images are encoded
+struct EncoderSettings
+{
+    ImageFormat m_format;
+    // zlib compression level for PNG, from 0 (fastest, largest) to 9 (slowest, smallest).
+    // -1 keeps Qt's default.
+    int m_pngLevel;
+    // Frames per second written in the header of a Y4M stream
+    int m_frameRate;
+
+    EncoderSettings(ImageFormat format = ImageFormat::Png, int pngLevel = -1, int frameRate = 30)
+        : m_format(format), m_pngLevel(pngLevel), m_frameRate(frameRate)
+    {}
+};
+
+// Looks up a format by its name or file extension ("png", "bmp", "qoi", "rgba" or "y4m").
+// Returns false if the name is not one of them.
+bool ImageFormatFromName(const QString& name, ImageFormat* format);
+// The file extension used for a format, without the dot
+QString ImageFormatExtension(ImageFormat format);
+
+// Appends the encoded image to out. A Y4M image is a single frame without the stream header
+// (see Y4MStreamHeader), so frames can be appended to one stream one after another.
+// Returns false if the image could not be encoded.
+bool EncodeImage(const QImage& image, const EncoderSettings& settings, QByteArray* out);
+
+// The header that starts a Y4M stream of width x height frames
+QByteArray Y4MStreamHeader(int width, int height, int frameRate);
+
+// Encodes the image and writes it to a file. A Y4M file holds the image as a one-frame stream.
+bool SaveImage(const QImage& image, const QString& filename, const EncoderSettings& settings);
@@ -0,0 +1,45 @@
+#pragma once
+#include <glm/glm.hpp>
+
+enum class LightType
+{
+    // Light arriving from one direction everywhere, like the sun
+    Directional,
+    // Light shining from a point in a cone
+    Spot,
+    // Light shining from a point in every direction. Point lights cast no shadows.
+    Point
+};
+
+// A light in the scene. A Rasterizer given no lights keeps lighting from the camera, unshadowed.
+struct Light
+{
+    LightType m_type;
+    // Spot and point lights: where the light is, in world space
+    glm::vec3 m_position;
+    // The direction the light travels in, in world space
+    glm::vec3 m_direction;
+    // Color of the light, 1 being full white, scaled by its intensity
+    glm::vec3 m_color;
+    float m_intensity;
+    // Spot lights only: half the angle of the lit cone in degrees. Its outer tenth fades out.
+    float m_spotAngle;
+    // Spot and point lights: the distance at which the light has faded out completely,
+    // or 0 for a light that reaches any distance undimmed. Lights with a range are only
+    // evaluated on the parts of the screen they can reach.
+    float m_range;
+
+    // Whether the light casts shadows, with a square shadow map of this many texels a side
+    bool m_castsShadows;
+    int m_shadowMapSize;
+    // How far surfaces are pushed out along their normals before they are looked up in the
+    // shadow map, in texels. Keeps lit surfaces from shadowing themselves.
+    float m_shadowBias;
+    // Shadows are softened by averaging (2r + 1) x (2r + 1) shadow map tests (PCF) with this r
+    int m_shadowFilterRadius;
+
+    Light()
+        : m_type(LightType::Directional), m_position(0.f), m_direction(0.f, -1.f, 0.f), m_color(1.f), m_intensity(1.f),
+          m_spotAngle(30.f), m_range(0.f), m_castsShadows(true), m_shadowMapSize(1024), m_shadowBias(1.5f), m_shadowFilterRadius(1)
+    {}
+};
@@ -0,0 +1,119 @@
+#include "lightgrid.h"
+#include "frustum.h"
+#include <algorithm>
+#include <cmath>
+
+// The tiles a sphere may cover on screen, from the projected corners of the cube around it.
+// Returns false if the sphere is entirely off screen. A sphere reaching behind the camera
+// has no bounded projection and covers every tile.
+static bool SphereTiles(const glm::vec3& center, float radius, const glm::mat4& viewProjection, const QRect& region,
+                        int screenWidth, int screenHeight, int tilesX, int tilesY, int* tileBounds)
+{
+    if(!Frustum(viewProjection).intersectsSphere(center, radius))
+    {
+        return false;
+    }
+    float minX = 0.f, minY = 0.f, maxX = 0.f, maxY = 0.f;
+    for(int corner = 0; corner < 8; corner++)
+    {
+        glm::vec3 offset((corner & 1) ? radius : -radius, (corner & 2) ? radius : -radius, (corner & 4) ? radius : -radius);
+        glm::vec4 clip = viewProjection * glm::vec4(center + offset, 1.f);
+        if(clip.w <= 1e-6f)
+        {
+            tileBounds[0] = 0;
+            tileBounds[1] = 0;
+            tileBounds[2] = tilesX - 1;
+            tileBounds[3] = tilesY - 1;
+            return true;
+        }
+        float x = screenWidth * (clip.x / clip.w + 1.f) * 0.5f;
+        float y = screenHeight * (1.f - clip.y / clip.w) * 0.5f;
+        minX = corner == 0 ? x : std::min(minX, x);
+        maxX = corner == 0 ? x : std::max(maxX, x);
+        minY = corner == 0 ? y : std::min(minY, y);
+        maxY = corner == 0 ? y : std::max(maxY, y);
+    }
+    //pixels are sampled at whole coordinates, so widen by one to be safe
+    int left = std::max(0, static_cast<int>(std::floor(minX)) - 1 - region.left());
+    int top = std::max(0, static_cast<int>(std::floor(minY)) - 1 - region.top());
+    int right = std::min(region.width() - 1, static_cast<int>(std::ceil(maxX)) + 1 - region.left());
+    int bottom = std::min(region.height() - 1, static_cast<int>(std::ceil(maxY)) + 1 - region.top());
+    if(left > right || top > bottom)
+    {
+        return false;
+    }
+    tileBounds[0] = left >> LightGrid::TILE_SHIFT;
+    tileBounds[1] = top >> LightGrid::TILE_SHIFT;
+    tileBounds[2] = right >> LightGrid::TILE_SHIFT;
+    tileBounds[3] = bottom >> LightGrid::TILE_SHIFT;
+    return true;
+}
+
+LightGrid::LightGrid(const std::vector<Light>& lights, const glm::mat4& viewProjection, const QRect& region,
+                     int screenWidth, int screenHeight, Arena& arena)
+    : m_region(region),
+      m_tilesX((region.width() + TILE_SIZE - 1) >> TILE_SHIFT), m_tilesY((region.height() + TILE_SIZE - 1) >> TILE_SHIFT),
+      m_globalLights(ArenaAllocator<PreparedLight>(arena)), m_localLights(ArenaAllocator<PreparedLight>(arena)),
+      m_tileStart(m_tilesX * m_tilesY + 1, 0, ArenaAllocator<unsigned int>(arena)),
+      m_tileLights(ArenaAllocator<unsigned int>(arena))
+{
+    //tiles covered by each local light: left, top, right, bottom
+    FrameVector<int> localTiles = FrameVector<int>(ArenaAllocator<int>(arena));
+    for(unsigned int i = 0; i < lights.size(); i++)
+    {
+        const Light& light = lights[i];
+        PreparedLight prepared;
+        prepared.m_type = light.m_type;
+        prepared.m_position = light.m_position;
+        prepared.m_direction = glm::normalize(light.m_direction);
+        prepared.m_radiance = light.m_color * light.m_intensity;
+        prepared.m_cosOuter = std::cos(glm::radians(light.m_spotAngle));
+        prepared.m_cosInner = std::cos(glm::radians(0.9f * light.m_spotAngle));
+        bool limited = light.m_type != LightType::Directional && light.m_range > 0.f;
+        prepared.m_inverseRangeSquared = limited ? 1.f / (light.m_range * light.m_range) : 0.f;
+        prepared.m_shadowed = light.m_castsShadows && light.m_type != LightType::Point;
+        prepared.m_index = i;
+        if(!limited)
+        {
+            m_globalLights.push_back(prepared);
+            continue;
+        }
+        int tiles[4];
+        if(SphereTiles(light.m_position, light.m_range, viewProjection, region, screenWidth, screenHeight, m_tilesX, m_tilesY, tiles))
+        {
+            m_localLights.push_back(prepared);
+            localTiles.insert(localTiles.end(), tiles, tiles + 4);
+        }
+    }
+
+    //count the lights of each tile, turn the counts into where each tile's list starts,
+    //then fill the lists in
+    for(unsigned int l = 0; l < m_localLights.size(); l++)
+    {
+        const int* tiles = &localTiles[4 * l];
+        for(int ty = tiles[1]; ty <= tiles[3]; ty++)
+        {
+            for(int tx = tiles[0]; tx <= tiles[2]; tx++)
+            {
+                m_tileStart[ty * m_tilesX + tx + 1]++;
+            }
+        }
+    }
+    for(int t = 0; t < m_tilesX * m_tilesY; t++)
+    {
+        m_tileStart[t + 1] += m_tileStart[t];
+    }
+    m_tileLights.resize(m_tileStart[m_tilesX * m_tilesY]);
+    FrameVector<unsigned int> filled(m_tileStart.begin(), m_tileStart.end() - 1, ArenaAllocator<unsigned int>(arena));
+    for(unsigned int l = 0; l < m_localLights.size(); l++)
+    {
+        const int* tiles = &localTiles[4 * l];
+        for(int ty = tiles[1]; ty <= tiles[3]; ty++)
+        {
+            for(int tx = tiles[0]; tx <= tiles[2]; tx++)
+            {
+                m_tileLights[filled[ty * m_tilesX + tx]++] = l;
+            }
+        }
+    }
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <vector>
+#include <QRect>
+#include <glm/glm.hpp>
+#include <framearena.h>
+#include <light.h>
+
+// A Light with everything that only depends on the light worked out once per frame,
+// so shading a fragment does no normalizing or trigonometry of its own
+struct PreparedLight
+{
+    LightType m_type;
+    glm::vec3 m_position;
+    // Unit direction the light travels in
+    glm::vec3 m_direction;
+    // Color times intensity
+    glm::vec3 m_radiance;
+    // Spot lights: cosines of the cone's edge and of where it starts to fade
+    float m_cosOuter;
+    float m_cosInner;
+    // 1 / range^2, or 0 for a light of unlimited range
+    float m_inverseRangeSquared;
+    // Whether the light's shadow map is to be looked up
+    bool m_shadowed;
+    // Index of the light in the scene's list, which is also that of its shadow map
+    unsigned int m_index;
+};
+
+// The scene's lights sorted into square tiles of the screen for one frame. Lights of limited
+// range (point lights and spot lights given a range) are only listed in the tiles their sphere
+// of influence covers on screen, so a fragment looks at a handful of lights even when the scene
+// has hundreds. Lights that reach everywhere are kept in a single list every fragment uses.
+class LightGrid
+{
+public:
+    static const int TILE_SHIFT = 4;
+    static const int TILE_SIZE = 1 << TILE_SHIFT;
+
+    // Bins lights for a region of a screenWidth x screenHeight frame seen through viewProjection.
+    // Everything is allocated from the arena and lives as long as the frame.
+    LightGrid(const std::vector<Light>& lights, const glm::mat4& viewProjection, const QRect& region,
+              int screenWidth, int screenHeight, Arena& arena);
+
+    // Lights of unlimited range, which reach every pixel
+    const FrameVector<PreparedLight>& GlobalLights() const
+    {
+        return m_globalLights;
+    }
+
+    // The lights of limited range that may reach the pixel (x, y) of the frame, as indices
+    // into LocalLights(). Returns the first and sets count to how many there are.
+    const unsigned int* LightsAt(int x, int y, unsigned int* count) const
+    {
+        int tile = ((y - m_region.top()) >> TILE_SHIFT) * m_tilesX + ((x - m_region.left()) >> TILE_SHIFT);
+        *count = m_tileStart[tile + 1] - m_tileStart[tile];
+        return m_tileLights.data() + m_tileStart[tile];
+    }
+    const FrameVector<PreparedLight>& LocalLights() const
+    {
+        return m_localLights;
+    }
+
+private:
+    QRect m_region;
+    int m_tilesX;
+    int m_tilesY;
+    FrameVector<PreparedLight> m_globalLights;
+    FrameVector<PreparedLight> m_localLights;
+    //The lights of tile t are m_tileLights[m_tileStart[t]] up to m_tileLights[m_tileStart[t + 1]]
+    FrameVector<unsigned int> m_tileStart;
+    FrameVector<unsigned int> m_tileLights;
+};
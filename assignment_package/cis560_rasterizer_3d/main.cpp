@@ -1,9 +1,341 @@
 #include "mainwindow.h"
 #include <QApplication>
+#include <QCoreApplication>
+#include <QCommandLineParser>
 #include <QFileDialog>
+#include <QFileInfo>
+#include <cstring>
+#include <iostream>
+#include <sceneloader.h>
+#include <batchrender.h>
+#include <renderfarm.h>
+#include <imageencoder.h>
+#include <framewriter.h>
+
+// Reads the --format, --png-level and --fps options. Without --format, the format follows the
+// extension of the output file, falling back to PNG.
+static bool ReadEncoderSettings(const QCommandLineParser& parser, const QString& output, EncoderSettings* settings)
+{
+    settings->m_format = ImageFormat::Png;
+    if(parser.isSet(QString("format")))
+    {
+        if(!ImageFormatFromName(parser.value(QString("format")), &settings->m_format))
+        {
+            std::cerr << "Unknown output format " << parser.value(QString("format")).toStdString() << std::endl;
+            return false;
+        }
+    }
+    else
+    {
+        ImageFormatFromName(QFileInfo(output).suffix(), &settings->m_format);
+    }
+    settings->m_pngLevel = parser.value(QString("png-level")).toInt();
+    settings->m_frameRate = parser.value(QString("fps")).toInt();
+    return true;
+}
+
+// Reads the --aovs option: "all", or a comma separated list of depth, objectid, triangleid and normal
+static bool ReadAOVFlags(const QCommandLineParser& parser, unsigned int* flags)
+{
+    *flags = AOV_NONE;
+    if(!parser.isSet(QString("aovs")))
+    {
+        return true;
+    }
+    for(const QString& name : parser.value(QString("aovs")).toLower().split(QChar(',')))
+    {
+        if(name == QString("all"))
+        {
+            *flags |= AOV_ALL;
+        }
+        else if(name == QString("depth"))
+        {
+            *flags |= AOV_DEPTH;
+        }
+        else if(name == QString("objectid"))
+        {
+            *flags |= AOV_OBJECT_ID;
+        }
+        else if(name == QString("triangleid"))
+        {
+            *flags |= AOV_TRIANGLE_ID;
+        }
+        else if(name == QString("normal"))
+        {
+            *flags |= AOV_NORMAL;
+        }
+        else
+        {
+            std::cerr << "Unknown AOV " << name.toStdString() << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Reads the --aov-format option: exr, or pfm for depth alone
+static bool ReadAOVFileFormat(const QCommandLineParser& parser, unsigned int aovFlags, AOVFileFormat* format)
+{
+    QString name = parser.value(QString("aov-format")).toLower();
+    if(name == QString("exr"))
+    {
+        *format = AOVFileFormat::Exr;
+    }
+    else if(name == QString("pfm"))
+    {
+        //a PFM image has room for the depth and nothing else
+        if(aovFlags != AOV_DEPTH)
+        {
+            std::cerr << "PFM AOV files hold depth only; use --aovs depth" << std::endl;
+            return false;
+        }
+        *format = AOVFileFormat::Pfm;
+    }
+    else
+    {
+        std::cerr << "Unknown AOV format " << name.toStdString() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Reads the --depth option: float32, reversed, unorm24 or unorm16
+static bool ReadDepthFormat(const QCommandLineParser& parser, DepthFormat* format)
+{
+    QString name = parser.value(QString("depth")).toLower();
+    if(name == QString("float32"))
+    {
+        *format = DepthFormat::Float32;
+    }
+    else if(name == QString("reversed"))
+    {
+        *format = DepthFormat::ReversedFloat32;
+    }
+    else if(name == QString("unorm24"))
+    {
+        *format = DepthFormat::Unorm24;
+    }
+    else if(name == QString("unorm16"))
+    {
+        *format = DepthFormat::Unorm16;
+    }
+    else
+    {
+        std::cerr << "Unknown depth format " << name.toStdString() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Reads the --sort option: none, objects or clusters
+static bool ReadDrawSorting(const QCommandLineParser& parser, DrawSorting* sorting)
+{
+    QString name = parser.value(QString("sort")).toLower();
+    if(name == QString("none"))
+    {
+        *sorting = DrawSorting::None;
+    }
+    else if(name == QString("objects"))
+    {
+        *sorting = DrawSorting::FrontToBack;
+    }
+    else if(name == QString("clusters"))
+    {
+        *sorting = DrawSorting::FrontToBackClusters;
+    }
+    else
+    {
+        std::cerr << "Unknown draw order " << name.toStdString() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Reads the --post option: a comma separated list of fxaa, sharpen and gamma, run in that order
+static bool ReadPostProcess(const QCommandLineParser& parser, PostProcessChain* chain)
+{
+    chain->Clear();
+    if(!parser.isSet(QString("post")))
+    {
+        return true;
+    }
+    for(const QString& name : parser.value(QString("post")).toLower().split(QChar(',')))
+    {
+        if(name == QString("fxaa"))
+        {
+            chain->Add(std::make_shared<FXAAPass>());
+        }
+        else if(name == QString("sharpen"))
+        {
+            chain->Add(std::make_shared<SharpenPass>());
+        }
+        else if(name == QString("gamma"))
+        {
+            chain->Add(std::make_shared<GammaPass>());
+        }
+        else
+        {
+            std::cerr << "Unknown post-process pass " << name.toStdString() << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Runs one of the modes that render without opening a window:
+//   cis277_hw01 --batch scene.json [--output folder] [--threads N] [--format F] [--aovs list] [--aov-format F] [--depth D] [--msaa S] [--post list] [--scale F] [--sort S] [--cull-backfaces] [--lod-threshold P]
+//       renders the "cameraPath" of the scene to numbered images, or with --output - streams
+//       the frames to standard output, e.g. --format y4m piped into a video encoder.
+//       --aovs also saves depth, IDs and/or normals of every frame to numbered EXR files
+//       (or with --aovs depth --aov-format pfm, the depth alone to PFM files),
+//       and --msaa 4 or 8 anti-aliases edges with that many samples per pixel. --post runs
+//       full-screen passes over every frame, e.g. --post fxaa,sharpen for cheaper anti-aliasing,
+//       and --scale 0.5 rasterizes frames at half the width and height and upscales them.
+//       --sort objects (or clusters, to sort triangles as well) draws what is nearest first, and
+//       --cull-backfaces skips the parts of large closed meshes facing away from the camera.
+//       Meshes loaded with "lods" are drawn simplified while that moves them at most P pixels
+//       (1 by default, 0 for full detail)
+//   cis277_hw01 --farm scene.json [--output image.png] [--workers N] [--width W] [--height H] [--tile T]
+//       renders one large image, split into tiles across N worker processes
+//   cis277_hw01 --worker scene.json
+//       runs as one of those worker processes (started by --farm)
+static int RunCommandLine(const QCoreApplication& app)
+{
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    parser.addOption(QCommandLineOption(QString("batch"), QString("Render the camera path of <scene>."), QString("scene")));
+    parser.addOption(QCommandLineOption(QString("farm"), QString("Render <scene> in tiles across worker processes."), QString("scene")));
+    parser.addOption(QCommandLineOption(QString("worker"), QString("Serve tile jobs for <scene> on standard input."), QString("scene")));
+    parser.addOption(QCommandLineOption(QString("output"), QString("Folder (batch) or image file (farm) to write."), QString("path"), QString(".")));
+    parser.addOption(QCommandLineOption(QString("format"), QString("Image format: png, qoi, bmp, rgba or y4m."), QString("name")));
+    parser.addOption(QCommandLineOption(QString("png-level"), QString("PNG compression level from 0 (fastest) to 9 (smallest)."), QString("level"), QString("1")));
+    parser.addOption(QCommandLineOption(QString("fps"), QString("Frame rate written to Y4M streams."), QString("rate"), QString("30")));
+    parser.addOption(QCommandLineOption(QString("aovs"), QString("AOVs to save as EXR: all, or any of depth,objectid,triangleid,normal."), QString("list")));
+    parser.addOption(QCommandLineOption(QString("aov-format"), QString("AOV file format: exr, or pfm for depth alone."), QString("name"), QString("exr")));
+    parser.addOption(QCommandLineOption(QString("depth"), QString("Depth buffer format: float32, reversed, unorm24 or unorm16."), QString("format"), QString("float32")));
+    parser.addOption(QCommandLineOption(QString("msaa"), QString("Samples per pixel for anti-aliasing: 1, 4 or 8."), QString("samples"), QString("1")));
+    parser.addOption(QCommandLineOption(QString("post"), QString("Passes run over every frame, in order: any of fxaa,sharpen,gamma."), QString("list")));
+    parser.addOption(QCommandLineOption(QString("scale"), QString("Fraction of the resolution rasterized before upscaling, from 0.125 to 1."), QString("fraction"), QString("1")));
+    parser.addOption(QCommandLineOption(QString("sort"), QString("Front to back draw order: none, objects or clusters."), QString("order"), QString("none")));
+    parser.addOption(QCommandLineOption(QString("cull-backfaces"), QString("Skip meshlets facing away from the camera (closed meshes only).")));
+    parser.addOption(QCommandLineOption(QString("lod-threshold"), QString("Pixels a simplified mesh may be off by on screen; 0 always draws full detail."), QString("pixels"), QString("1")));
+    parser.addOption(QCommandLineOption(QString("threads"), QString("Frames rendered at once (default: one per core)."), QString("count"), QString("0")));
+    parser.addOption(QCommandLineOption(QString("workers"), QString("Worker processes to start."), QString("count"), QString("4")));
+    parser.addOption(QCommandLineOption(QString("width"), QString("Width of the farmed image."), QString("pixels"), QString("512")));
+    parser.addOption(QCommandLineOption(QString("height"), QString("Height of the farmed image."), QString("pixels"), QString("512")));
+    parser.addOption(QCommandLineOption(QString("tile"), QString("Size of the square tiles handed to workers."), QString("pixels"), QString("256")));
+    parser.process(app);
+
+    QString output = parser.value(QString("output"));
+    EncoderSettings settings;
+    if(!ReadEncoderSettings(parser, output, &settings))
+    {
+        return 1;
+    }
+    if(output == QString("-"))
+    {
+        //standard output carries the images, so anything else the program prints goes to standard error
+        std::cout.rdbuf(std::cerr.rdbuf());
+    }
+
+    if(parser.isSet(QString("worker")))
+    {
+        return RunRenderWorker(parser.value(QString("worker")));
+    }
+
+    if(parser.isSet(QString("farm")))
+    {
+        int width = parser.value(QString("width")).toInt();
+        int height = parser.value(QString("height")).toInt();
+        RenderFarm farm(QFileInfo(parser.value(QString("farm"))).absoluteFilePath(), parser.value(QString("workers")).toUInt());
+        Camera camera;
+        camera.aspectRatio = static_cast<float>(width) / height;
+        QImage image = farm.Render(camera, width, height, parser.value(QString("tile")).toInt());
+        if(image.isNull())
+        {
+            return 1;
+        }
+        if(output == QString("-"))
+        {
+            FrameWriter writer(1);
+            writer.Stream(image, 0, settings);
+            writer.Finish();
+            return writer.GetFailureCount() == 0 ? 0 : 1;
+        }
+        if(QFileInfo(output).isDir())
+        {
+            output.append(QString("/farm.%1").arg(ImageFormatExtension(settings.m_format)));
+        }
+        return SaveImage(image, output, settings) ? 0 : 1;
+    }
+
+    SceneDescription scene;
+    if(!LoadSceneFile(QFileInfo(parser.value(QString("batch"))).absoluteFilePath(), &scene))
+    {
+        return 1;
+    }
+    if(!scene.m_hasCameraPath)
+    {
+        std::cout << "The scene has no cameraPath to render." << std::endl;
+        return 1;
+    }
+
+    unsigned int aovFlags;
+    AOVFileFormat aovFormat;
+    DepthFormat depthFormat;
+    PostProcessChain postProcess;
+    DrawSorting sorting;
+    if(!ReadAOVFlags(parser, &aovFlags) || !ReadAOVFileFormat(parser, aovFlags, &aovFormat) || !ReadDepthFormat(parser, &depthFormat) || !ReadPostProcess(parser, &postProcess)
+       || !ReadDrawSorting(parser, &sorting))
+    {
+        return 1;
+    }
+    int samples = parser.value(QString("msaa")).toInt();
+    if(samples != 1 && samples != 4 && samples != 8)
+    {
+        std::cerr << "MSAA takes 1, 4 or 8 samples per pixel" << std::endl;
+        return 1;
+    }
+    bool scaleValid = false;
+    float scale = parser.value(QString("scale")).toFloat(&scaleValid);
+    if(!scaleValid || scale < 0.125f || scale > 1.0f)
+    {
+        std::cerr << "The render scale must be between 0.125 and 1" << std::endl;
+        return 1;
+    }
+    bool lodThresholdValid = false;
+    float lodThreshold = parser.value(QString("lod-threshold")).toFloat(&lodThresholdValid);
+    if(!lodThresholdValid || lodThreshold < 0.0f)
+    {
+        std::cerr << "The LOD threshold must be 0 or more pixels" << std::endl;
+        return 1;
+    }
+    Rasterizer rasterizer(scene.m_polygons, scene.m_instances);
+    rasterizer.SetLights(scene.m_lights);
+    rasterizer.SetAOVs(aovFlags);
+    rasterizer.SetDepthFormat(depthFormat);
+    rasterizer.SetSampleCount(samples);
+    rasterizer.SetPostProcess(postProcess);
+    rasterizer.SetRenderScale(scale);
+    rasterizer.SetDrawSorting(sorting);
+    rasterizer.SetBackfaceCulling(parser.isSet(QString("cull-backfaces")));
+    rasterizer.SetLODThreshold(lodThreshold);
+    bool written = RenderSequence(rasterizer, scene.m_cameraPath, output, settings, parser.value(QString("threads")).toUInt(), aovFormat);
+    return written ? 0 : 1;
+}
 
 int main(int argc, char *argv[])
 {
+    //the command line modes need no window, so they run without a GUI application
+    for(int i = 1; i < argc; i++)
+    {
+        if(std::strcmp(argv[i], "--batch") == 0 || std::strcmp(argv[i], "--farm") == 0 || std::strcmp(argv[i], "--worker") == 0)
+        {
+            QCoreApplication a(argc, argv);
+            return RunCommandLine(a);
+        }
+    }
+
 	QApplication::setAttribute(Qt::AA_EnableHighDpiScaling);
     QApplication a(argc, argv);
     MainWindow w;
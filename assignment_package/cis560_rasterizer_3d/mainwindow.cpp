@@ -9,9 +9,11 @@
 #include <iostream>
 #include <QApplication>
 #include <QKeyEvent>
-#include <QImageWriter>
-#include <QDebug>
-#include <tiny_obj_loader.h>
+#include <QFileInfo>
+#include <QInputDialog>
+#include <QStatusBar>
+#include <chrono>
+#include <sceneloader.h>
 
 //Poke around in this file if you want, but it's virtually uncommented!
 //You won't need to modify anything in here to complete the assignment.
@@ -65,15 +67,15 @@ void MainWindow::keyPressEvent(QKeyEvent *e)
         break;
     }
 
-    rendered_image = rasterizer.RenderScene();
-    DisplayQImage(rendered_image);
+    RenderAndDisplay();
 }
 
 
 MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
     ui(new Ui::MainWindow),
-    rasterizer(std::vector<Polygon>())
+    rasterizer(std::vector<Polygon>()),
+    resolution_controller(16.0f)
 {
     ui->setupUi(this);
     setFocusPolicy(Qt::StrongFocus);
@@ -92,166 +94,58 @@ void MainWindow::DisplayQImage(QImage &i)
     ui->scene_display->setScene(&graphics_scene);
 }
 
-void MainWindow::on_actionLoad_Scene_triggered()
+void MainWindow::RenderAndDisplay()
 {
-    std::vector<Polygon> polygons;
-
-    QString filename = QFileDialog::getOpenFileName(0, QString("Load Scene File"), QDir::currentPath().append(QString("../..")), QString("*.json"));
-    int i = filename.length() - 1;
-    while(QString::compare(filename.at(i), QChar('/')) != 0)
-    {
-        i--;
-    }
-    QString local_path = filename.left(i+1);
-
-    QFile file(filename);
-    if(!file.open(QIODevice::ReadOnly)){
-        qWarning("Could not open the JSON file.");
-        return;
-    }
-    QByteArray file_data = file.readAll();
+    //the rasterizer is replaced whenever a scene is loaded, so the scale is set again for every frame
+    float scale = resolution_controller.GetScale();
+    rasterizer.SetRenderScale(scale);
+    auto start = std::chrono::steady_clock::now();
+    rendered_image = rasterizer.RenderScene();
+    float milliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    DisplayQImage(rendered_image);
 
-    QJsonDocument jdoc(QJsonDocument::fromJson(file_data));
-    //Read the mesh data in the file
-    QJsonArray objects = jdoc.object()["objects"].toArray();
-    for(int i = 0; i < objects.size(); i++)
+    resolution_controller.Update(milliseconds);
+    QString message = QString("%1 ms at %2% resolution").arg(milliseconds, 0, 'f', 1).arg(qRound(scale * 100.0f));
+    if(resolution_controller.GetFrameBudget() > 0.0f)
     {
-        std::vector<glm::vec4> vert_pos;
-        std::vector<glm::vec3> vert_col;
-        QJsonObject obj = objects[i].toObject();
-        QString type = obj["type"].toString();
-        //Custom Polygon case
-        if(QString::compare(type, QString("custom")) == 0)
-        {
-            QString name = obj["name"].toString();
-            QJsonArray pos = obj["vertexPos"].toArray();
-            for(int j = 0; j < pos.size(); j++)
-            {
-                QJsonArray arr = pos[j].toArray();
-                glm::vec4 p(arr[0].toDouble(), arr[1].toDouble(), arr[2].toDouble(), 1);
-                vert_pos.push_back(p);
-            }
-            QJsonArray col = obj["vertexCol"].toArray();
-            for(int j = 0; j < col.size(); j++)
-            {
-                QJsonArray arr = col[j].toArray();
-                glm::vec3 c(arr[0].toDouble(), arr[1].toDouble(), arr[2].toDouble());
-                vert_col.push_back(c);
-            }
-            Polygon p(name, vert_pos, vert_col);
-            polygons.push_back(p);
-        }
-        //Regular Polygon case
-        else if(QString::compare(type, QString("regular")) == 0)
-        {
-            QString name = obj["name"].toString();
-            int sides = obj["sides"].toInt();
-            QJsonArray colorA = obj["color"].toArray();
-            glm::vec3 color(colorA[0].toDouble(), colorA[1].toDouble(), colorA[2].toDouble());
-            QJsonArray posA = obj["pos"].toArray();
-            glm::vec4 pos(posA[0].toDouble(), posA[1].toDouble(), posA[2].toDouble(),1);
-            float rot = obj["rot"].toDouble();
-            QJsonArray scaleA = obj["scale"].toArray();
-            glm::vec4 scale(scaleA[0].toDouble(), scaleA[1].toDouble(), scaleA[2].toDouble(),1);
-            Polygon p(name, sides, color, pos, rot, scale);
-            polygons.push_back(p);
-        }
-        //OBJ file case
-        else if(QString::compare(type, QString("obj")) == 0)
-        {
-            QString name = obj["name"].toString();
-            QString filename = local_path;
-            filename.append(obj["filename"].toString());
-            Polygon p = LoadOBJ(filename, name);
-            QString texPath = local_path;
-            texPath.append(obj["texture"].toString());
-            p.SetTexture(new QImage(texPath));
-            if(obj.contains(QString("normalMap")))
-            {
-                p.SetNormalMap(new QImage(local_path.append(obj["normalMap"].toString())));
-            }
-            polygons.push_back(p);
-        }
+        message.append(QString(" (budget %1 ms)").arg(resolution_controller.GetFrameBudget(), 0, 'f', 1));
     }
-
-    rasterizer = Rasterizer(polygons);
-
-    rendered_image = rasterizer.RenderScene();
-    DisplayQImage(rendered_image);
+    statusBar()->showMessage(message);
 }
 
-
-Polygon MainWindow::LoadOBJ(const QString &file, const QString &polyName)
+void MainWindow::on_actionLoad_Scene_triggered()
 {
-    Polygon p(polyName);
-    QString filepath = file;
-    std::vector<tinyobj::shape_t> shapes; std::vector<tinyobj::material_t> materials;
-    std::string errors = tinyobj::LoadObj(shapes, materials, filepath.toStdString().c_str());
-    std::cout << errors << std::endl;
-    if(errors.size() == 0)
+    QString filename = QFileDialog::getOpenFileName(0, QString("Load Scene File"), QDir::currentPath().append(QString("../..")), QString("*.json"));
+    SceneDescription scene;
+    if(!LoadSceneFile(filename, &scene))
     {
-        int min_idx = 0;
-        //Read the information from the vector of shape_ts
-        for(unsigned int i = 0; i < shapes.size(); i++)
-        {
-            std::vector<glm::vec4> pos, nor;
-            std::vector<glm::vec2> uv;
-            std::vector<float> &positions = shapes[i].mesh.positions;
-            std::vector<float> &normals = shapes[i].mesh.normals;
-            std::vector<float> &uvs = shapes[i].mesh.texcoords;
-            for(unsigned int j = 0; j < positions.size()/3; j++)
-            {
-                pos.push_back(glm::vec4(positions[j*3], positions[j*3+1], positions[j*3+2],1));
-            }
-            for(unsigned int j = 0; j < normals.size()/3; j++)
-            {
-                nor.push_back(glm::vec4(normals[j*3], normals[j*3+1], normals[j*3+2],0));
-            }
-            for(unsigned int j = 0; j < uvs.size()/2; j++)
-            {
-                uv.push_back(glm::vec2(uvs[j*2], uvs[j*2+1]));
-            }
-            for(unsigned int j = 0; j < pos.size(); j++)
-            {
-                p.AddVertex(Vertex(pos[j], glm::vec3(255,255,255), nor[j], uv[j]));
-            }
+        return;
+    }
 
-            std::vector<unsigned int> indices = shapes[i].mesh.indices;
-            for(unsigned int j = 0; j < indices.size(); j += 3)
-            {
-                Triangle t;
-                t.m_indices[0] = indices[j] + min_idx;
-                t.m_indices[1] = indices[j+1] + min_idx;
-                t.m_indices[2] = indices[j+2] + min_idx;
-                p.AddTriangle(t);
-            }
+    rasterizer = Rasterizer(scene.m_polygons, scene.m_instances);
+    rasterizer.SetLights(scene.m_lights);
 
-            min_idx += pos.size();
-        }
-    }
-    else
-    {
-        //An error loading the OBJ occurred!
-        std::cout << errors << std::endl;
-    }
-    return p;
+    RenderAndDisplay();
 }
 
 
 void MainWindow::on_actionSave_Image_triggered()
 {
-    QString filename = QFileDialog::getSaveFileName(0, QString("Save Image"), QString("../.."), QString("*.bmp"));
-    QString ext = filename.right(4);
-    if(QString::compare(ext, QString(".bmp")) != 0)
+    QString filename = QFileDialog::getSaveFileName(0, QString("Save Image"), QString("../.."),
+                                                    QString("Bitmap (*.bmp);;PNG (*.png);;QOI (*.qoi);;Raw RGBA (*.rgba)"));
+    if(filename.isEmpty())
     {
-        filename.append(QString(".bmp"));
+        return;
     }
-    QImageWriter writer(filename);
-    writer.setFormat("bmp");
-    if(!writer.write(rendered_image))
+    //the format follows the extension, and files without a known one are saved as BMP as before
+    EncoderSettings settings(ImageFormat::Bmp);
+    if(!ImageFormatFromName(QFileInfo(filename).suffix(), &settings.m_format))
     {
-        qDebug() << writer.errorString();
+        filename.append(QString(".bmp"));
     }
+    //PNGs are saved with fast compression; rendered images are mostly flat color and still compress well
+    settings.m_pngLevel = 1;
+    image_writer.Write(rendered_image, filename, settings);
 }
 
 void MainWindow::on_actionEquilateral_Triangle_triggered()
@@ -281,11 +175,22 @@ void MainWindow::on_actionEquilateral_Triangle_triggered()
 
     rasterizer = Rasterizer(vec);
 
-    rendered_image = rasterizer.RenderScene();
-    DisplayQImage(rendered_image);
+    RenderAndDisplay();
 }
 
 void MainWindow::on_actionQuit_Esc_triggered()
 {
     QApplication::exit();
 }
+
+void MainWindow::on_actionSet_Frame_Budget_triggered()
+{
+    bool accepted = false;
+    double budget = QInputDialog::getDouble(this, QString("Frame Budget"),
+                                            QString("Milliseconds each frame may take to render (0 always renders at full resolution):"),
+                                            resolution_controller.GetFrameBudget(), 0.0, 1000.0, 1, &accepted);
+    if(accepted)
+    {
+        resolution_controller.SetFrameBudget(static_cast<float>(budget));
+    }
+}
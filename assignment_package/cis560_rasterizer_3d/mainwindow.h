@@ -6,6 +6,8 @@
 #include <QGraphicsScene>
 #include <polygon.h>
 #include <rasterizer.h>
+#include <framewriter.h>
+#include <resolutioncontroller.h>
 
 namespace Ui {
 class MainWindow;
@@ -23,6 +25,9 @@ public:
 
     void keyPressEvent(QKeyEvent *e);
 
+    //Renders the scene at the scale the frame budget allows, shows it, and reports how long it took
+    void RenderAndDisplay();
+
 private slots:
     void on_actionLoad_Scene_triggered();
 
@@ -32,9 +37,10 @@ private slots:
 
     void on_actionQuit_Esc_triggered();
 
+    void on_actionSet_Frame_Budget_triggered();
+
 private:
     Ui::MainWindow *ui;
-    Polygon LoadOBJ(const QString &file, const QString &polyName);
 
     //This is used to display the QImage produced by RenderScene in the GUI
     QGraphicsScene graphics_scene;
@@ -45,6 +51,12 @@ private:
     //The instance of the Rasterizer used to render our scene
     Rasterizer rasterizer;
 
+    //Encodes and saves images in the background so the window stays responsive
+    FrameWriter image_writer;
+
+    //Lowers the resolution frames are rendered at when they take longer than the frame budget
+    ResolutionController resolution_controller;
+
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,194 @@
+#include "meshcache.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QDateTime>
+#include <QtGlobal>
+#include <cstdint>
+#include <cstring>
+
+//vertices and triangles are written byte for byte, so a cache file is only read back on the kind of CPU that wrote it
+static_assert(Q_BYTE_ORDER == Q_LITTLE_ENDIAN, "Mesh caches are written straight from memory, which assumes a little-endian CPU");
+//(glm's vectors are plain floats, but declare their own copy constructors, so this checks there is no padding instead)
+static_assert(sizeof(Vertex) == 13 * sizeof(float) && sizeof(Triangle) == 3 * sizeof(unsigned int),
+              "Mesh caches copy vertices and triangles as bytes");
+
+static const char CACHE_MAGIC[4] = {'M', 'S', 'H', 'C'};
+//bumped whenever the layout, or what a preparation does, changes, so older caches are prepared again
+static const uint32_t CACHE_VERSION = 2;
+
+//what a cache file starts with: what it was made from, then how much follows
+struct CacheHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t preparation;
+    uint32_t lodCount;
+    int64_t sourceSize;
+    int64_t sourceModified;
+    uint32_t vertexCount;
+    uint32_t triangleCount;
+};
+
+//what each LOD starts with, after the vertices and triangles; its triangles follow
+struct CacheLODHeader
+{
+    uint32_t triangleCount;
+    uint32_t vertexCount;
+    float error;
+};
+
+// Reads count triangles indexing fewer than vertexCount vertices, as long as the file has that many
+// bytes left; *remaining is reduced by what was read
+static bool ReadTriangles(QFile& file, uint32_t count, uint32_t vertexCount, qint64* remaining, std::vector<Triangle>* tris)
+{
+    qint64 bytes = static_cast<qint64>(count) * sizeof(Triangle);
+    if(bytes > *remaining)
+    {
+        return false;
+    }
+    tris->resize(count);
+    if(file.read(reinterpret_cast<char*>(tris->data()), bytes) != bytes)
+    {
+        return false;
+    }
+    *remaining -= bytes;
+    //indices past the vertices would be read out of bounds while drawing
+    for(const Triangle& t : *tris)
+    {
+        for(unsigned int index : t.m_indices)
+        {
+            if(index >= vertexCount)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static QString CachePath(const QString& objFile)
+{
+    return objFile + QString(".meshcache");
+}
+
+// The header a cache file for the OBJ file as it is now should have (less the counts)
+static bool ExpectedHeader(const QString& objFile, unsigned int preparation, CacheHeader* header)
+{
+    QFileInfo info(objFile);
+    if(!info.isFile())
+    {
+        return false;
+    }
+    std::memset(header, 0, sizeof(CacheHeader));
+    std::memcpy(header->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header->version = CACHE_VERSION;
+    header->preparation = preparation;
+    header->sourceSize = info.size();
+    header->sourceModified = info.lastModified().toMSecsSinceEpoch();
+    return true;
+}
+
+bool LoadMeshCache(const QString& objFile, unsigned int preparation, Polygon* p)
+{
+    CacheHeader expected;
+    QFile file(CachePath(objFile));
+    if(!ExpectedHeader(objFile, preparation, &expected) || !file.open(QIODevice::ReadOnly))
+    {
+        return false;
+    }
+    CacheHeader header;
+    if(file.read(reinterpret_cast<char*>(&header), sizeof(header)) != sizeof(header)
+       || std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0
+       || header.version != expected.version || header.preparation != expected.preparation
+       || header.sourceSize != expected.sourceSize || header.sourceModified != expected.sourceModified)
+    {
+        return false;
+    }
+    //the counts are checked against what is left of the file before anything is allocated for them,
+    //and a file cut short (say, by a crash while it was written) reads as out of date too
+    qint64 remaining = file.size() - static_cast<qint64>(sizeof(header));
+    qint64 vertexBytes = static_cast<qint64>(header.vertexCount) * sizeof(Vertex);
+    if(vertexBytes > remaining)
+    {
+        return false;
+    }
+    std::vector<Vertex> verts(header.vertexCount);
+    if(file.read(reinterpret_cast<char*>(verts.data()), vertexBytes) != vertexBytes)
+    {
+        return false;
+    }
+    remaining -= vertexBytes;
+    std::vector<Triangle> tris;
+    if(!ReadTriangles(file, header.triangleCount, header.vertexCount, &remaining, &tris))
+    {
+        return false;
+    }
+    if(static_cast<qint64>(header.lodCount) * static_cast<qint64>(sizeof(CacheLODHeader)) > remaining)
+    {
+        return false;
+    }
+    std::vector<PolygonLOD> lods(header.lodCount);
+    for(PolygonLOD& lod : lods)
+    {
+        CacheLODHeader lodHeader;
+        if(static_cast<qint64>(sizeof(lodHeader)) > remaining
+           || file.read(reinterpret_cast<char*>(&lodHeader), sizeof(lodHeader)) != sizeof(lodHeader)
+           || lodHeader.vertexCount > header.vertexCount)
+        {
+            return false;
+        }
+        remaining -= sizeof(lodHeader);
+        if(!ReadTriangles(file, lodHeader.triangleCount, lodHeader.vertexCount, &remaining, &lod.m_tris))
+        {
+            return false;
+        }
+        lod.m_vertexCount = lodHeader.vertexCount;
+        lod.m_error = lodHeader.error;
+    }
+    if(remaining != 0)
+    {
+        return false;
+    }
+    p->m_verts.swap(verts);
+    p->m_tris.swap(tris);
+    p->m_lods.swap(lods);
+    return true;
+}
+
+bool SaveMeshCache(const QString& objFile, unsigned int preparation, const Polygon& p)
+{
+    CacheHeader header;
+    if(p.IsPacked() || !ExpectedHeader(objFile, preparation, &header))
+    {
+        return false;
+    }
+    header.vertexCount = p.m_verts.size();
+    header.triangleCount = p.m_tris.size();
+    header.lodCount = p.m_lods.size();
+    //written to a temporary file that replaces the cache only once complete, so processes loading the
+    //same scene at once (such as farm workers) only ever see no cache or a whole one
+    QSaveFile file(CachePath(objFile));
+    if(!file.open(QIODevice::WriteOnly))
+    {
+        return false;
+    }
+    qint64 vertexBytes = static_cast<qint64>(p.m_verts.size()) * sizeof(Vertex);
+    qint64 triangleBytes = static_cast<qint64>(p.m_tris.size()) * sizeof(Triangle);
+    bool written = file.write(reinterpret_cast<const char*>(&header), sizeof(header)) == sizeof(header)
+                   && file.write(reinterpret_cast<const char*>(p.m_verts.data()), vertexBytes) == vertexBytes
+                   && file.write(reinterpret_cast<const char*>(p.m_tris.data()), triangleBytes) == triangleBytes;
+    for(const PolygonLOD& lod : p.m_lods)
+    {
+        CacheLODHeader lodHeader = {static_cast<uint32_t>(lod.m_tris.size()), lod.m_vertexCount, lod.m_error};
+        qint64 lodBytes = static_cast<qint64>(lod.m_tris.size()) * sizeof(Triangle);
+        written = written && file.write(reinterpret_cast<const char*>(&lodHeader), sizeof(lodHeader)) == sizeof(lodHeader)
+                  && file.write(reinterpret_cast<const char*>(lod.m_tris.data()), lodBytes) == lodBytes;
+    }
+    //a partly written cache is dropped along with the temporary file
+    if(!written)
+    {
+        file.cancelWriting();
+    }
+    return file.commit();
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <QString>
+#include <polygon.h>
+
+// What is done to an OBJ file's mesh after it is read. Combine them with | to do several.
+enum MeshPreparation : unsigned int
+{
+    // The triangles and vertices as the file lists them
+    MESH_AS_LOADED = 0,
+    // Reordered for locality and less overdraw (see Polygon::OptimizeTriangleOrder)
+    MESH_OPTIMIZED = 1,
+    // Welded, and rid of triangles with no area or repeated (see Polygon::Clean); done before optimizing
+    MESH_CLEANED = 2,
+    // Given a chain of simplified LODs (see Polygon::BuildLODs); done last, and only useful on a
+    // mesh that has been cleaned, since simplification never moves a position split across vertices
+    MESH_SIMPLIFIED = 4
+};
+
+// Preparing a large mesh can take far longer than reading it, so the result is saved in a binary
+// file next to the OBJ file (its name with ".meshcache" added) and read back the next time the same
+// file is loaded the same way. A cache file is only used while the OBJ file keeps the size and
+// modification time it had when the cache was written, and was prepared the same way.
+
+// Fills p's vertices, triangles and LODs from the cache file for an OBJ file prepared as given.
+// Returns false, leaving p as it was, if there is no such cache file or it is out of date.
+bool LoadMeshCache(const QString& objFile, unsigned int preparation, Polygon* p);
+
+// Writes the vertices, triangles and LODs of p, an OBJ file's mesh prepared as given, to its cache file.
+// The file is replaced atomically, so it is safe to load while another process writes it.
+// Returns false if the file cannot be written (the mesh is then just prepared again next time).
+bool SaveMeshCache(const QString& objFile, unsigned int preparation, const Polygon& p);
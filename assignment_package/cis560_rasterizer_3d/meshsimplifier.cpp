@@ -0,0 +1,346 @@
+#include "meshsimplifier.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <queue>
+#include <unordered_map>
+
+//a collapse is not made if it would turn any triangle around the moving end further than this
+//(the cosine of the angle between its normals before and after)
+static const float MIN_COLLAPSE_NORMAL_COS = 0.2f;
+//a LOD is only kept if it has at most this fraction of the triangles of the one before, so a mesh
+//that can hardly be simplified does not get a chain of near copies
+static const float MAX_LOD_TRIANGLE_FRACTION = 0.8f;
+
+// The sum of the squared distances from a point to a set of planes, as the symmetric 4x4 matrix
+// Q = sum of p p^T over the planes p = (a, b, c, d), so the sum at x is (x, 1)^T Q (x, 1).
+// Kept in doubles, since it is the small difference of large sums
+struct Quadric
+{
+    double m_aa, m_ab, m_ac, m_ad, m_bb, m_bc, m_bd, m_cc, m_cd, m_dd;
+
+    Quadric()
+        : m_aa(0), m_ab(0), m_ac(0), m_ad(0), m_bb(0), m_bc(0), m_bd(0), m_cc(0), m_cd(0), m_dd(0)
+    {}
+
+    // The quadric of one plane through point with unit normal
+    Quadric(const glm::vec3& normal, const glm::vec3& point)
+    {
+        double a = normal.x, b = normal.y, c = normal.z, d = -glm::dot(normal, point);
+        m_aa = a * a; m_ab = a * b; m_ac = a * c; m_ad = a * d;
+        m_bb = b * b; m_bc = b * c; m_bd = b * d;
+        m_cc = c * c; m_cd = c * d;
+        m_dd = d * d;
+    }
+
+    Quadric& operator+=(const Quadric& q)
+    {
+        m_aa += q.m_aa; m_ab += q.m_ab; m_ac += q.m_ac; m_ad += q.m_ad;
+        m_bb += q.m_bb; m_bc += q.m_bc; m_bd += q.m_bd;
+        m_cc += q.m_cc; m_cd += q.m_cd;
+        m_dd += q.m_dd;
+        return *this;
+    }
+
+    double Evaluate(const glm::vec3& p) const
+    {
+        double x = p.x, y = p.y, z = p.z;
+        double error = m_aa * x * x + 2 * m_ab * x * y + 2 * m_ac * x * z + 2 * m_ad * x
+                       + m_bb * y * y + 2 * m_bc * y * z + 2 * m_bd * y
+                       + m_cc * z * z + 2 * m_cd * z
+                       + m_dd;
+        //rounding can take a sum of squares a little below zero
+        return std::max(error, 0.0);
+    }
+};
+
+// Moving position m_from onto m_to, and what it costs. The versions are those of both ends when the
+// cost was worked out; once either end changes, the collapse is stale and skipped.
+struct Collapse
+{
+    double m_cost;
+    unsigned int m_from;
+    unsigned int m_to;
+    unsigned int m_fromVersion;
+    unsigned int m_toVersion;
+
+    bool operator>(const Collapse& other) const { return m_cost > other.m_cost; }
+};
+
+// A triangle while the mesh is simplified: the positions at its corners, and the vertices
+struct WorkingTriangle
+{
+    unsigned int m_positions[3];
+    unsigned int m_vertices[3];
+    bool m_alive;
+};
+
+static glm::vec3 TriangleNormal(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2)
+{
+    return glm::cross(p1 - p0, p2 - p0);
+}
+
+std::vector<PolygonLOD> SimplifyMesh(const std::vector<glm::vec3>& positions, const std::vector<Triangle>& triangles,
+                                     const std::vector<unsigned int>& targetTriangles)
+{
+    std::vector<PolygonLOD> lods;
+    unsigned int vertexCount = positions.size();
+    unsigned int triangleCount = triangles.size();
+    if(targetTriangles.empty() || triangleCount == 0)
+    {
+        return lods;
+    }
+
+    //the mesh is simplified by position: vertices split for their normals or UVs move together
+    std::vector<unsigned int> positionOf = FirstAtSamePosition(positions);
+    std::vector<WorkingTriangle> working(triangleCount);
+    std::vector<std::vector<unsigned int>> positionTriangles(vertexCount);
+    for(unsigned int i = 0; i < triangleCount; i++)
+    {
+        WorkingTriangle& t = working[i];
+        for(unsigned int corner = 0; corner < 3; corner++)
+        {
+            t.m_vertices[corner] = triangles[i].m_indices[corner];
+            t.m_positions[corner] = positionOf[t.m_vertices[corner]];
+            positionTriangles[t.m_positions[corner]].push_back(i);
+        }
+        t.m_alive = true;
+    }
+
+    //positions that never move: those with more than one vertex (a seam), and the ends of edges with
+    //a single triangle on them (an outline) or more than two (where surfaces meet)
+    std::vector<bool> locked(vertexCount, false);
+    for(unsigned int v = 0; v < vertexCount; v++)
+    {
+        locked[positionOf[v]] = locked[positionOf[v]] || positionOf[v] != v;
+    }
+    std::unordered_map<std::uint64_t, unsigned int> edgeTriangles;
+    edgeTriangles.reserve(triangleCount * 3);
+    auto edgeKey = [](unsigned int a, unsigned int b) {
+        return (static_cast<std::uint64_t>(std::min(a, b)) << 32) | std::max(a, b);
+    };
+    for(const WorkingTriangle& t : working)
+    {
+        for(unsigned int corner = 0; corner < 3; corner++)
+        {
+            edgeTriangles[edgeKey(t.m_positions[corner], t.m_positions[(corner + 1) % 3])]++;
+        }
+    }
+    for(const auto& edge : edgeTriangles)
+    {
+        if(edge.second != 2)
+        {
+            locked[edge.first >> 32] = true;
+            locked[edge.first & 0xffffffffu] = true;
+        }
+    }
+
+    //every position's quadric starts as the planes of the triangles around it
+    std::vector<Quadric> quadrics(vertexCount);
+    for(const WorkingTriangle& t : working)
+    {
+        const glm::vec3& p0 = positions[t.m_positions[0]];
+        glm::vec3 normal = TriangleNormal(p0, positions[t.m_positions[1]], positions[t.m_positions[2]]);
+        float length = glm::length(normal);
+        if(length == 0.0f)
+        {
+            continue;
+        }
+        Quadric plane(normal / length, p0);
+        for(unsigned int position : t.m_positions)
+        {
+            quadrics[position] += plane;
+        }
+    }
+
+    std::vector<unsigned int> version(vertexCount, 0);
+    std::vector<bool> removed(vertexCount, false);
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> collapses;
+    auto pushCollapse = [&](unsigned int from, unsigned int to) {
+        if(locked[from])
+        {
+            return;
+        }
+        Quadric combined = quadrics[from];
+        combined += quadrics[to];
+        collapses.push(Collapse{combined.Evaluate(positions[to]), from, to, version[from], version[to]});
+    };
+    for(const auto& edge : edgeTriangles)
+    {
+        unsigned int a = edge.first >> 32, b = edge.first & 0xffffffffu;
+        pushCollapse(a, b);
+        pushCollapse(b, a);
+    }
+
+    //the positions around one, gathered into a reused buffer
+    std::vector<unsigned int> neighborsFrom, neighborsTo;
+    auto gatherNeighbors = [&](unsigned int position, std::vector<unsigned int>* neighbors) {
+        neighbors->clear();
+        for(unsigned int i : positionTriangles[position])
+        {
+            if(!working[i].m_alive)
+            {
+                continue;
+            }
+            for(unsigned int other : working[i].m_positions)
+            {
+                if(other != position)
+                {
+                    neighbors->push_back(other);
+                }
+            }
+        }
+        std::sort(neighbors->begin(), neighbors->end());
+        neighbors->erase(std::unique(neighbors->begin(), neighbors->end()), neighbors->end());
+    };
+
+    unsigned int aliveTriangles = triangleCount;
+    double maxCost = 0.0;
+    unsigned int nextTarget = 0;
+    auto snapshot = [&]() {
+        PolygonLOD lod;
+        lod.m_vertexCount = 0;
+        lod.m_error = static_cast<float>(std::sqrt(maxCost));
+        lod.m_tris.reserve(aliveTriangles);
+        for(const WorkingTriangle& t : working)
+        {
+            if(t.m_alive)
+            {
+                Triangle triangle;
+                std::copy(t.m_vertices, t.m_vertices + 3, triangle.m_indices);
+                lod.m_tris.push_back(triangle);
+            }
+        }
+        size_t previous = lods.empty() ? triangleCount : lods.back().m_tris.size();
+        if(lod.m_tris.size() <= MAX_LOD_TRIANGLE_FRACTION * previous)
+        {
+            lods.push_back(lod);
+        }
+    };
+
+    while(nextTarget < targetTriangles.size() && !collapses.empty())
+    {
+        Collapse c = collapses.top();
+        collapses.pop();
+        if(removed[c.m_from] || removed[c.m_to] || version[c.m_from] != c.m_fromVersion || version[c.m_to] != c.m_toVersion)
+        {
+            continue;
+        }
+        unsigned int from = c.m_from, to = c.m_to;
+
+        //the edge must still be there, with exactly the two triangles on it sharing the positions the
+        //ends have in common; a third shared neighbor would pinch the surface into two
+        gatherNeighbors(from, &neighborsFrom);
+        gatherNeighbors(to, &neighborsTo);
+        if(!std::binary_search(neighborsFrom.begin(), neighborsFrom.end(), to))
+        {
+            continue;
+        }
+        unsigned int shared = 0;
+        for(unsigned int n : neighborsFrom)
+        {
+            shared += std::binary_search(neighborsTo.begin(), neighborsTo.end(), n);
+        }
+        if(shared != 2)
+        {
+            continue;
+        }
+
+        //no triangle around the moving end may fold over, and the vertex it moves onto is the one
+        //the triangles on the edge use at the other end; where those differ, a seam at the other end
+        //runs between them and there is no one vertex to move onto
+        bool folds = false;
+        bool toVertexFound = false;
+        unsigned int toVertex = to;
+        for(unsigned int i : positionTriangles[from])
+        {
+            const WorkingTriangle& t = working[i];
+            if(!t.m_alive)
+            {
+                continue;
+            }
+            glm::vec3 before[3], after[3];
+            bool onEdge = false;
+            for(unsigned int corner = 0; corner < 3; corner++)
+            {
+                before[corner] = positions[t.m_positions[corner]];
+                after[corner] = t.m_positions[corner] == from ? positions[to] : before[corner];
+                if(t.m_positions[corner] == to)
+                {
+                    onEdge = true;
+                    folds = folds || (toVertexFound && toVertex != t.m_vertices[corner]);
+                    toVertexFound = true;
+                    toVertex = t.m_vertices[corner];
+                }
+            }
+            if(folds)
+            {
+                break;
+            }
+            if(onEdge)
+            {
+                continue;
+            }
+            glm::vec3 normalBefore = TriangleNormal(before[0], before[1], before[2]);
+            glm::vec3 normalAfter = TriangleNormal(after[0], after[1], after[2]);
+            if(glm::dot(normalBefore, normalAfter) <= MIN_COLLAPSE_NORMAL_COS * glm::length(normalBefore) * glm::length(normalAfter))
+            {
+                folds = true;
+                break;
+            }
+        }
+        if(folds)
+        {
+            continue;
+        }
+
+        //the triangles on the edge go, and the others around the moving end move with it
+        for(unsigned int i : positionTriangles[from])
+        {
+            WorkingTriangle& t = working[i];
+            if(!t.m_alive)
+            {
+                continue;
+            }
+            if(t.m_positions[0] == to || t.m_positions[1] == to || t.m_positions[2] == to)
+            {
+                t.m_alive = false;
+                aliveTriangles--;
+                continue;
+            }
+            for(unsigned int corner = 0; corner < 3; corner++)
+            {
+                if(t.m_positions[corner] == from)
+                {
+                    t.m_positions[corner] = to;
+                    t.m_vertices[corner] = toVertex;
+                }
+            }
+            positionTriangles[to].push_back(i);
+        }
+        removed[from] = true;
+        quadrics[to] += quadrics[from];
+        version[to]++;
+        maxCost = std::max(maxCost, c.m_cost);
+
+        //every collapse to or from the end that stays now costs something else
+        gatherNeighbors(to, &neighborsTo);
+        for(unsigned int n : neighborsTo)
+        {
+            pushCollapse(to, n);
+            pushCollapse(n, to);
+        }
+
+        while(nextTarget < targetTriangles.size() && aliveTriangles <= targetTriangles[nextTarget])
+        {
+            snapshot();
+            nextTarget++;
+        }
+    }
+    //a mesh that runs out of edges to collapse stops at the coarsest it could get
+    if(nextTarget < targetTriangles.size())
+    {
+        snapshot();
+    }
+    return lods;
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+#include <polygon.h>
+
+// Simplifies a mesh by collapsing its edges one at a time, cheapest first, after Garland and
+// Heckbert's "Surface Simplification Using Quadric Error Metrics". Each collapse moves one end of
+// an edge onto the other, so the simplified triangles use a subset of the mesh's own vertices.
+//
+// Every position keeps the planes of the triangles around it in the original mesh, and a collapse
+// costs the sum of the squared distances from the position it moves to to the planes of both ends.
+// Collapses that would fold a triangle over, or pinch the surface into a non-manifold one, are not
+// made. The ends of open edges, and positions where the mesh splits its vertices for different
+// normals or UVs, never move, so outlines and UV seams stay where they are.
+//
+// Returns one LOD for each of targetTriangles (largest first) the mesh could be simplified to,
+// each with the triangles left once there were at most that many. Their m_error is the square root
+// of the costliest collapse made so far, a bound on how far the surface has moved. Their vertex
+// counts are left for the caller to fill.
+std::vector<PolygonLOD> SimplifyMesh(const std::vector<glm::vec3>& positions, const std::vector<Triangle>& triangles,
+                                     const std::vector<unsigned int>& targetTriangles);
@@ -0,0 +1,163 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <QColor>
+#include <glm/glm.hpp>
+
+// Where within a pixel its samples are taken for multisample anti-aliasing, as offsets from the
+// pixel's own sample point in pixels. These are the standard 4x and 8x patterns: every sample has
+// its own row and column, so near-horizontal and near-vertical edges both get every coverage step.
+struct SamplePattern
+{
+    int m_count;
+    glm::vec2 m_offsets[8];
+
+    // The pattern for 4 or 8 samples; any other count gets the single sample at the pixel's point
+    static const SamplePattern& ForCount(int count) {
+        static const SamplePattern single = {1, {glm::vec2(0.f, 0.f)}};
+        static const SamplePattern four = {4, {glm::vec2(-2.f, -6.f) / 16.f, glm::vec2(6.f, -2.f) / 16.f,
+                                               glm::vec2(-6.f, 2.f) / 16.f, glm::vec2(2.f, 6.f) / 16.f}};
+        static const SamplePattern eight = {8, {glm::vec2(1.f, -3.f) / 16.f, glm::vec2(-1.f, 3.f) / 16.f,
+                                                glm::vec2(5.f, 1.f) / 16.f, glm::vec2(-3.f, -5.f) / 16.f,
+                                                glm::vec2(-5.f, 5.f) / 16.f, glm::vec2(-7.f, -1.f) / 16.f,
+                                                glm::vec2(3.f, 7.f) / 16.f, glm::vec2(7.f, -7.f) / 16.f}};
+        return count == 8 ? eight : (count == 4 ? four : single);
+    }
+};
+
+// Which samples of a pixel a screen space triangle covers, and its depth at each of them.
+//
+// Each edge is evaluated from whichever of its endpoints sorts first, so two triangles sharing the
+// edge compute exactly opposite values. A sample exactly on the edge goes to the triangle on its
+// positive side, so samples along shared edges are covered once: never twice, never not at all.
+class TriangleCoverage
+{
+public:
+    // Sets up the triangle from its pixel space vertices, with depth in z
+    TriangleCoverage(const glm::vec4& v1, const glm::vec4& v2, const glm::vec4& v3)
+        : m_valid(false), m_z0(v1.z), m_x0(v1.x), m_y0(v1.y), m_dzdx(0.f), m_dzdy(0.f)
+    {
+        const glm::vec4* v[3] = {&v1, &v2, &v3};
+        float area = (v2.x - v1.x) * (v3.y - v1.y) - (v3.x - v1.x) * (v2.y - v1.y);
+        if (area == 0.f) {
+            return;
+        }
+        for (int i = 0; i < 3; i++) {
+            const glm::vec4* p = v[i];
+            const glm::vec4* q = v[(i + 1) % 3];
+            if (q->x < p->x || (q->x == p->x && q->y < p->y)) {
+                std::swap(p, q);
+            }
+            Edge& edge = m_edges[i];
+            edge.m_x = p->x;
+            edge.m_y = p->y;
+            edge.m_dx = q->x - p->x;
+            edge.m_dy = q->y - p->y;
+            //the side the third vertex is on is the inside
+            const glm::vec4& r = *v[(i + 2) % 3];
+            float side = edge.m_dx * (r.y - edge.m_y) - edge.m_dy * (r.x - edge.m_x);
+            if (side == 0.f) {
+                return;
+            }
+            edge.m_sign = side > 0.f ? 1.f : -1.f;
+        }
+        //depth is linear across the screen, so it comes from the triangle's plane
+        m_dzdx = ((v2.z - v1.z) * (v3.y - v1.y) - (v3.z - v1.z) * (v2.y - v1.y)) / area;
+        m_dzdy = ((v3.z - v1.z) * (v2.x - v1.x) - (v2.z - v1.z) * (v3.x - v1.x)) / area;
+        m_valid = true;
+    }
+
+    // False for triangles with no area, which cover no sample
+    bool Valid() const {
+        return m_valid;
+    }
+
+    // The samples of the pixel at (x, y) inside the triangle, as a bit mask
+    unsigned int Mask(int x, int y, const SamplePattern& pattern) const {
+        unsigned int mask = 0;
+        for (int s = 0; s < pattern.m_count; s++) {
+            if (Inside(x + pattern.m_offsets[s].x, y + pattern.m_offsets[s].y)) {
+                mask |= 1u << s;
+            }
+        }
+        return mask;
+    }
+
+    // The triangle's depth at a point of the screen
+    float DepthAt(float x, float y) const {
+        return m_z0 + m_dzdx * (x - m_x0) + m_dzdy * (y - m_y0);
+    }
+
+    // The columns of the row of pixels at y that can have a sample inside the triangle,
+    // given samples lie less than half a pixel from their pixel's point. False if there are none.
+    bool RowSpan(int y, int* xMin, int* xMax) const {
+        float yLow = y - 0.5f, yHigh = y + 0.5f;
+        float left = std::numeric_limits<float>::max(), right = -std::numeric_limits<float>::max();
+        for (const Edge& edge : m_edges) {
+            //the part of the edge within the band of rows the pixels' samples span
+            float y1 = edge.m_y, y2 = edge.m_y + edge.m_dy;
+            if (std::max(y1, y2) < yLow || std::min(y1, y2) > yHigh) {
+                continue;
+            }
+            float t1 = 0.f, t2 = 1.f;
+            if (edge.m_dy != 0.f) {
+                float ta = (yLow - y1) / edge.m_dy, tb = (yHigh - y1) / edge.m_dy;
+                t1 = std::max(0.f, std::min(ta, tb));
+                t2 = std::min(1.f, std::max(ta, tb));
+            }
+            float xa = edge.m_x + t1 * edge.m_dx, xb = edge.m_x + t2 * edge.m_dx;
+            left = std::min({left, xa, xb});
+            right = std::max({right, xa, xb});
+        }
+        if (left > right) {
+            return false;
+        }
+        *xMin = static_cast<int>(std::ceil(left - 0.5f));
+        *xMax = static_cast<int>(std::floor(right + 0.5f));
+        return *xMin <= *xMax;
+    }
+
+private:
+    struct Edge
+    {
+        float m_x, m_y, m_dx, m_dy;
+        float m_sign;
+    };
+
+    bool Inside(float x, float y) const {
+        for (const Edge& edge : m_edges) {
+            float e = edge.m_dx * (y - edge.m_y) - edge.m_dy * (x - edge.m_x);
+            if (e * edge.m_sign < 0.f || (e == 0.f && edge.m_sign < 0.f)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool m_valid;
+    Edge m_edges[3];
+    //the depth plane, from the first vertex
+    float m_z0, m_x0, m_y0;
+    float m_dzdx, m_dzdy;
+};
+
+// The color of a pixel from the colors of its samples: their average, rounded
+inline QRgb ResolveSamples(const QRgb* samples, int count) {
+    //most pixels are inside one triangle or none, with every sample alike
+    bool uniform = true;
+    for (int s = 1; s < count; s++) {
+        uniform = uniform && samples[s] == samples[0];
+    }
+    if (uniform) {
+        return samples[0];
+    }
+    int r = 0, g = 0, b = 0;
+    for (int s = 0; s < count; s++) {
+        r += qRed(samples[s]);
+        g += qGreen(samples[s]);
+        b += qBlue(samples[s]);
+    }
+    int half = count / 2;
+    return qRgb((r + half) / count, (g + half) / count, (b + half) / count);
+}
@@ -0,0 +1,65 @@
+#include "normalmap.h"
+#include <mutex>
+#include <unordered_map>
+
+static glm::uint PackSigned(float value)
+{
+    return static_cast<glm::uint>(static_cast<unsigned char>(static_cast<signed char>(glm::round(glm::clamp(value, -1.0f, 1.0f) * 127.0f))));
+}
+
+NormalMap::NormalMap(const QImage& image)
+    : m_width(image.width()), m_height(image.height()), m_texels()
+{
+    //the texture cache already hands out RGB32, so this is normally not a copy
+    QImage rgb = image.convertToFormat(QImage::Format_RGB32);
+    m_texels.resize(static_cast<size_t>(m_width) * m_height);
+    for(int y = 0; y < m_height; y++)
+    {
+        const QRgb* row = reinterpret_cast<const QRgb*>(rgb.constScanLine(y));
+        glm::uint* out = m_texels.data() + static_cast<size_t>(y) * m_width;
+        for(int x = 0; x < m_width; x++)
+        {
+            glm::vec3 n = glm::vec3(qRed(row[x]), qGreen(row[x]), qBlue(row[x])) * (2.0f / 255.0f) - 1.0f;
+            //compression artifacts leave many texels a little off unit length; a blank one points straight out
+            float length = glm::length(n);
+            n = length > 1e-4f ? n / length : glm::vec3(0.0f, 0.0f, 1.0f);
+            out[x] = PackSigned(n.x) | (PackSigned(n.y) << 8) | (PackSigned(n.z) << 16);
+        }
+    }
+}
+
+std::shared_ptr<const NormalMap> NormalMap::ForImage(const std::shared_ptr<const QImage>& image)
+{
+    if(!image || image->isNull())
+    {
+        return nullptr;
+    }
+    //the texture cache already shares one QImage between every Polygon using a file,
+    //so keying on the image shares the packed map the same way
+    struct Entry
+    {
+        std::weak_ptr<const QImage> image;
+        std::weak_ptr<const NormalMap> map;
+    };
+    static std::mutex mutex;
+    static std::unordered_map<const QImage*, Entry> entries;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    Entry& entry = entries[image.get()];
+    std::shared_ptr<const NormalMap> map = entry.map.lock();
+    //a released image's address may have been reused by a different one
+    if(map && entry.image.lock() == image)
+    {
+        return map;
+    }
+    map = std::make_shared<const NormalMap>(*image);
+    entry.image = image;
+    entry.map = map;
+
+    //forget maps nobody holds any more so the table does not grow without bound
+    for(auto it = entries.begin(); it != entries.end();)
+    {
+        it = it->second.map.expired() ? entries.erase(it) : std::next(it);
+    }
+    return map;
+}
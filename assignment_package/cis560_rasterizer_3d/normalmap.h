@@ -0,0 +1,47 @@
+#pragma once
+#include <QImage>
+#include <memory>
+#include <vector>
+#include <glm/glm.hpp>
+
+// A tangent space normal map decoded once from its image into signed 8-bit X, Y and Z,
+// one 32-bit word per texel, so a fragment's normal costs a single load and three
+// sign extensions rather than a QImage::pixel call and a remap from [0, 255] to [-1, 1].
+// Texels are addressed like GetImageColor addresses a texture.
+class NormalMap
+{
+public:
+    // Decodes an image whose red, green and blue channels hold a normal remapped to [0, 255]
+    explicit NormalMap(const QImage& image);
+
+    // Returns the packed map of an image, decoding it only the first time any Polygon asks.
+    // Returns a null pointer for a null or empty image.
+    static std::shared_ptr<const NormalMap> ForImage(const std::shared_ptr<const QImage>& image);
+
+    // The unit length normal at the specified texture coordinates
+    glm::vec3 Sample(const glm::vec2& uv) const
+    {
+        //unlike QImage::pixel there is no bounds check below, so stray coordinates are clamped
+        int x = glm::clamp(m_width * uv.x, 0.0f, m_width - 1.0f);
+        int y = glm::clamp(m_height * (1.0f - uv.y), 0.0f, m_height - 1.0f);
+        glm::uint texel = m_texels[y * m_width + x];
+        return glm::vec3(static_cast<signed char>(texel & 0xff),
+                         static_cast<signed char>((texel >> 8) & 0xff),
+                         static_cast<signed char>((texel >> 16) & 0xff)) * (1.0f / 127.0f);
+    }
+
+    int Width() const
+    {
+        return m_width;
+    }
+    int Height() const
+    {
+        return m_height;
+    }
+
+private:
+    int m_width;
+    int m_height;
+    // Row by row, X in the low byte, then Y and Z
+    std::vector<glm::uint> m_texels;
+};
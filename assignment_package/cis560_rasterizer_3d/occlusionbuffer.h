@@ -0,0 +1,213 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <QRect>
+#include <glm/glm.hpp>
+#include <framearena.h>
+#include <polygon.h>
+
+// Where a box lands on screen: the pixels it can cover and the nearest depth it can have.
+// Not valid if part of the box is behind the camera, since its projection is then unbounded.
+struct ProjectedBox
+{
+    bool m_valid;
+    float m_minX, m_minY, m_maxX, m_maxY;
+    float m_nearestZ;
+
+    ProjectedBox()
+        : m_valid(false), m_minX(0.f), m_minY(0.f), m_maxX(0.f), m_maxY(0.f), m_nearestZ(0.f)
+    {}
+
+    float Area() const {
+        return m_valid ? (m_maxX - m_minX) * (m_maxY - m_minY) : 0.f;
+    }
+};
+
+// A low resolution depth buffer that large occluders are drawn into before the frame,
+// so whole objects hidden behind them can be skipped before their vertices are transformed.
+//
+// Each cell covers 4x4 pixels of the region being drawn. A cell only takes an occluder's
+// depth once the occluder's triangle covers every pixel of it, and then the farthest depth
+// the triangle has there, so the buffer never claims more is hidden than really is: an object
+// reported hidden would have lost the depth test on every one of its pixels.
+//
+// Depth is one of the formats in depthformat.h; cells hold depths in its encoding.
+template <typename Depth>
+class OcclusionBuffer
+{
+public:
+    typedef typename Depth::Value Value;
+    static const int CELL_SHIFT = 2;
+    static const int CELL_SIZE = 1 << CELL_SHIFT;
+
+    // Covers the given region of a screenWidth x screenHeight frame, whose depth is tested up to
+    // sampleSpread pixels away from each pixel's point (with multisampling)
+    OcclusionBuffer(const QRect& region, int screenWidth, int screenHeight, Arena& arena, float sampleSpread = 0.0f)
+        : m_region(region), m_screenWidth(screenWidth), m_screenHeight(screenHeight), m_halfSpan(SAMPLE_HALF_SPAN + sampleSpread),
+          m_cellsX((region.width() + CELL_SIZE - 1) >> CELL_SHIFT), m_cellsY((region.height() + CELL_SIZE - 1) >> CELL_SHIFT),
+          m_cells(m_cellsX * m_cellsY, Depth::Clear(), ArenaAllocator<Value>(arena))
+    {}
+
+    // Projects a box through a model-view-projection matrix (one of Depth's projections)
+    ProjectedBox Project(const AxisAlignedBox& box, const glm::mat4& modelViewProjection) const {
+        ProjectedBox projected;
+        bool first = true;
+        for (int corner = 0; corner < 8; corner++) {
+            glm::vec4 p((corner & 1) ? box.m_max.x : box.m_min.x,
+                        (corner & 2) ? box.m_max.y : box.m_min.y,
+                        (corner & 4) ? box.m_max.z : box.m_min.z, 1.0f);
+            glm::vec3 screen;
+            if (!ToScreen(modelViewProjection * p, &screen)) {
+                return ProjectedBox();
+            }
+            if (first) {
+                projected.m_minX = projected.m_maxX = screen.x;
+                projected.m_minY = projected.m_maxY = screen.y;
+                projected.m_nearestZ = screen.z;
+                first = false;
+            } else {
+                projected.m_minX = std::min(projected.m_minX, screen.x);
+                projected.m_maxX = std::max(projected.m_maxX, screen.x);
+                projected.m_minY = std::min(projected.m_minY, screen.y);
+                projected.m_maxY = std::max(projected.m_maxY, screen.y);
+                //depth only grows with distance in front of the camera, so a corner is nearest
+                projected.m_nearestZ = Depth::Passes(Depth::Encode(screen.z), Depth::Encode(projected.m_nearestZ)) ? screen.z : projected.m_nearestZ;
+            }
+        }
+        projected.m_valid = true;
+        return projected;
+    }
+
+    // Draws the depth of one occluder triangle, given by its clip space vertices
+    void DrawTriangle(const glm::vec4& clip1, const glm::vec4& clip2, const glm::vec4& clip3) {
+        glm::vec3 v[3];
+        if (!ToScreen(clip1, &v[0]) || !ToScreen(clip2, &v[1]) || !ToScreen(clip3, &v[2])) {
+            return;
+        }
+        float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[2].x - v[0].x) * (v[1].y - v[0].y);
+        if (std::abs(area) < 1.0f) {
+            //too thin to cover a whole cell anyway
+            return;
+        }
+        float sign = area > 0.f ? 1.f : -1.f;
+
+        //edge functions E(x, y) = a * x + b * y + c, positive inside the triangle. A cell is covered
+        //when every one of its pixels (and their samples) is at least a hundredth of a pixel inside each edge
+        float a[3], b[3], c[3];
+        for (int i = 0; i < 3; i++) {
+            const glm::vec3& p = v[i];
+            const glm::vec3& q = v[(i + 1) % 3];
+            a[i] = sign * (p.y - q.y);
+            b[i] = sign * (q.x - p.x);
+            c[i] = -(a[i] * p.x + b[i] * p.y);
+            //measured from the pixel centers nearest the edge, and kept away from it by the margin
+            c[i] -= m_halfSpan * (std::abs(a[i]) + std::abs(b[i])) + 0.01f * std::sqrt(a[i] * a[i] + b[i] * b[i]);
+        }
+
+        //depth is linear across the screen; the farthest a cell holds is at one of its corner pixels
+        float dzdx = ((v[1].z - v[0].z) * (v[2].y - v[0].y) - (v[2].z - v[0].z) * (v[1].y - v[0].y)) / area;
+        float dzdy = ((v[2].z - v[0].z) * (v[1].x - v[0].x) - (v[1].z - v[0].z) * (v[2].x - v[0].x)) / area;
+        //(plus a hundredth of a pixel, for the rasterizer placing vertices slightly differently)
+        float spread = (m_halfSpan + 0.01f) * (std::abs(dzdx) + std::abs(dzdy));
+
+        //cells whose pixels fall within the triangle's bounds
+        float minX = std::min({v[0].x, v[1].x, v[2].x}), maxX = std::max({v[0].x, v[1].x, v[2].x});
+        float minY = std::min({v[0].y, v[1].y, v[2].y}), maxY = std::max({v[0].y, v[1].y, v[2].y});
+        int cellMinX = std::max(0, CellFloor(minX - m_region.left()));
+        int cellMinY = std::max(0, CellFloor(minY - m_region.top()));
+        int cellMaxX = std::min(m_cellsX - 1, CellFloor(maxX - m_region.left()));
+        int cellMaxY = std::min(m_cellsY - 1, CellFloor(maxY - m_region.top()));
+
+        //every loop iteration is independent straight-line arithmetic, so the compiler can vectorize it
+        for (int cy = cellMinY; cy <= cellMaxY; cy++) {
+            float y = CellCenter(cy, m_region.top());
+            Value* row = m_cells.data() + cy * m_cellsX;
+            for (int cx = cellMinX; cx <= cellMaxX; cx++) {
+                float x = CellCenter(cx, m_region.left());
+                float e0 = a[0] * x + b[0] * y + c[0];
+                float e1 = a[1] * x + b[1] * y + c[1];
+                float e2 = a[2] * x + b[2] * y + c[2];
+                if (e0 < 0.f || e1 < 0.f || e2 < 0.f) {
+                    continue;
+                }
+                float z = v[0].z + dzdx * (x - v[0].x) + dzdy * (y - v[0].y);
+                Value farthest = Farthest(z - spread, z + spread);
+                if (Depth::Passes(farthest, row[cx])) {
+                    row[cx] = farthest;
+                }
+            }
+        }
+    }
+
+    // Whether everything within a projected box is behind the occluders drawn so far
+    bool Hidden(const ProjectedBox& box) const {
+        if (!box.m_valid) {
+            return false;
+        }
+        //a pixel past the box's edges may still be drawn when it is rasterized
+        int minX = std::max(m_region.left(), static_cast<int>(std::floor(box.m_minX)) - 1) - m_region.left();
+        int minY = std::max(m_region.top(), static_cast<int>(std::floor(box.m_minY)) - 1) - m_region.top();
+        int maxX = std::min(m_region.right(), static_cast<int>(std::ceil(box.m_maxX)) + 1) - m_region.left();
+        int maxY = std::min(m_region.bottom(), static_cast<int>(std::ceil(box.m_maxY)) + 1) - m_region.top();
+        if (minX > maxX || minY > maxY) {
+            return false;
+        }
+        Value nearest = Nearest(box.m_nearestZ);
+        for (int cy = minY >> CELL_SHIFT; cy <= maxY >> CELL_SHIFT; cy++) {
+            const Value* row = m_cells.data() + cy * m_cellsX;
+            for (int cx = minX >> CELL_SHIFT; cx <= maxX >> CELL_SHIFT; cx++) {
+                if (!Depth::Passes(row[cx], nearest)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+private:
+    //distance from a cell's center to the centers of its outermost pixels
+    static constexpr float SAMPLE_HALF_SPAN = 0.5f * (CELL_SIZE - 1);
+
+    //pixel coordinates and depth of a clip space point, the same way the rasterizer computes
+    //them, or false if the point is not in front of the camera
+    bool ToScreen(const glm::vec4& clip, glm::vec3* screen) const {
+        if (!(clip.w > 1e-6f)) {
+            return false;
+        }
+        glm::vec3 ndc = glm::vec3(clip) / clip.w;
+        *screen = glm::vec3(m_screenWidth * (ndc.x + 1.0f) * 0.5f, m_screenHeight * (1.0f - ndc.y) * 0.5f, ndc.z);
+        return true;
+    }
+
+    static int CellFloor(float regionX) {
+        return static_cast<int>(std::floor(regionX)) >> CELL_SHIFT;
+    }
+
+    static float CellCenter(int cell, int regionStart) {
+        return static_cast<float>(regionStart + (cell << CELL_SHIFT)) + SAMPLE_HALF_SPAN;
+    }
+
+    //depths are rounded differently here than by the rasterizer, so both ends of every
+    //comparison are pushed a little the safe way
+    static float Margin(float z) {
+        return 1e-5f * std::abs(z) + 1e-7f;
+    }
+    static Value Farthest(float low, float high) {
+        Value a = Depth::Encode(low - Margin(low)), b = Depth::Encode(high + Margin(high));
+        return Depth::Passes(a, b) ? b : a;
+    }
+    static Value Nearest(float z) {
+        Value a = Depth::Encode(z - Margin(z)), b = Depth::Encode(z + Margin(z));
+        return Depth::Passes(a, b) ? a : b;
+    }
+
+    QRect m_region;
+    int m_screenWidth;
+    int m_screenHeight;
+    //distance from a cell's center to the farthest its depth is tested at
+    float m_halfSpan;
+    int m_cellsX;
+    int m_cellsY;
+    //Depth of the nearest occluder covering each cell, or Depth::Clear()
+    FrameVector<Value> m_cells;
+};
@@ -0,0 +1,60 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <cmath>
+
+// A compact, quantized form of a Vertex used to store large loaded meshes.
+// A Vertex spends 52 bytes on floats, including a w component for both its position
+// and its normal. A PackedVertex spends 20 bytes:
+//  - 3 floats of position (w is always 1)
+//  - the unit normal, octahedral-encoded into two 16-bit signed normalized values
+//  - the UV coordinates as two half floats
+// Vertex colors, if any, are kept in a separate array of 8-bit RGBA values (see Polygon::Pack)
+// so meshes with the default white color do not pay for them.
+struct PackedVertex
+{
+    float m_pos[3];
+    glm::uint m_normal;
+    glm::uint m_uv;
+};
+
+// Maps a direction onto the [-1, 1] square by projecting it onto an octahedron
+// and folding the lower half over the upper half. A zero normal is stored as +Z.
+inline glm::uint PackNormal(const glm::vec3& n)
+{
+    float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    if(l1 == 0.f)
+    {
+        return glm::packSnorm2x16(glm::vec2(0.f));
+    }
+    glm::vec2 p = glm::vec2(n.x, n.y) / l1;
+    if(n.z < 0.f)
+    {
+        p = glm::vec2((1.f - std::abs(p.y)) * (p.x >= 0.f ? 1.f : -1.f),
+                      (1.f - std::abs(p.x)) * (p.y >= 0.f ? 1.f : -1.f));
+    }
+    return glm::packSnorm2x16(p);
+}
+
+// Inverse of PackNormal. Returns a unit-length normal.
+inline glm::vec3 UnpackNormal(glm::uint packed)
+{
+    glm::vec2 p = glm::unpackSnorm2x16(packed);
+    glm::vec3 n(p.x, p.y, 1.f - std::abs(p.x) - std::abs(p.y));
+    if(n.z < 0.f)
+    {
+        n.x = (1.f - std::abs(p.y)) * (p.x >= 0.f ? 1.f : -1.f);
+        n.y = (1.f - std::abs(p.x)) * (p.y >= 0.f ? 1.f : -1.f);
+    }
+    return glm::normalize(n);
+}
+
+// Colors in this program are stored in [0, 255] rather than [0, 1]
+inline glm::uint PackColor(const glm::vec3& c)
+{
+    return glm::packUnorm4x8(glm::vec4(glm::clamp(c / 255.f, 0.f, 1.f), 1.f));
+}
+
+inline glm::vec3 UnpackColor(glm::uint packed)
+{
+    return glm::vec3(glm::unpackUnorm4x8(packed)) * 255.f;
+}
@@ -1,5 +1,15 @@
 #include "polygon.h"
+#include "meshsimplifier.h"
 #include <glm/gtx/transform.hpp>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <set>
+#include <tuple>
+#include <thread>
+#include <unordered_map>
 
 void Polygon::Triangulate()
 {
@@ -20,6 +30,26 @@ void Polygon::Triangulate()
 
 }
 
+std::vector<unsigned int> FirstAtSamePosition(const std::vector<glm::vec3>& positions)
+{
+    unsigned int count = positions.size();
+    std::vector<unsigned int> byPosition(count);
+    for(unsigned int i = 0; i < count; i++)
+    {
+        byPosition[i] = i;
+    }
+    std::sort(byPosition.begin(), byPosition.end(), [&](unsigned int l, unsigned int r)
+    {
+        return std::make_tuple(positions[l].x, positions[l].y, positions[l].z, l) < std::make_tuple(positions[r].x, positions[r].y, positions[r].z, r);
+    });
+    std::vector<unsigned int> first(count);
+    for(unsigned int i = 0; i < count; i++)
+    {
+        first[byPosition[i]] = i > 0 && positions[byPosition[i]] == positions[byPosition[i - 1]] ? first[byPosition[i - 1]] : byPosition[i];
+    }
+    return first;
+}
+
 glm::vec3 GetImageColor(const glm::vec2 &uv_coord, const QImage* const image)
 {
     if(image)
@@ -35,7 +65,7 @@ glm::vec3 GetImageColor(const glm::vec2 &uv_coord, const QImage* const image)
 
 // Creates a polygon from the input list of vertex positions and colors
 Polygon::Polygon(const QString& name, const std::vector<glm::vec4>& pos, const std::vector<glm::vec3>& col)
-    : m_tris(), m_verts(), m_name(name), mp_texture(nullptr), mp_normalMap(nullptr)
+    : m_tris(), m_verts(), m_name(name), mp_texture(nullptr), mp_normalMap(nullptr), mp_packedNormalMap(nullptr)
 {
     for(unsigned int i = 0; i < pos.size(); i++)
     {
@@ -48,7 +78,7 @@ Polygon::Polygon(const QString& name, const std::vector<glm::vec4>& pos, const s
 // All of its vertices are of color "color", and the polygon is centered at "pos".
 // It is rotated about its center by "rot" degrees, and is scaled from its center by "scale" units
 Polygon::Polygon(const QString& name, int sides, glm::vec3 color, glm::vec4 pos, float rot, glm::vec4 scale)
-    : m_tris(), m_verts(), m_name(name), mp_texture(nullptr), mp_normalMap(nullptr)
+    : m_tris(), m_verts(), m_name(name), mp_texture(nullptr), mp_normalMap(nullptr), mp_packedNormalMap(nullptr)
 {
     glm::vec4 v(0.f, 1.f, 0.f, 1.f);
     float angle = 360.f / sides;
@@ -66,39 +96,833 @@ Polygon::Polygon(const QString& name, int sides, glm::vec3 color, glm::vec4 pos,
 }
 
 Polygon::Polygon(const QString &name)
-    : m_tris(), m_verts(), m_name(name), mp_texture(nullptr), mp_normalMap(nullptr)
+    : m_tris(), m_verts(), m_name(name), mp_texture(nullptr), mp_normalMap(nullptr), mp_packedNormalMap(nullptr)
 {}
 
 Polygon::Polygon()
-    : m_tris(), m_verts(), m_name("Polygon"), mp_texture(nullptr), mp_normalMap(nullptr)
+    : m_tris(), m_verts(), m_name("Polygon"), mp_texture(nullptr), mp_normalMap(nullptr), mp_packedNormalMap(nullptr)
 {}
 
-Polygon::Polygon(const Polygon& p)
-    : m_tris(p.m_tris), m_verts(p.m_verts), m_name(p.m_name), mp_texture(nullptr), mp_normalMap(nullptr)
+void Polygon::SetTexture(std::shared_ptr<const QImage> i)
+{
+    mp_texture = std::move(i);
+}
+
+void Polygon::SetNormalMap(std::shared_ptr<const QImage> i)
+{
+    mp_normalMap = std::move(i);
+    mp_packedNormalMap = NormalMap::ForImage(mp_normalMap);
+}
+
+//runs body(begin, end) over [0, count) split into one contiguous range per thread
+template <typename Body>
+static void ParallelFor(unsigned int count, unsigned int threadCount, const Body& body)
+{
+    threadCount = std::max(1u, std::min(threadCount, count / 1024 + 1));
+    if(threadCount == 1)
+    {
+        body(0u, count);
+        return;
+    }
+    std::vector<std::thread> threads;
+    for(unsigned int t = 0; t < threadCount; t++)
+    {
+        unsigned int begin = static_cast<unsigned int>(static_cast<unsigned long long>(count) * t / threadCount);
+        unsigned int end = static_cast<unsigned int>(static_cast<unsigned long long>(count) * (t + 1) / threadCount);
+        threads.emplace_back([&body, begin, end]() { body(begin, end); });
+    }
+    for(std::thread& thread : threads)
+    {
+        thread.join();
+    }
+}
+
+//the triangles around each vertex, as one list per vertex laid end to end: those of vertex i are
+//vertexTriangles[firstTriangle[i]] up to vertexTriangles[firstTriangle[i + 1] - 1]
+static void VertexTriangles(const std::vector<Triangle>& triangles, unsigned int vertexCount,
+                            std::vector<unsigned int>* firstTriangle, std::vector<unsigned int>* vertexTriangles)
+{
+    firstTriangle->assign(vertexCount + 1, 0);
+    for(const Triangle& t : triangles)
+    {
+        for(unsigned int corner = 0; corner < 3; corner++)
+        {
+            (*firstTriangle)[t.m_indices[corner] + 1]++;
+        }
+    }
+    for(unsigned int i = 0; i < vertexCount; i++)
+    {
+        (*firstTriangle)[i + 1] += (*firstTriangle)[i];
+    }
+    vertexTriangles->assign((*firstTriangle)[vertexCount], 0);
+    std::vector<unsigned int> filled(firstTriangle->begin(), firstTriangle->end() - 1);
+    for(unsigned int i = 0; i < triangles.size(); i++)
+    {
+        for(unsigned int corner = 0; corner < 3; corner++)
+        {
+            (*vertexTriangles)[filled[triangles[i].m_indices[corner]]++] = i;
+        }
+    }
+}
+
+void Polygon::ComputeTangents(unsigned int threadCount)
+{
+    if(threadCount == 0)
+    {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    unsigned int vertexCount = VertexCount();
+    unsigned int triangleCount = m_tris.size();
+    //packed polygons are decoded once up front rather than once per triangle corner
+    std::vector<Vertex> decoded;
+    if(IsPacked())
+    {
+        decoded.reserve(vertexCount);
+        for(unsigned int i = 0; i < vertexCount; i++)
+        {
+            decoded.push_back(VertAt(i));
+        }
+    }
+    const std::vector<Vertex>& verts = IsPacked() ? decoded : m_verts;
+
+    //the directions of increasing U and V across each triangle. Each is scaled by the triangle's
+    //area in UV space, so tiny or badly stretched triangles count for little when they are summed
+    std::vector<glm::vec3> faceTangents(triangleCount), faceBitangents(triangleCount);
+    ParallelFor(triangleCount, threadCount, [&](unsigned int begin, unsigned int end) {
+        for(unsigned int i = begin; i < end; i++)
+        {
+            const Triangle& t = m_tris[i];
+            const Vertex& v0 = verts[t.m_indices[0]];
+            const Vertex& v1 = verts[t.m_indices[1]];
+            const Vertex& v2 = verts[t.m_indices[2]];
+            glm::vec3 e1 = glm::vec3(v1.m_pos - v0.m_pos), e2 = glm::vec3(v2.m_pos - v0.m_pos);
+            glm::vec2 d1 = v1.m_uv - v0.m_uv, d2 = v2.m_uv - v0.m_uv;
+            float sign = d1.x * d2.y - d2.x * d1.y < 0.0f ? -1.0f : 1.0f;
+            faceTangents[i] = sign * (e1 * d2.y - e2 * d1.y);
+            faceBitangents[i] = sign * (e2 * d1.x - e1 * d2.x);
+        }
+    });
+
+    //every vertex's triangles
+    std::vector<unsigned int> firstTriangle, vertexTriangles;
+    VertexTriangles(m_tris, vertexCount, &firstTriangle, &vertexTriangles);
+
+    //each vertex sums its own triangles, so no two threads ever write the same tangent
+    m_tangents.assign(vertexCount, glm::vec4(0.0f));
+    ParallelFor(vertexCount, threadCount, [&](unsigned int begin, unsigned int end) {
+        for(unsigned int i = begin; i < end; i++)
+        {
+            glm::vec3 tangent(0.0f), bitangent(0.0f);
+            for(unsigned int j = firstTriangle[i]; j < firstTriangle[i + 1]; j++)
+            {
+                tangent += faceTangents[vertexTriangles[j]];
+                bitangent += faceBitangents[vertexTriangles[j]];
+            }
+            glm::vec3 normal = glm::vec3(verts[i].m_normal);
+            float normalLength = glm::length(normal);
+            normal = normalLength > 0.0f ? normal / normalLength : glm::vec3(0.0f, 0.0f, 1.0f);
+            //keep only the part of the tangent along the surface; without usable UVs, any direction on it will do
+            tangent -= normal * glm::dot(normal, tangent);
+            if(glm::length(tangent) < 1e-12f)
+            {
+                tangent = glm::cross(normal, std::abs(normal.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f));
+            }
+            float handedness = glm::dot(glm::cross(normal, tangent), bitangent) < 0.0f ? -1.0f : 1.0f;
+            m_tangents[i] = glm::vec4(glm::normalize(tangent), handedness);
+        }
+    });
+}
+
+//how much further off a triangle counts as when building meshlets for each unit its normal is
+//turned away from the meshlet's, so meshlets follow the surface around less sharp corners
+static const float MESHLET_NORMAL_WEIGHT = 8.0f;
+
+void Polygon::BuildMeshlets(unsigned int maxTriangles)
+{
+    m_meshlets.clear();
+    m_meshletTriangles.clear();
+    m_triangleMeshlets.clear();
+    unsigned int vertexCount = VertexCount();
+    unsigned int triangleCount = m_tris.size();
+    maxTriangles = std::max(maxTriangles, 1u);
+    //positions are decoded once up front rather than once per triangle corner
+    std::vector<glm::vec3> positions(vertexCount);
+    for(unsigned int i = 0; i < vertexCount; i++)
+    {
+        positions[i] = glm::vec3(VertAt(i).m_pos);
+    }
+    //the center and unit normal of every triangle (by its winding; none for triangles without area)
+    std::vector<glm::vec3> centroids(triangleCount), normals(triangleCount);
+    for(unsigned int i = 0; i < triangleCount; i++)
+    {
+        const glm::vec3& p0 = positions[m_tris[i].m_indices[0]];
+        const glm::vec3& p1 = positions[m_tris[i].m_indices[1]];
+        const glm::vec3& p2 = positions[m_tris[i].m_indices[2]];
+        centroids[i] = (p0 + p1 + p2) / 3.0f;
+        glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+        float length = glm::length(normal);
+        normals[i] = length > 0.0f ? normal / length : glm::vec3(0.0f);
+    }
+
+    //triangles are neighbors when they share a corner. OBJ files give every corner its own vertex
+    //wherever normals or UVs differ (and the loader gives every corner its own vertex outright), so
+    //corners are matched by position: each vertex is numbered by the first vertex at the same position
+    std::vector<unsigned int> corner = FirstAtSamePosition(positions);
+    std::vector<Triangle> corners(m_tris);
+    for(Triangle& t : corners)
+    {
+        for(unsigned int& index : t.m_indices)
+        {
+            index = corner[index];
+        }
+    }
+    std::vector<unsigned int> firstTriangle, vertexTriangles;
+    VertexTriangles(corners, vertexCount, &firstTriangle, &vertexTriangles);
+
+    //meshlets grow greedily from the first triangle not yet taken, each time adding the neighboring
+    //triangle nearest the meshlet's center, counting a triangle facing away from the meshlet's average
+    //normal as further off, so meshlets come out compact and facing one way (which lets them be culled
+    //when facing away). Triangles filling a gap between the meshlet's corners go first regardless.
+    std::vector<bool> taken(triangleCount, false);
+    //the meshlet each corner was last added to, so whether one is in the current meshlet is a comparison
+    std::vector<unsigned int> cornerMeshlet(vertexCount, std::numeric_limits<unsigned int>::max());
+    std::vector<unsigned int> order;
+    order.reserve(triangleCount);
+    std::vector<unsigned int> candidates;
+    unsigned int seed = 0;
+    while(order.size() < triangleCount)
+    {
+        while(taken[seed])
+        {
+            seed++;
+        }
+        unsigned int meshlet = m_meshlets.size();
+        unsigned int first = order.size();
+        glm::vec3 centroidSum(0.0f), normalSum(0.0f);
+        candidates.clear();
+        unsigned int next = seed;
+        while(true)
+        {
+            taken[next] = true;
+            order.push_back(next);
+            centroidSum += centroids[next];
+            normalSum += normals[next];
+            for(unsigned int c : corners[next].m_indices)
+            {
+                if(cornerMeshlet[c] != meshlet)
+                {
+                    cornerMeshlet[c] = meshlet;
+                    candidates.insert(candidates.end(), vertexTriangles.begin() + firstTriangle[c], vertexTriangles.begin() + firstTriangle[c + 1]);
+                }
+            }
+            if(order.size() - first >= maxTriangles)
+            {
+                break;
+            }
+
+            candidates.erase(std::remove_if(candidates.begin(), candidates.end(), [&](unsigned int c) { return taken[c]; }), candidates.end());
+            glm::vec3 center = centroidSum / static_cast<float>(order.size() - first);
+            float normalLength = glm::length(normalSum);
+            glm::vec3 normal = normalLength > 0.0f ? normalSum / normalLength : glm::vec3(0.0f);
+            unsigned int best = triangleCount;
+            bool bestFillsGap = false;
+            float bestCost = 0.0f;
+            for(unsigned int candidate : candidates)
+            {
+                bool fillsGap = true;
+                for(unsigned int c : corners[candidate].m_indices)
+                {
+                    fillsGap = fillsGap && cornerMeshlet[c] == meshlet;
+                }
+                float distance = glm::length(centroids[candidate] - center);
+                float cost = distance * (1.0f + MESHLET_NORMAL_WEIGHT * (1.0f - glm::dot(normals[candidate], normal)));
+                if(best == triangleCount || (fillsGap && !bestFillsGap) || (fillsGap == bestFillsGap && cost < bestCost))
+                {
+                    best = candidate;
+                    bestFillsGap = fillsGap;
+                    bestCost = cost;
+                }
+            }
+            //nothing left around the meshlet
+            if(best == triangleCount)
+            {
+                break;
+            }
+            next = best;
+        }
+        //each meshlet keeps its triangles in the order they came in, so an order chosen for locality
+        //beforehand (see OptimizeTriangleOrder) carries on within it
+        std::sort(order.begin() + first, order.end());
+        Meshlet m;
+        m.m_firstTriangle = first;
+        m.m_triangleCount = order.size() - first;
+        m_meshlets.push_back(m);
+    }
+
+    for(Meshlet& m : m_meshlets)
+    {
+        //a sphere centered on the box around the triangles, as for the whole polygon
+        glm::vec3 minPos(std::numeric_limits<float>::max()), maxPos(-std::numeric_limits<float>::max());
+        glm::vec3 normalSum(0.0f);
+        for(unsigned int i = m.m_firstTriangle; i < m.m_firstTriangle + m.m_triangleCount; i++)
+        {
+            for(unsigned int index : m_tris[order[i]].m_indices)
+            {
+                minPos = glm::min(minPos, positions[index]);
+                maxPos = glm::max(maxPos, positions[index]);
+            }
+            normalSum += normals[order[i]];
+        }
+        glm::vec3 center = (minPos + maxPos) * 0.5f;
+        float radius = 0.0f;
+        //the cone around the triangles' average normal holding all of theirs. Triangles without
+        //area face nowhere and are never drawn, so they leave it as it is.
+        float sumLength = glm::length(normalSum);
+        glm::vec3 axis = sumLength > 0.0f ? normalSum / sumLength : glm::vec3(0.0f);
+        float cosSpread = sumLength > 0.0f ? 1.0f : -1.0f;
+        for(unsigned int i = m.m_firstTriangle; i < m.m_firstTriangle + m.m_triangleCount; i++)
+        {
+            for(unsigned int index : m_tris[order[i]].m_indices)
+            {
+                radius = std::max(radius, glm::length(positions[index] - center));
+            }
+            if(normals[order[i]] != glm::vec3(0.0f))
+            {
+                cosSpread = std::min(cosSpread, glm::dot(normals[order[i]], axis));
+            }
+        }
+        m.m_bounds = glm::vec4(center, radius);
+        m.m_cone = glm::vec4(axis, cosSpread);
+    }
+
+    m_meshletTriangles.swap(order);
+    m_triangleMeshlets.assign(triangleCount, 0);
+    for(unsigned int meshlet = 0; meshlet < m_meshlets.size(); meshlet++)
+    {
+        const Meshlet& m = m_meshlets[meshlet];
+        for(unsigned int i = m.m_firstTriangle; i < m.m_firstTriangle + m.m_triangleCount; i++)
+        {
+            m_triangleMeshlets[m_meshletTriangles[i]] = meshlet;
+        }
+    }
+}
+
+//VERTEX CACHE ORDERING, after Tom Forsyth's "Linear-Speed Vertex Cache Optimisation": triangles
+//are drawn greedily, each time picking the one whose vertices score best in a simulated cache
+static const unsigned int VERTEX_CACHE_SIZE = 32;
+static const float CACHE_DECAY_POWER = 1.5f;
+static const float LAST_TRIANGLE_SCORE = 0.75f;
+static const float VALENCE_BOOST_SCALE = 2.0f;
+static const float VALENCE_BOOST_POWER = 0.5f;
+//clusters are split where their cache misses per triangle are within this factor of the whole mesh's
+//and they have at least this many triangles, so reordering them for overdraw costs little locality
+static const float OVERDRAW_CLUSTER_THRESHOLD = 1.05f;
+static const unsigned int MIN_OVERDRAW_CLUSTER = 16;
+
+// How much using a vertex in the next triangle is worth, given its place in the cache
+// (-1 when it is not in it) and how many triangles not drawn yet still use it
+static float VertexCacheScore(int cachePosition, unsigned int remainingTriangles)
+{
+    if(remainingTriangles == 0)
+    {
+        return -1.0f;
+    }
+    float score = 0.0f;
+    if(cachePosition >= 0)
+    {
+        //the last triangle's three vertices score the same, since drawing it used them all at once
+        score = cachePosition < 3 ? LAST_TRIANGLE_SCORE
+                                  : std::pow(1.0f - static_cast<float>(cachePosition - 3) / (VERTEX_CACHE_SIZE - 3), CACHE_DECAY_POWER);
+    }
+    //vertices with few triangles left are finished off first, rather than left to fall out of the cache
+    return score + VALENCE_BOOST_SCALE * std::pow(static_cast<float>(remainingTriangles), -VALENCE_BOOST_POWER);
+}
+
+// The order to draw the triangles in so vertices are reused while still in the cache
+static std::vector<unsigned int> VertexCacheOrder(const std::vector<Triangle>& triangles, unsigned int vertexCount)
+{
+    unsigned int triangleCount = triangles.size();
+    std::vector<unsigned int> firstTriangle, vertexTriangles;
+    VertexTriangles(triangles, vertexCount, &firstTriangle, &vertexTriangles);
+    std::vector<unsigned int> remaining(vertexCount);
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> score(vertexCount);
+    for(unsigned int v = 0; v < vertexCount; v++)
+    {
+        remaining[v] = firstTriangle[v + 1] - firstTriangle[v];
+        score[v] = VertexCacheScore(-1, remaining[v]);
+    }
+
+    std::vector<bool> drawn(triangleCount, false);
+    std::vector<unsigned int> order;
+    order.reserve(triangleCount);
+    std::vector<unsigned int> cache, nextCache;
+    unsigned int nextUndrawn = 0;
+    unsigned int best = triangleCount;
+    while(order.size() < triangleCount)
+    {
+        //nothing in the cache has triangles left: go on from the first triangle not drawn yet
+        if(best == triangleCount)
+        {
+            while(drawn[nextUndrawn])
+            {
+                nextUndrawn++;
+            }
+            best = nextUndrawn;
+        }
+        drawn[best] = true;
+        order.push_back(best);
+
+        //its vertices go to the front of the cache, pushing the rest back and the oldest out
+        nextCache.assign(triangles[best].m_indices, triangles[best].m_indices + 3);
+        for(unsigned int v : triangles[best].m_indices)
+        {
+            remaining[v]--;
+        }
+        for(unsigned int v : cache)
+        {
+            if(v != nextCache[0] && v != nextCache[1] && v != nextCache[2])
+            {
+                nextCache.push_back(v);
+            }
+        }
+        for(unsigned int i = 0; i < nextCache.size(); i++)
+        {
+            unsigned int v = nextCache[i];
+            cachePosition[v] = i < VERTEX_CACHE_SIZE ? static_cast<int>(i) : -1;
+            score[v] = VertexCacheScore(cachePosition[v], remaining[v]);
+        }
+        nextCache.resize(std::min<size_t>(nextCache.size(), VERTEX_CACHE_SIZE));
+        cache.swap(nextCache);
+
+        //the next triangle is the best scoring one using a vertex in the cache
+        best = triangleCount;
+        float bestScore = 0.0f;
+        for(unsigned int v : cache)
+        {
+            for(unsigned int i = firstTriangle[v]; i < firstTriangle[v + 1]; i++)
+            {
+                unsigned int candidate = vertexTriangles[i];
+                if(drawn[candidate])
+                {
+                    continue;
+                }
+                const Triangle& t = triangles[candidate];
+                float candidateScore = score[t.m_indices[0]] + score[t.m_indices[1]] + score[t.m_indices[2]];
+                if(best == triangleCount || candidateScore > bestScore)
+                {
+                    best = candidate;
+                    bestScore = candidateScore;
+                }
+            }
+        }
+    }
+    return order;
+}
+
+// Reorders clusters of consecutive triangles in order so the ones facing out from the middle of the
+// mesh come first, since they are the most likely to hide the others (after Sander, Nehab and Barczak's
+// "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw"). A cluster ends where the cache
+// starts over, where its triangles share no vertex with the ones before, or where it has been
+// about as cache friendly as the whole mesh, so the locality within each is kept.
+static void OrderClustersForOverdraw(const std::vector<Triangle>& triangles, const std::vector<glm::vec3>& positions, std::vector<unsigned int>* order)
+{
+    unsigned int triangleCount = order->size();
+    if(triangleCount == 0)
+    {
+        return;
+    }
+    //a first-in first-out cache counts the vertices each triangle brings in
+    std::vector<unsigned int> misses(triangleCount, 0);
+    std::vector<unsigned int> cachedSince(positions.size(), 0);
+    unsigned int loaded = 0, totalMisses = 0;
+    for(unsigned int i = 0; i < triangleCount; i++)
+    {
+        for(unsigned int v : triangles[(*order)[i]].m_indices)
+        {
+            if(cachedSince[v] == 0 || loaded - cachedSince[v] >= VERTEX_CACHE_SIZE)
+            {
+                cachedSince[v] = ++loaded;
+                misses[i]++;
+            }
+        }
+        totalMisses += misses[i];
+    }
+    float meshMissRate = static_cast<float>(totalMisses) / triangleCount;
+
+    //each cluster's own misses are counted from an empty cache, since it may end up drawn after any other
+    std::vector<unsigned int> clusterStarts;
+    unsigned int clusterMisses = 0, clusterLoadedBefore = 0;
+    std::fill(cachedSince.begin(), cachedSince.end(), 0);
+    loaded = 0;
+    for(unsigned int i = 0; i < triangleCount; i++)
+    {
+        unsigned int clusterSize = clusterStarts.empty() ? 0 : i - clusterStarts.back();
+        bool restart = misses[i] == 3;
+        bool cacheFriendly = clusterSize >= MIN_OVERDRAW_CLUSTER && clusterMisses <= OVERDRAW_CLUSTER_THRESHOLD * meshMissRate * clusterSize;
+        if(clusterStarts.empty() || restart || cacheFriendly)
+        {
+            clusterStarts.push_back(i);
+            clusterMisses = 0;
+            clusterLoadedBefore = loaded;
+        }
+        for(unsigned int v : triangles[(*order)[i]].m_indices)
+        {
+            if(cachedSince[v] <= clusterLoadedBefore || loaded - cachedSince[v] >= VERTEX_CACHE_SIZE)
+            {
+                cachedSince[v] = ++loaded;
+                clusterMisses++;
+            }
+        }
+    }
+    clusterStarts.push_back(triangleCount);
+
+    //how far each cluster's middle is out from the mesh's along the way the cluster faces,
+    //both weighed by the area of the triangles
+    std::vector<glm::vec3> clusterCenters(clusterStarts.size() - 1, glm::vec3(0.0f)), clusterNormals(clusterStarts.size() - 1, glm::vec3(0.0f));
+    glm::vec3 meshCenter(0.0f);
+    float meshArea = 0.0f;
+    for(unsigned int c = 0; c + 1 < clusterStarts.size(); c++)
+    {
+        float clusterArea = 0.0f;
+        for(unsigned int i = clusterStarts[c]; i < clusterStarts[c + 1]; i++)
+        {
+            const Triangle& t = triangles[(*order)[i]];
+            const glm::vec3& p0 = positions[t.m_indices[0]];
+            const glm::vec3& p1 = positions[t.m_indices[1]];
+            const glm::vec3& p2 = positions[t.m_indices[2]];
+            glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+            float area = glm::length(normal);
+            clusterCenters[c] += (p0 + p1 + p2) * (area / 3.0f);
+            clusterNormals[c] += normal;
+            clusterArea += area;
+        }
+        meshCenter += clusterCenters[c];
+        meshArea += clusterArea;
+        if(clusterArea > 0.0f)
+        {
+            clusterCenters[c] /= clusterArea;
+        }
+    }
+    if(meshArea > 0.0f)
+    {
+        meshCenter /= meshArea;
+    }
+    std::vector<float> outwardness(clusterCenters.size(), 0.0f);
+    std::vector<unsigned int> clusters(clusterCenters.size());
+    for(unsigned int c = 0; c < clusters.size(); c++)
+    {
+        clusters[c] = c;
+        float normalLength = glm::length(clusterNormals[c]);
+        if(normalLength > 0.0f)
+        {
+            outwardness[c] = glm::dot(clusterCenters[c] - meshCenter, clusterNormals[c] / normalLength);
+        }
+    }
+    std::stable_sort(clusters.begin(), clusters.end(), [&](unsigned int l, unsigned int r) { return outwardness[l] > outwardness[r]; });
+
+    std::vector<unsigned int> reordered;
+    reordered.reserve(triangleCount);
+    for(unsigned int c : clusters)
+    {
+        reordered.insert(reordered.end(), order->begin() + clusterStarts[c], order->begin() + clusterStarts[c + 1]);
+    }
+    order->swap(reordered);
+}
+
+// Moves every vertex attribute to its new index (attributes not kept for every vertex are left alone)
+template <typename T>
+static void RemapVertices(const std::vector<unsigned int>& remap, std::vector<T>* attribute)
 {
-    if(p.mp_texture != nullptr)
+    if(attribute->size() != remap.size())
     {
-        mp_texture = new QImage(*p.mp_texture);
+        return;
     }
-    if(p.mp_normalMap != nullptr)
+    std::vector<T> remapped(attribute->size());
+    for(unsigned int v = 0; v < remap.size(); v++)
     {
-        mp_normalMap = new QImage(*p.mp_normalMap);
+        remapped[remap[v]] = (*attribute)[v];
     }
+    attribute->swap(remapped);
 }
 
-Polygon::~Polygon()
+void Polygon::OptimizeTriangleOrder()
 {
-    delete mp_texture;
+    unsigned int vertexCount = VertexCount();
+    std::vector<glm::vec3> positions(vertexCount);
+    for(unsigned int i = 0; i < vertexCount; i++)
+    {
+        positions[i] = glm::vec3(VertAt(i).m_pos);
+    }
+    std::vector<unsigned int> order = VertexCacheOrder(m_tris, vertexCount);
+    OrderClustersForOverdraw(m_tris, positions, &order);
+
+    //vertices are renumbered in the order the triangles first use them, so drawing reads them front
+    //to back; any no triangle uses go last
+    std::vector<unsigned int> remap(vertexCount, std::numeric_limits<unsigned int>::max());
+    unsigned int nextVertex = 0;
+    std::vector<Triangle> reordered;
+    reordered.reserve(m_tris.size());
+    for(unsigned int i : order)
+    {
+        Triangle t = m_tris[i];
+        for(unsigned int& index : t.m_indices)
+        {
+            if(remap[index] == std::numeric_limits<unsigned int>::max())
+            {
+                remap[index] = nextVertex++;
+            }
+            index = remap[index];
+        }
+        reordered.push_back(t);
+    }
+    for(unsigned int& index : remap)
+    {
+        if(index == std::numeric_limits<unsigned int>::max())
+        {
+            index = nextVertex++;
+        }
+    }
+    m_tris.swap(reordered);
+    RemapVertices(remap, &m_verts);
+    RemapVertices(remap, &m_packedVerts);
+    RemapVertices(remap, &m_packedColors);
+    RemapVertices(remap, &m_tangents);
+    //meshlets are ranges of the old order, and LODs use the old vertex numbers
+    m_meshlets.clear();
+    m_meshletTriangles.clear();
+    m_triangleMeshlets.clear();
+    m_lods.clear();
 }
 
-void Polygon::SetTexture(QImage* i)
+//vertices are only welded where their normals are within about 1 degree of each other and their
+//UVs this close, so hard edges and UV seams are kept
+static const float WELD_NORMAL_COS = 0.9998f;
+static const float WELD_UV_TOLERANCE = 1e-5f;
+
+// Whether two vertices within the tolerance of each other are close enough in every attribute to be one
+static bool Weldable(const Vertex& a, const Vertex& b, float tolerance)
 {
-    mp_texture = i;
+    if(glm::length(glm::vec3(a.m_pos) - glm::vec3(b.m_pos)) > tolerance || a.m_color != b.m_color
+       || glm::length(a.m_uv - b.m_uv) > WELD_UV_TOLERANCE)
+    {
+        return false;
+    }
+    glm::vec3 normalA(a.m_normal), normalB(b.m_normal);
+    float lengths = glm::length(normalA) * glm::length(normalB);
+    return lengths > 0.0f ? glm::dot(normalA, normalB) >= WELD_NORMAL_COS * lengths : normalA == normalB;
 }
 
-void Polygon::SetNormalMap(QImage* i)
+// The key of the grid cell at integer coordinates, 21 bits per axis (cells further out wrap around,
+// which only puts more vertices in a cell to compare against)
+static std::uint64_t CellKey(const glm::ivec3& cell)
 {
-    mp_normalMap = i;
+    const std::uint64_t mask = (1u << 21) - 1;
+    return (static_cast<std::uint64_t>(cell.x) & mask) | ((static_cast<std::uint64_t>(cell.y) & mask) << 21)
+           | ((static_cast<std::uint64_t>(cell.z) & mask) << 42);
+}
+
+MeshCleanStats Polygon::Clean(float tolerance)
+{
+    MeshCleanStats stats;
+    stats.m_verticesBefore = VertexCount();
+    stats.m_verticesAfter = stats.m_verticesBefore;
+    stats.m_trianglesBefore = m_tris.size();
+    stats.m_degenerateTriangles = 0;
+    stats.m_duplicateTriangles = 0;
+    if(IsPacked())
+    {
+        return stats;
+    }
+    tolerance = std::max(tolerance, 0.0f);
+    unsigned int vertexCount = m_verts.size();
+
+    //WELDING: each vertex joins the first one before it close enough in every attribute. Vertices
+    //are kept in a grid of cells the size of the tolerance, so only the 27 cells around are searched
+    float cellSize = tolerance > 0.0f ? tolerance : 1.0f;
+    std::unordered_map<std::uint64_t, std::vector<unsigned int>> cells;
+    cells.reserve(vertexCount);
+    std::vector<unsigned int> weldedTo(vertexCount);
+    for(unsigned int v = 0; v < vertexCount; v++)
+    {
+        glm::ivec3 cell(glm::floor(glm::vec3(m_verts[v].m_pos) / cellSize));
+        weldedTo[v] = v;
+        for(int z = -1; z <= 1 && weldedTo[v] == v; z++)
+        {
+            for(int y = -1; y <= 1 && weldedTo[v] == v; y++)
+            {
+                for(int x = -1; x <= 1 && weldedTo[v] == v; x++)
+                {
+                    auto found = cells.find(CellKey(cell + glm::ivec3(x, y, z)));
+                    if(found == cells.end())
+                    {
+                        continue;
+                    }
+                    for(unsigned int other : found->second)
+                    {
+                        if(Weldable(m_verts[other], m_verts[v], tolerance))
+                        {
+                            weldedTo[v] = other;
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+        if(weldedTo[v] == v)
+        {
+            cells[CellKey(cell)].push_back(v);
+        }
+    }
+
+    //TRIANGLES: those left with no area (two corners welded together, or all three in a line to within
+    //the tolerance) cover no pixels, and a repeat of one already kept (from any corner, wound the same
+    //way) only covers the same ones again
+    std::set<std::array<unsigned int, 3>> kept;
+    std::vector<Triangle> cleaned;
+    cleaned.reserve(m_tris.size());
+    for(const Triangle& triangle : m_tris)
+    {
+        Triangle t;
+        for(unsigned int corner = 0; corner < 3; corner++)
+        {
+            t.m_indices[corner] = weldedTo[triangle.m_indices[corner]];
+        }
+        glm::vec3 p0(m_verts[t.m_indices[0]].m_pos), p1(m_verts[t.m_indices[1]].m_pos), p2(m_verts[t.m_indices[2]].m_pos);
+        //twice the area over the longest edge is the triangle's height across it
+        float longestEdge = std::max({glm::length(p1 - p0), glm::length(p2 - p1), glm::length(p0 - p2)});
+        if(t.m_indices[0] == t.m_indices[1] || t.m_indices[1] == t.m_indices[2] || t.m_indices[2] == t.m_indices[0]
+           || glm::length(glm::cross(p1 - p0, p2 - p0)) <= tolerance * longestEdge)
+        {
+            stats.m_degenerateTriangles++;
+            continue;
+        }
+        unsigned int first = std::min_element(t.m_indices, t.m_indices + 3) - t.m_indices;
+        std::array<unsigned int, 3> key = {t.m_indices[first], t.m_indices[(first + 1) % 3], t.m_indices[(first + 2) % 3]};
+        if(!kept.insert(key).second)
+        {
+            stats.m_duplicateTriangles++;
+            continue;
+        }
+        cleaned.push_back(t);
+    }
+    m_tris.swap(cleaned);
+
+    //vertices no triangle uses any more are dropped, the rest keeping their order
+    std::vector<unsigned int> remap(vertexCount, std::numeric_limits<unsigned int>::max());
+    for(const Triangle& t : m_tris)
+    {
+        for(unsigned int index : t.m_indices)
+        {
+            remap[index] = 0;
+        }
+    }
+    std::vector<Vertex> verts;
+    for(unsigned int v = 0; v < vertexCount; v++)
+    {
+        if(remap[v] == 0)
+        {
+            remap[v] = verts.size();
+            verts.push_back(m_verts[v]);
+        }
+    }
+    for(Triangle& t : m_tris)
+    {
+        for(unsigned int& index : t.m_indices)
+        {
+            index = remap[index];
+        }
+    }
+    m_verts.swap(verts);
+    stats.m_verticesAfter = m_verts.size();
+    //all of these were worked out for the old vertices and triangles
+    m_tangents.clear();
+    m_meshlets.clear();
+    m_meshletTriangles.clear();
+    m_triangleMeshlets.clear();
+    m_lods.clear();
+    return stats;
+}
+
+void Polygon::BuildLODs(unsigned int maxLevels, unsigned int minTriangles)
+{
+    m_lods.clear();
+    std::vector<unsigned int> targets;
+    for(unsigned int target = m_tris.size() / 2; targets.size() < maxLevels && target >= minTriangles; target /= 2)
+    {
+        targets.push_back(target);
+    }
+    if(targets.empty())
+    {
+        return;
+    }
+    unsigned int vertexCount = VertexCount();
+    std::vector<glm::vec3> positions(vertexCount);
+    for(unsigned int i = 0; i < vertexCount; i++)
+    {
+        positions[i] = glm::vec3(VertAt(i).m_pos);
+    }
+    m_lods = SimplifyMesh(positions, m_tris, targets);
+
+    //every coarser LOD uses a subset of the vertices of the one before, so numbering the vertices by
+    //the coarsest LOD using them (and otherwise keeping their order) puts each LOD's vertices first
+    std::vector<unsigned int> coarsest(vertexCount, 0);
+    for(const Triangle& t : m_tris)
+    {
+        for(unsigned int index : t.m_indices)
+        {
+            coarsest[index] = 1;
+        }
+    }
+    for(unsigned int level = 0; level < m_lods.size(); level++)
+    {
+        for(const Triangle& t : m_lods[level].m_tris)
+        {
+            for(unsigned int index : t.m_indices)
+            {
+                coarsest[index] = level + 2;
+            }
+        }
+    }
+    std::vector<unsigned int> order(vertexCount);
+    for(unsigned int i = 0; i < vertexCount; i++)
+    {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) {
+        return coarsest[a] > coarsest[b];
+    });
+    std::vector<unsigned int> remap(vertexCount);
+    for(unsigned int i = 0; i < vertexCount; i++)
+    {
+        remap[order[i]] = i;
+    }
+
+    for(Triangle& t : m_tris)
+    {
+        for(unsigned int& index : t.m_indices)
+        {
+            index = remap[index];
+        }
+    }
+    for(unsigned int level = 0; level < m_lods.size(); level++)
+    {
+        PolygonLOD& lod = m_lods[level];
+        for(Triangle& t : lod.m_tris)
+        {
+            for(unsigned int& index : t.m_indices)
+            {
+                index = remap[index];
+            }
+        }
+        lod.m_vertexCount = std::count_if(coarsest.begin(), coarsest.end(), [&](unsigned int c) {
+            return c >= level + 2;
+        });
+    }
+    RemapVertices(remap, &m_verts);
+    RemapVertices(remap, &m_packedVerts);
+    RemapVertices(remap, &m_packedColors);
+    RemapVertices(remap, &m_tangents);
 }
 
 void Polygon::AddTriangle(const Triangle& t)
@@ -133,5 +957,106 @@ Vertex &Polygon::VertAt(unsigned int i)
 
 Vertex Polygon::VertAt(unsigned int i) const
 {
-    return m_verts[i];
+    if(!IsPacked())
+    {
+        return m_verts[i];
+    }
+    const PackedVertex& v = m_packedVerts[i];
+    glm::vec3 color = m_packedColors.empty() ? glm::vec3(255.f, 255.f, 255.f) : UnpackColor(m_packedColors[i]);
+    return Vertex(glm::vec4(v.m_pos[0], v.m_pos[1], v.m_pos[2], 1.f),
+                  color,
+                  glm::vec4(UnpackNormal(v.m_normal), 0.f),
+                  glm::unpackHalf2x16(v.m_uv));
+}
+
+void Polygon::Pack()
+{
+    if(IsPacked())
+    {
+        return;
+    }
+    bool allWhite = true;
+    for(const Vertex& v : m_verts)
+    {
+        if(v.m_color != glm::vec3(255.f, 255.f, 255.f))
+        {
+            allWhite = false;
+            break;
+        }
+    }
+
+    m_packedVerts.reserve(m_verts.size());
+    if(!allWhite)
+    {
+        m_packedColors.reserve(m_verts.size());
+    }
+    for(const Vertex& v : m_verts)
+    {
+        PackedVertex packed;
+        packed.m_pos[0] = v.m_pos.x;
+        packed.m_pos[1] = v.m_pos.y;
+        packed.m_pos[2] = v.m_pos.z;
+        packed.m_normal = PackNormal(glm::vec3(v.m_normal));
+        packed.m_uv = glm::packHalf2x16(v.m_uv);
+        m_packedVerts.push_back(packed);
+        if(!allWhite)
+        {
+            m_packedColors.push_back(PackColor(v.m_color));
+        }
+    }
+    //release the full-precision copy entirely rather than just clearing it
+    std::vector<Vertex>().swap(m_verts);
+}
+
+bool Polygon::IsPacked() const
+{
+    return !m_packedVerts.empty();
+}
+
+unsigned int Polygon::VertexCount() const
+{
+    return IsPacked() ? m_packedVerts.size() : m_verts.size();
+}
+
+glm::vec4 Polygon::BoundingSphere() const
+{
+    unsigned int count = VertexCount();
+    if(count == 0)
+    {
+        return glm::vec4(0.f);
+    }
+    //center the sphere on the axis-aligned bounding box of the vertices
+    glm::vec3 minPos(VertAt(0).m_pos);
+    glm::vec3 maxPos = minPos;
+    for(unsigned int i = 0; i < count; i++)
+    {
+        glm::vec3 pos(VertAt(i).m_pos);
+        minPos = glm::min(minPos, pos);
+        maxPos = glm::max(maxPos, pos);
+    }
+    glm::vec3 center = (minPos + maxPos) * 0.5f;
+    float radius = 0.f;
+    for(unsigned int i = 0; i < count; i++)
+    {
+        radius = glm::max(radius, glm::length(glm::vec3(VertAt(i).m_pos) - center));
+    }
+    return glm::vec4(center, radius);
+}
+
+AxisAlignedBox Polygon::BoundingBox3D() const
+{
+    AxisAlignedBox box;
+    unsigned int count = VertexCount();
+    if(count == 0)
+    {
+        return box;
+    }
+    box.m_min = box.m_max = glm::vec3(VertAt(0).m_pos);
+    for(unsigned int i = 1; i < count; i++)
+    {
+        glm::vec3 pos(VertAt(i).m_pos);
+        box.m_min = glm::min(box.m_min, pos);
+        box.m_max = glm::max(box.m_max, pos);
+    }
+    return box;
 }
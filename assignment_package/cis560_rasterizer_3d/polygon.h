@@ -1,9 +1,12 @@
 #pragma once
 #include <glm/glm.hpp>
 #include <vector>
+#include <memory>
 #include <QString>
 #include <QImage>
 #include <QColor>
+#include <packedvertex.h>
+#include <normalmap.h>
 
 // A Vertex is a point in space that defines one corner of a polygon.
 // Each Vertex has several attributes that determine how they contribute to the
@@ -18,6 +21,10 @@ struct Vertex
     Vertex(glm::vec4 p, glm::vec3 c, glm::vec4 n, glm::vec2 u)
         : m_pos(p), m_color(c), m_normal(n), m_uv(u)
     {}
+
+    Vertex()
+        : m_pos(), m_color(), m_normal(), m_uv()
+    {}
 };
 
 // Each Polygon can be decomposed into triangles that fill its area.
@@ -45,6 +52,61 @@ struct BoundingBox
         maxY = std::min(static_cast<float>(screenHeight - 1), maxY);
     }
 
+    // Clamps the box to a rectangle of pixels given by its inclusive corners
+    void ClampToRegion(int left, int top, int right, int bottom) {
+        minX = std::max(static_cast<float>(left), minX);
+        minY = std::max(static_cast<float>(top), minY);
+        maxX = std::min(static_cast<float>(right), maxX);
+        maxY = std::min(static_cast<float>(bottom), maxY);
+    }
+
+};
+
+// An axis-aligned box in 3D, given by its minimum and maximum corners
+struct AxisAlignedBox
+{
+    glm::vec3 m_min;
+    glm::vec3 m_max;
+
+    AxisAlignedBox()
+        : m_min(0.f), m_max(0.f)
+    {}
+};
+
+// A small cluster of neighboring triangles of a Polygon, which the rasterizer culls as a whole
+// before looking at any of its triangles (see Polygon::BuildMeshlets)
+struct Meshlet
+{
+    // Its triangles are those listed in the Polygon's m_meshletTriangles from m_firstTriangle on
+    unsigned int m_firstTriangle;
+    unsigned int m_triangleCount;
+    // A sphere enclosing the triangles, with the center in xyz and the radius in w
+    glm::vec4 m_bounds;
+    // A cone around the normal of every triangle (as given by its counterclockwise winding):
+    // its unit axis in xyz and the cosine of its half angle in w, 0 or less if the triangles
+    // face too many ways for all of them to ever face away from the camera at once
+    glm::vec4 m_cone;
+};
+
+// A coarser version of a Polygon's triangles over the same vertices (see Polygon::BuildLODs)
+struct PolygonLOD
+{
+    std::vector<Triangle> m_tris;
+    // The triangles only use the first m_vertexCount of the Polygon's vertices
+    unsigned int m_vertexCount;
+    // How far the surface may have moved from the full detail one, in the Polygon's own units
+    float m_error;
+};
+
+// What Polygon::Clean removed from a mesh
+struct MeshCleanStats
+{
+    unsigned int m_verticesBefore;
+    unsigned int m_verticesAfter;
+    unsigned int m_trianglesBefore;
+    // Triangles with no area left, and repeats of other triangles
+    unsigned int m_degenerateTriangles;
+    unsigned int m_duplicateTriangles;
 };
 
 class Polygon
@@ -53,33 +115,80 @@ public:
     // TODO: Populate this list of triangles in Triangulate()
     std::vector<Triangle> m_tris;
     // The list of Vertices that define this polygon. This is already filled by the Polygon constructor.
+    // Empty once the polygon has been packed; read vertices through VertAt() or m_packedVerts instead.
     std::vector<Vertex> m_verts;
+    // The compact form of m_verts, filled by Pack()
+    std::vector<PackedVertex> m_packedVerts;
+    // The 8-bit colors of m_packedVerts. Empty if every vertex is white.
+    std::vector<glm::uint> m_packedColors;
     // The name of this polygon, primarily to help you debug
     QString m_name;
     // The image that can be read to determine pixel color when used in conjunction with UV coordinates
-    // Not used until homework 3.
-    QImage* mp_texture;
+    // Shared with every other Polygon that uses the same texture (see TextureCache)
+    std::shared_ptr<const QImage> mp_texture;
     // The image that can be read to determine surface normal offset when used in conjunction with UV coordinates
-    // Not used until homework 3
-    QImage* mp_normalMap;
+    // Shared with every other Polygon that uses the same normal map (see TextureCache)
+    std::shared_ptr<const QImage> mp_normalMap;
+    // mp_normalMap decoded for shading, shared the same way
+    std::shared_ptr<const NormalMap> mp_packedNormalMap;
+    // The tangent of each vertex in xyz, perpendicular to its normal and pointing along increasing U,
+    // with w = 1 or -1 giving the direction of increasing V as w * cross(normal, tangent).
+    // Filled by ComputeTangents(); empty for polygons without a normal map.
+    std::vector<glm::vec4> m_tangents;
+    // The meshlets m_tris is divided into, filled by BuildMeshlets(); empty for polygons drawn
+    // triangle by triangle
+    std::vector<Meshlet> m_meshlets;
+    // The indices into m_tris of every meshlet's triangles, each meshlet's side by side
+    std::vector<unsigned int> m_meshletTriangles;
+    // The meshlet each triangle of m_tris is in, so meshlets can be culled without reordering m_tris
+    std::vector<unsigned int> m_triangleMeshlets;
+    // Ever coarser versions of m_tris, filled by BuildLODs(); empty for polygons always drawn in full
+    std::vector<PolygonLOD> m_lods;
 
     // Polygon class constructors
     Polygon(const QString& name, const std::vector<glm::vec4>& pos, const std::vector<glm::vec3> &col);
     Polygon(const QString& name, int sides, glm::vec3 color, glm::vec4 pos, float rot, glm::vec4 scale);
     Polygon(const QString& name);
     Polygon();
-    Polygon(const Polygon& p);
-    ~Polygon();
 
     // TODO: Complete the body of Triangulate() in polygon.cpp
     // Creates a set of triangles that, when combined, fill the area of this convex polygon.
     void Triangulate();
 
-    // Copies the input QImage into this Polygon's texture
-    void SetTexture(QImage*);
-
-    // Copies the input QImage into this Polygon's normal map
-    void SetNormalMap(QImage*);
+    // Shares the input image as this Polygon's texture
+    void SetTexture(std::shared_ptr<const QImage>);
+
+    // Shares the input image as this Polygon's normal map
+    void SetNormalMap(std::shared_ptr<const QImage>);
+
+    // Fills m_tangents from the triangles' positions and UVs, split across threadCount threads
+    // (default: one per core). Only meaningful once the polygon has been triangulated.
+    void ComputeTangents(unsigned int threadCount = 0);
+
+    // Welds together vertices within tolerance of each other (in the polygon's own units) whose
+    // normals, UVs and colors also match, then drops the triangles left with no area, repeats of
+    // other triangles, and the vertices no triangle uses. Meant for meshes as read from files, which
+    // often repeat a vertex for every face around it; tangents, meshlets and LODs are dropped, so
+    // compute them afterwards. Polygons that have been packed are left as they are.
+    MeshCleanStats Clean(float tolerance);
+
+    // Reorders m_tris so the triangles drawn one after another share vertices as much as possible
+    // (for a 32 vertex cache), then in clusters so the ones facing out of the mesh, which tend to hide
+    // the others, are drawn first. The vertices are then renumbered in the order the triangles first
+    // use them. The shape is unchanged; meshlets and LODs are dropped, so build them afterwards.
+    void OptimizeTriangleOrder();
+
+    // Divides the triangles into meshlets of at most maxTriangles neighboring triangles, listing each
+    // meshlet's in m_meshletTriangles and each triangle's meshlet in m_triangleMeshlets; m_tris keeps
+    // its order. Meant for large meshes, whose meshlets can then be culled before their triangles are
+    // looked at; any change to the triangles afterwards needs the meshlets built again.
+    void BuildMeshlets(unsigned int maxTriangles = 64);
+
+    // Fills m_lods with up to maxLevels simplified versions of the triangles (see SimplifyMesh), each
+    // with about half the triangles of the one before, stopping before one would have fewer than
+    // minTriangles. The vertices are renumbered so the ones a coarser LOD uses come first, and the
+    // rasterizer only transforms those when it draws it.
+    void BuildLODs(unsigned int maxLevels = 4, unsigned int minTriangles = 256);
 
     // Various getter, setter, and adder functions
     void AddVertex(const Vertex&);
@@ -89,10 +198,30 @@ public:
     Triangle& TriAt(unsigned int);
     Triangle TriAt(unsigned int) const;
 
+    // The non-const version may only be used on a polygon that has not been packed
     Vertex& VertAt(unsigned int);
+    // Decodes the vertex if the polygon has been packed
     Vertex VertAt(unsigned int) const;
+
+    // Replaces m_verts with its compact quantized form (see PackedVertex),
+    // freeing the full-precision vertices
+    void Pack();
+    bool IsPacked() const;
+    // The number of vertices, whether or not the polygon has been packed
+    unsigned int VertexCount() const;
+
+    // Returns a sphere enclosing every vertex of this polygon,
+    // with the center in xyz and the radius in w
+    glm::vec4 BoundingSphere() const;
+
+    // Returns the smallest axis-aligned box enclosing every vertex of this polygon
+    AxisAlignedBox BoundingBox3D() const;
 };
 
 // Returns the color of the pixel in the image at the specified texture coordinates.
 // Returns white if the image is a null pointer
 glm::vec3 GetImageColor(const glm::vec2 &uv_coord, const QImage* const image);
+
+// Numbers every position by the first of the positions equal to it, so vertices a mesh splits
+// where normals or UVs differ can be matched up again
+std::vector<unsigned int> FirstAtSamePosition(const std::vector<glm::vec3>& positions);
@@ -0,0 +1,292 @@
+#include "postprocess.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <thread>
+#include <glm/glm.hpp>
+
+//rows each thread takes at a time
+static const int BAND_ROWS = 32;
+
+//FXAA walks along an edge in steps that grow with the distance covered, up to this many pixels
+static const int EDGE_STEPS[] = {1, 1, 1, 1, 1, 2, 2, 2, 2, 4, 8};
+static const int EDGE_STEP_COUNT = sizeof(EDGE_STEPS) / sizeof(EDGE_STEPS[0]);
+//how far an edge is assumed to go on when its end is not found
+static const int EDGE_GUESS = 8;
+
+//perceived brightness of a color, from 0 to 1
+static inline float Luma(QRgb c)
+{
+    return (0.299f * qRed(c) + 0.587f * qGreen(c) + 0.114f * qBlue(c)) * (1.0f / 255.0f);
+}
+
+//luma of one row of pixels, in a loop the compiler can vectorize
+static void RowLuma(const QRgb* row, int width, float* luma)
+{
+    for(int x = 0; x < width; x++)
+    {
+        luma[x] = Luma(row[x]);
+    }
+}
+
+//whether each pixel of a row stands out enough from its four neighbors to be looked at, again
+//in a branch-free loop; the first and last pixels repeat themselves as their outer neighbors
+static void RowContrast(const float* above, const float* center, const float* below, int width,
+                        float contrastThreshold, float relativeThreshold, unsigned char* flags)
+{
+    for(int x = 0; x < width; x++)
+    {
+        float w = center[x > 0 ? x - 1 : 0], e = center[x < width - 1 ? x + 1 : x];
+        float highest = std::max(std::max(std::max(center[x], above[x]), std::max(below[x], w)), e);
+        float lowest = std::min(std::min(std::min(center[x], above[x]), std::min(below[x], w)), e);
+        flags[x] = highest - lowest >= std::max(contrastThreshold, relativeThreshold * highest);
+    }
+}
+
+static inline QRgb Lerp(QRgb a, QRgb b, float t)
+{
+    return qRgb(static_cast<int>(qRed(a) + (qRed(b) - qRed(a)) * t + 0.5f),
+                static_cast<int>(qGreen(a) + (qGreen(b) - qGreen(a)) * t + 0.5f),
+                static_cast<int>(qBlue(a) + (qBlue(b) - qBlue(a)) * t + 0.5f));
+}
+
+FXAAPass::FXAAPass(float contrastThreshold, float relativeThreshold, float subpixel)
+    : m_contrastThreshold(contrastThreshold), m_relativeThreshold(relativeThreshold), m_subpixel(subpixel)
+{}
+
+void FXAAPass::Apply(const QRgb* source, QRgb* destination, int width, int height, int top, int bottom) const
+{
+    auto pixel = [&](int x, int y) -> QRgb {
+        return source[std::min(std::max(y, 0), height - 1) * width + std::min(std::max(x, 0), width - 1)];
+    };
+
+    //luma of the rows above, at and below the one being filtered, rolled down as it moves
+    std::vector<float> lumaRows(3 * width);
+    float* above = lumaRows.data();
+    float* center = above + width;
+    float* below = center + width;
+    std::vector<unsigned char> edgeFlags(width);
+    RowLuma(source + std::max(top - 1, 0) * width, width, above);
+    RowLuma(source + top * width, width, center);
+
+    for(int y = top; y < bottom; y++)
+    {
+        RowLuma(source + std::min(y + 1, height - 1) * width, width, below);
+        RowContrast(above, center, below, width, m_contrastThreshold, m_relativeThreshold, edgeFlags.data());
+        const QRgb* in = source + y * width;
+        QRgb* out = destination + y * width;
+        //flat areas, which are most of the image, stay as they are
+        std::copy(in, in + width, out);
+        for(int x = 0; x < width; x++)
+        {
+            if(!edgeFlags[x])
+            {
+                continue;
+            }
+            int left = std::max(x - 1, 0), right = std::min(x + 1, width - 1);
+            float m = center[x], n = above[x], s = below[x], w = center[left], e = center[right];
+            float contrast = std::max({m, n, s, w, e}) - std::min({m, n, s, w, e});
+            float ne = above[right], nw = above[left], se = below[right], sw = below[left];
+
+            //subpixel blend: how much the pixel stands out from the average of its neighborhood
+            float average = (2.0f * (n + e + s + w) + ne + nw + se + sw) * (1.0f / 12.0f);
+            float standOut = std::min(std::abs(average - m) / contrast, 1.0f);
+            standOut = standOut * standOut * (3.0f - 2.0f * standOut);
+            float subpixelBlend = standOut * standOut * m_subpixel;
+
+            //whether the edge runs along the row or down the column, from which way luma changes more
+            float horizontal = 2.0f * std::abs(n + s - 2.0f * m) + std::abs(ne + se - 2.0f * e) + std::abs(nw + sw - 2.0f * w);
+            float vertical = 2.0f * std::abs(e + w - 2.0f * m) + std::abs(ne + nw - 2.0f * n) + std::abs(se + sw - 2.0f * s);
+            bool alongRow = horizontal >= vertical;
+            //the neighbor across the edge is on the side luma changes more
+            float positive = alongRow ? s : e, negative = alongRow ? n : w;
+            float positiveGradient = std::abs(positive - m), negativeGradient = std::abs(negative - m);
+            int across = positiveGradient >= negativeGradient ? 1 : -1;
+            float edgeLuma = 0.5f * (m + (across > 0 ? positive : negative));
+            float gradientThreshold = 0.25f * std::max(positiveGradient, negativeGradient);
+            int acrossX = alongRow ? 0 : across, acrossY = alongRow ? across : 0;
+            int alongX = alongRow ? 1 : 0, alongY = alongRow ? 0 : 1;
+
+            //follow the edge both ways until the luma between the two sides no longer matches it
+            int distances[2];
+            float endDeltas[2];
+            for(int direction = 0; direction < 2; direction++)
+            {
+                int sign = direction == 0 ? 1 : -1;
+                int distance = 0;
+                float delta = 0.0f;
+                bool found = false;
+                for(int i = 0; i < EDGE_STEP_COUNT && !found; i++)
+                {
+                    distance += EDGE_STEPS[i];
+                    int px = x + sign * distance * alongX, py = y + sign * distance * alongY;
+                    delta = 0.5f * (Luma(pixel(px, py)) + Luma(pixel(px + acrossX, py + acrossY))) - edgeLuma;
+                    found = std::abs(delta) >= gradientThreshold;
+                }
+                distances[direction] = found ? distance : distance + EDGE_GUESS;
+                endDeltas[direction] = delta;
+            }
+            //only the nearer end decides, and only if the edge bends away from this pixel's side there
+            int nearer = distances[0] <= distances[1] ? 0 : 1;
+            float edgeBlend = 0.0f;
+            if((endDeltas[nearer] >= 0.0f) != (m - edgeLuma >= 0.0f))
+            {
+                edgeBlend = 0.5f - static_cast<float>(distances[nearer]) / (distances[0] + distances[1]);
+            }
+
+            out[x] = Lerp(in[x], pixel(x + acrossX, y + acrossY), std::max(subpixelBlend, edgeBlend));
+        }
+        std::swap(above, center);
+        std::swap(center, below);
+    }
+}
+
+SharpenPass::SharpenPass(float amount)
+    : m_weight(static_cast<int>(std::lround(std::max(amount, 0.0f) * 256.0f)))
+{}
+
+//one channel of c + amount * (c - neighbor average), in fixed point with amount = k / 256
+static inline glm::uint SharpenChannel(glm::uint c, glm::uint l, glm::uint r, glm::uint u, glm::uint d, int shift, int k)
+{
+    int center = (c >> shift) & 0xff;
+    int neighbors = ((l >> shift) & 0xff) + ((r >> shift) & 0xff) + ((u >> shift) & 0xff) + ((d >> shift) & 0xff);
+    int value = (center * (1024 + 4 * k) - neighbors * k + 512) >> 10;
+    return static_cast<glm::uint>(std::min(std::max(value, 0), 255)) << shift;
+}
+
+static inline QRgb SharpenPixel(QRgb c, QRgb l, QRgb r, QRgb u, QRgb d, int k)
+{
+    return 0xff000000u | SharpenChannel(c, l, r, u, d, 16, k) | SharpenChannel(c, l, r, u, d, 8, k) | SharpenChannel(c, l, r, u, d, 0, k);
+}
+
+void SharpenPass::Apply(const QRgb* source, QRgb* destination, int width, int height, int top, int bottom) const
+{
+    int k = m_weight;
+    for(int y = top; y < bottom; y++)
+    {
+        const QRgb* in = source + y * width;
+        const QRgb* up = source + std::max(y - 1, 0) * width;
+        const QRgb* down = source + std::min(y + 1, height - 1) * width;
+        QRgb* out = destination + y * width;
+        //the first and last pixels repeat themselves as their outer neighbors, so the pixels
+        //between them run in a loop without branches the compiler can vectorize
+        out[0] = SharpenPixel(in[0], in[0], in[std::min(1, width - 1)], up[0], down[0], k);
+        for(int x = 1; x < width - 1; x++)
+        {
+            out[x] = SharpenPixel(in[x], in[x - 1], in[x + 1], up[x], down[x], k);
+        }
+        if(width > 1)
+        {
+            out[width - 1] = SharpenPixel(in[width - 1], in[width - 2], in[width - 1], up[width - 1], down[width - 1], k);
+        }
+    }
+}
+
+GammaPass::GammaPass(float gamma)
+{
+    for(int i = 0; i < 256; i++)
+    {
+        m_table[i] = static_cast<unsigned char>(std::lround(255.0f * std::pow(i / 255.0f, 1.0f / gamma)));
+    }
+}
+
+void GammaPass::Apply(const QRgb* source, QRgb* destination, int width, int, int top, int bottom) const
+{
+    for(int i = top * width; i < bottom * width; i++)
+    {
+        QRgb c = source[i];
+        destination[i] = qRgb(m_table[qRed(c)], m_table[qGreen(c)], m_table[qBlue(c)]);
+    }
+}
+
+PostProcessChain::PostProcessChain()
+    : m_passes(), m_threadCount(0)
+{}
+
+void PostProcessChain::Add(std::shared_ptr<const PostProcessPass> pass)
+{
+    if(pass)
+    {
+        m_passes.push_back(std::move(pass));
+    }
+}
+
+void PostProcessChain::Clear()
+{
+    m_passes.clear();
+}
+
+bool PostProcessChain::Empty() const
+{
+    return m_passes.empty();
+}
+
+void PostProcessChain::SetThreadCount(unsigned int threads)
+{
+    m_threadCount = threads;
+}
+
+void PostProcessChain::Run(QImage& image, QImage& scratch) const
+{
+    if(m_passes.empty() || image.isNull())
+    {
+        return;
+    }
+    int width = image.width(), height = image.height();
+    int bands = (height + BAND_ROWS - 1) / BAND_ROWS;
+    unsigned int threadCount = m_threadCount == 0 ? std::max(1u, std::thread::hardware_concurrency()) : m_threadCount;
+    threadCount = std::min(threadCount, static_cast<unsigned int>(bands));
+
+    //each stage is one pass that reads neighbors (or none at the start of the chain), and the
+    //pointwise passes after it, all run on one band before the next
+    size_t next = 0;
+    while(next < m_passes.size())
+    {
+        const PostProcessPass* filter = m_passes[next]->Pointwise() ? nullptr : m_passes[next++].get();
+        size_t pointwiseStart = next;
+        while(next < m_passes.size() && m_passes[next]->Pointwise())
+        {
+            next++;
+        }
+        size_t pointwiseEnd = next;
+
+        if(filter && (scratch.width() != width || scratch.height() != height || scratch.format() != QImage::Format_RGB32))
+        {
+            scratch = QImage(width, height, QImage::Format_RGB32);
+        }
+        const QRgb* source = reinterpret_cast<const QRgb*>(image.constBits());
+        QRgb* destination = reinterpret_cast<QRgb*>(filter ? scratch.bits() : image.bits());
+
+        std::atomic<int> nextBand(0);
+        auto work = [&]() {
+            for(int band = nextBand++; band < bands; band = nextBand++)
+            {
+                int top = band * BAND_ROWS, bottom = std::min(top + BAND_ROWS, height);
+                if(filter)
+                {
+                    filter->Apply(source, destination, width, height, top, bottom);
+                }
+                for(size_t i = pointwiseStart; i < pointwiseEnd; i++)
+                {
+                    m_passes[i]->Apply(destination, destination, width, height, top, bottom);
+                }
+            }
+        };
+        std::vector<std::thread> threads;
+        for(unsigned int t = 1; t < threadCount; t++)
+        {
+            threads.emplace_back(work);
+        }
+        work();
+        for(std::thread& thread : threads)
+        {
+            thread.join();
+        }
+
+        //the filtered frame takes the place of the one it was read from
+        if(filter)
+        {
+            image.swap(scratch);
+        }
+    }
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include <QImage>
+#include <memory>
+#include <vector>
+
+// One full-screen filter run over a finished frame (see PostProcessChain).
+// Passes are given the frame as rows of QRgb, width pixels each, laid end to end as in a
+// Format_RGB32 QImage. A pass is never modified while it runs, and runs on several bands of rows
+// at once, so one pass object can be shared by any number of chains and threads.
+class PostProcessPass
+{
+public:
+    virtual ~PostProcessPass() {}
+
+    // Whether each output pixel depends on nothing but the same pixel of the input. Such passes
+    // (tone mapping, gamma) run in place; the others read the frame and write a second buffer.
+    virtual bool Pointwise() const = 0;
+
+    // Filters rows top to bottom - 1 of a width x height frame from source into destination.
+    // For a pointwise pass the two are the same buffer; otherwise source may be read anywhere.
+    virtual void Apply(const QRgb* source, QRgb* destination, int width, int height, int top, int bottom) const = 0;
+};
+
+// Fast approximate anti-aliasing: finds the edges of the finished image by their contrast in luma,
+// follows each edge to its ends to work out how far along a stair step a pixel is, and blends the
+// pixel with its neighbor across the edge by that much. A fraction of the cost of multisampling,
+// at the price of also softening some texture detail.
+class FXAAPass : public PostProcessPass
+{
+public:
+    // Pixels whose neighborhood's luma range (from 0 to 1) is below both the absolute threshold and
+    // the relative one times the brightest luma are left alone. subpixel (0 to 1) is how strongly
+    // pixels finer than an edge (single bright or dark pixels) are smoothed.
+    explicit FXAAPass(float contrastThreshold = 0.0312f, float relativeThreshold = 0.125f, float subpixel = 0.75f);
+
+    bool Pointwise() const override { return false; }
+    void Apply(const QRgb* source, QRgb* destination, int width, int height, int top, int bottom) const override;
+
+private:
+    float m_contrastThreshold;
+    float m_relativeThreshold;
+    float m_subpixel;
+};
+
+// Sharpens the image with an unsharp mask over each pixel's four neighbors, e.g. to restore some
+// crispness after FXAA or upscaling
+class SharpenPass : public PostProcessPass
+{
+public:
+    // amount 0 leaves the image unchanged; 1 adds the full difference from the neighbors' average
+    explicit SharpenPass(float amount = 0.25f);
+
+    bool Pointwise() const override { return false; }
+    void Apply(const QRgb* source, QRgb* destination, int width, int height, int top, int bottom) const override;
+
+private:
+    // amount in 1/256ths, so the filter runs on integers
+    int m_weight;
+};
+
+// Raises every channel to the power 1 / gamma, through a table worked out once
+class GammaPass : public PostProcessPass
+{
+public:
+    explicit GammaPass(float gamma = 2.2f);
+
+    bool Pointwise() const override { return true; }
+    void Apply(const QRgb* source, QRgb* destination, int width, int height, int top, int bottom) const override;
+
+private:
+    unsigned char m_table[256];
+};
+
+// A sequence of PostProcessPasses run one after another over a frame, each on the output of the
+// one before. The frame is split into bands of rows filtered on several threads.
+//
+// Pointwise passes run on each band straight after the pass before them, while it is still in
+// cache, rather than going over the whole frame again. A pass that reads neighboring pixels writes
+// into a second buffer, which then takes the frame's place, so no pass ever copies the image.
+class PostProcessChain
+{
+public:
+    PostProcessChain();
+
+    void Add(std::shared_ptr<const PostProcessPass> pass);
+    void Clear();
+    bool Empty() const;
+
+    // Sets the number of threads the bands are split across (0, the default, means one per core)
+    void SetThreadCount(unsigned int threads);
+
+    // Runs every pass over image, a Format_RGB32 QImage. scratch is the second buffer passes that
+    // read neighbors write into; it is (re)allocated as needed and may be swapped with image, so it
+    // should be kept from one frame to the next. Pixels past the edges of image repeat its edges.
+    void Run(QImage& image, QImage& scratch) const;
+
+private:
+    std::vector<std::shared_ptr<const PostProcessPass>> m_passes;
+    unsigned int m_threadCount;
+};
@@ -0,0 +1,53 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <framearena.h>
+
+// Sorts values by their unsigned integer keys, smallest key first, keeping values with equal keys
+// in the order they were given. This is a least significant digit radix sort: one counting pass per
+// byte of the key, so it takes time linear in the count rather than n log n comparisons, and a byte
+// that is the same in every key (e.g. the top byte of small keys) is skipped without moving anything.
+// keys and values are both reordered; the buffers they move through come from the arena.
+template <typename Key, typename Value>
+void RadixSortByKey(Key* keys, Value* values, size_t count, Arena& arena) {
+    if (count < 2) {
+        return;
+    }
+    FrameVector<Key> keyScratch(count, Key(), ArenaAllocator<Key>(arena));
+    FrameVector<Value> valueScratch(count, Value(), ArenaAllocator<Value>(arena));
+    Key* keysIn = keys;
+    Value* valuesIn = values;
+    Key* keysOut = keyScratch.data();
+    Value* valuesOut = valueScratch.data();
+
+    for (unsigned int shift = 0; shift < 8 * sizeof(Key); shift += 8) {
+        size_t counts[256] = {};
+        for (size_t i = 0; i < count; i++) {
+            counts[(keysIn[i] >> shift) & 0xff]++;
+        }
+        if (counts[(keysIn[0] >> shift) & 0xff] == count) {
+            continue;
+        }
+        //each digit's first position in the output
+        size_t start = 0;
+        for (size_t& c : counts) {
+            size_t digitCount = c;
+            c = start;
+            start += digitCount;
+        }
+        for (size_t i = 0; i < count; i++) {
+            size_t position = counts[(keysIn[i] >> shift) & 0xff]++;
+            keysOut[position] = keysIn[i];
+            valuesOut[position] = valuesIn[i];
+        }
+        std::swap(keysIn, keysOut);
+        std::swap(valuesIn, valuesOut);
+    }
+
+    //after an odd number of passes the sorted order is in the scratch buffers
+    if (keysIn != keys) {
+        std::copy(keysIn, keysIn + count, keys);
+        std::copy(valuesIn, valuesIn + count, values);
+    }
+}
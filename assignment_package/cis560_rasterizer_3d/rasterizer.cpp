@@ -5,52 +5,485 @@
 #include <iostream>
 
 #include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <type_traits>
 
 #include "segment.h"
 #include "camera.h"
+#include "frustum.h"
+#include "hizbuffer.h"
+#include "multisample.h"
+#include "occlusionbuffer.h"
+#include "radixsort.h"
+#include "upscaler.h"
+
+//Occluders are picked automatically when a scene flags none: up to this many instances, each
+//covering at least this fraction of the region, and cheap enough to draw a second time
+static const unsigned int MAX_AUTO_OCCLUDERS = 8;
+static const float MIN_AUTO_OCCLUDER_COVERAGE = 1.0f / 16.0f;
+static const size_t MAX_AUTO_OCCLUDER_TRIANGLES = 4096;
+//Triangles of Polygons without meshlets are sorted front to back in runs of this many consecutive ones
+static const unsigned int TRIANGLE_CLUSTER_SIZE = 64;
+//Triangles less than this many pixels across both ways cross at most this many pixel rows, and
+//cover at most one more pixel than this on each. They skip the scanline setup (see RowCrossings)
+static const int SMALL_TRIANGLE_SIZE = 2;
+static const int MAX_SMALL_TRIANGLE_PIXELS = SMALL_TRIANGLE_SIZE * (SMALL_TRIANGLE_SIZE + 1);
+//A point or spot light closer than this to a surface has no direction to light it from, and lights none of it
+static const float MIN_LIGHT_DISTANCE_SQUARED = 1e-12f;
+
+// Widens [*xLeft, *xRight] to take in every point where the pixel row at y crosses an edge of the
+// triangle (v1, v2, v3), each found exactly as Segment::getIntersection would, so the pixels between
+// are the same ones the scanline loop draws
+static void RowCrossings(const glm::vec4& v1, const glm::vec4& v2, const glm::vec4& v3, int y, float* xLeft, float* xRight)
+{
+    const glm::vec4* corners[3] = {&v1, &v2, &v3};
+    for (int i = 0; i < 3; i++) {
+        const glm::vec4& a = *corners[i];
+        const glm::vec4& b = *corners[(i + 1) % 3];
+        if (a.y == b.y || y < std::min(a.y, b.y) || y > std::max(a.y, b.y)) {
+            continue;
+        }
+        float x = a.x == b.x ? a.x : (y - a.y) / ((b.y - a.y) / (b.x - a.x)) + a.x;
+        *xLeft = std::min(*xLeft, x);
+        *xRight = std::max(*xRight, x);
+    }
+}
+
+// Places every Polygon once, untransformed
+static std::vector<Instance> IdentityInstances(const std::vector<Polygon>& polygons)
+{
+    std::vector<Instance> instances;
+    for (unsigned int i = 0; i < polygons.size(); i++) {
+        instances.push_back(Instance(i, glm::mat4(1.0f)));
+    }
+    return instances;
+}
+
+// Reorders items nearest first by their distances (smaller is nearer, one per item), by radix sorting
+// the distances quantized to 16 bits across their own range. Items at about the same distance keep their order.
+static void SortNearestFirst(const float* distances, unsigned int* items, size_t count, Arena& arena)
+{
+    if (count < 2) {
+        return;
+    }
+    float nearest = *std::min_element(distances, distances + count);
+    float farthest = *std::max_element(distances, distances + count);
+    float scale = farthest > nearest ? 65535.0f / (farthest - nearest) : 0.0f;
+    FrameVector<std::uint16_t> keys(count, 0, ArenaAllocator<std::uint16_t>(arena));
+    for (size_t i = 0; i < count; i++) {
+        keys[i] = static_cast<std::uint16_t>((distances[i] - nearest) * scale);
+    }
+    RadixSortByKey(keys.data(), items, count, arena);
+}
+
+// Whether every triangle of the meshlet faces away from a camera at eye, given in the meshlet's own space:
+// whether the eye lies behind the plane of each, for every normal in the meshlet's cone and every point
+// in its bounding sphere. Being a question of which side of a plane the eye is on, the answer holds under
+// any model matrix.
+static bool MeshletFacesAway(const Meshlet& meshlet, const glm::vec3& eye)
+{
+    float cosSpread = meshlet.m_cone.w;
+    if (cosSpread <= 0.0f) {
+        return false;
+    }
+    glm::vec3 axis(meshlet.m_cone);
+    glm::vec3 toCenter = glm::vec3(meshlet.m_bounds) - eye;
+    //the least any normal in the cone points along toCenter, less the sphere's radius
+    float sinSpread = std::sqrt(std::max(1.0f - cosSpread * cosSpread, 0.0f));
+    return glm::dot(toCenter, axis) * cosSpread - glm::length(glm::cross(toCenter, axis)) * sinSpread >= meshlet.m_bounds.w;
+}
+
+// The coarsest of p's LODs whose error, scaled by scale, covers at most threshold pixels at nearest along
+// the view from the camera, where one unit across covers pixelsPerUnit pixels at a distance of one;
+// -1 for p's full detail triangles. Instances reaching past the near plane are always drawn in full.
+static int SelectLOD(const Polygon& p, float nearest, float nearClip, float scale, float pixelsPerUnit, float threshold)
+{
+    if (threshold <= 0.0f || nearest <= nearClip) {
+        return -1;
+    }
+    int level = -1;
+    for (unsigned int i = 0; i < p.m_lods.size(); i++) {
+        if (p.m_lods[i].m_error * scale * pixelsPerUnit / nearest > threshold) {
+            break;
+        }
+        level = i;
+    }
+    return level;
+}
+
+Scene::Scene(const std::vector<Polygon>& polygons, const std::vector<Instance>& instances)
+    : m_polygons(polygons), m_instances(instances), m_polygonBounds(), m_polygonBoxes(), m_worldBounds(0.0f), m_drawOrder()
+{
+    for (const Polygon& p : m_polygons) {
+        m_polygonBounds.push_back(p.BoundingSphere());
+        m_polygonBoxes.push_back(p.BoundingBox3D());
+    }
+
+    //a sphere around the world space box holding every instance's bounding sphere
+    glm::vec3 worldMin(std::numeric_limits<float>::max()), worldMax(-std::numeric_limits<float>::max());
+    for (const Instance& instance : m_instances) {
+        const glm::vec4& bounds = m_polygonBounds[instance.m_polygon];
+        glm::vec3 center(instance.m_model * glm::vec4(glm::vec3(bounds), 1.0f));
+        float scale = std::max({glm::length(glm::vec3(instance.m_model[0])), glm::length(glm::vec3(instance.m_model[1])), glm::length(glm::vec3(instance.m_model[2]))});
+        worldMin = glm::min(worldMin, center - glm::vec3(bounds.w * scale));
+        worldMax = glm::max(worldMax, center + glm::vec3(bounds.w * scale));
+    }
+    if (!m_instances.empty()) {
+        m_worldBounds = glm::vec4((worldMin + worldMax) * 0.5f, glm::length(worldMax - worldMin) * 0.5f);
+    }
+
+    //batch instances by Polygon so each shared vertex buffer is streamed through back to back
+    for (unsigned int i = 0; i < m_instances.size(); i++) {
+        m_drawOrder.push_back(i);
+    }
+    std::stable_sort(m_drawOrder.begin(), m_drawOrder.end(), [this](unsigned int a, unsigned int b) {
+        return m_instances[a].m_polygon < m_instances[b].m_polygon;
+    });
+}
 
 Rasterizer::Rasterizer(const std::vector<Polygon>& polygons)
-    : m_polygons(polygons)
+    : Rasterizer(polygons, IdentityInstances(polygons))
 {}
 
-QImage Rasterizer::RenderScene()
+Rasterizer::Rasterizer(const std::vector<Polygon>& polygons, const std::vector<Instance>& instances)
+    : mp_scene(std::make_shared<const Scene>(polygons, instances)), m_camera(), m_width(512), m_height(512), m_aovFlags(AOV_NONE), m_aovs(),
+      m_depthFormat(DepthFormat::Float32), m_sampleCount(1), m_occlusionCulling(true), m_drawSorting(DrawSorting::None), m_backfaceCulling(false), m_lodThreshold(1.0f), m_renderScale(1.0f),
+      m_lights(), m_shadowMaps(), m_frameArena(), m_colorTargets(), m_currentColorTarget(0), m_lowResolutionTarget(),
+      m_postProcess(), m_postProcessTarget()
+{}
+
+int Rasterizer::InstanceLOD(const Instance& instance, const glm::mat4& view, const glm::mat4& projection) const
+{
+    const Polygon& p = mp_scene->m_polygons[instance.m_polygon];
+    if (p.m_lods.empty()) {
+        return -1;
+    }
+    const glm::vec4& bounds = mp_scene->m_polygonBounds[instance.m_polygon];
+    float scale = std::max({glm::length(glm::vec3(instance.m_model[0])), glm::length(glm::vec3(instance.m_model[1])), glm::length(glm::vec3(instance.m_model[2]))});
+    glm::vec4 viewCenter = view * instance.m_model * glm::vec4(glm::vec3(bounds), 1.0f);
+    return SelectLOD(p, viewCenter.z - bounds.w * scale, m_camera.nearClip, scale, 0.5f * m_height * projection[1][1], m_lodThreshold);
+}
+
+FrameVector<Vertex> Rasterizer::TransformVertices(const Polygon& p, unsigned int vertexCount, const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection, int screenWidth, int screenHeight, Arena& arena)
+{
+    glm::mat4 modelView = view * model;
+    //normals move with the inverse transpose so non-uniform scales keep them perpendicular to the surface
+    glm::mat4 normalMatrix = glm::transpose(glm::inverse(model));
+
+    //packed polygons are decoded here, so their full-precision vertices only ever exist in this buffer
+    bool packed = p.IsPacked();
+    FrameVector<Vertex> transformed(vertexCount, Vertex(), ArenaAllocator<Vertex>(arena));
+    for (unsigned int i = 0; i < vertexCount; i++) {
+        const Vertex v = packed ? p.VertAt(i) : p.m_verts[i];
+        Vertex& out = transformed[i];
+        out.m_pos = worldSpaceToScreenSpace(v.m_pos, modelView, projection, screenWidth, screenHeight);
+        out.m_color = v.m_color;
+        //normals go back to unit length, since lambert takes them as they are: a scaled instance
+        //would otherwise light 1/scale times as brightly. Vertices without a normal keep a zero one
+        glm::vec3 normal(normalMatrix * v.m_normal);
+        float length = glm::length(normal);
+        out.m_normal = glm::vec4(length > 0.0f ? normal / length : normal, 0.0f);
+        out.m_uv = v.m_uv;
+    }
+    return transformed;
+}
+
+FrameVector<glm::vec4> Rasterizer::TransformTangents(const Polygon& p, unsigned int vertexCount, const glm::mat4& model, Arena& arena)
+{
+    //tangents lie along the surface, so they move with the model matrix itself. A mirroring
+    //model matrix also mirrors the bitangent relative to cross(normal, tangent)
+    glm::mat3 linear(model);
+    float handedness = glm::determinant(linear) < 0.0f ? -1.0f : 1.0f;
+    FrameVector<glm::vec4> transformed(vertexCount, glm::vec4(0.0f), ArenaAllocator<glm::vec4>(arena));
+    for (unsigned int i = 0; i < vertexCount; i++) {
+        const glm::vec4& t = p.m_tangents[i];
+        transformed[i] = glm::vec4(linear * glm::vec3(t), handedness * t.w);
+    }
+    return transformed;
+}
+
+QImage Rasterizer::RenderScene(const QRect& regionOfInterest)
+{
+    //the pixels of the full frame that are actually drawn; the returned image covers just this region
+    QRect region(0, 0, m_width, m_height);
+    if (!regionOfInterest.isNull()) {
+        region = region.intersected(regionOfInterest);
+    }
+    if (region.isEmpty()) {
+        return QImage();
+    }
+
+    //draw into whichever color buffer the previous frame did not use
+    m_currentColorTarget = 1 - m_currentColorTarget;
+    QImage& result = m_colorTargets[m_currentColorTarget];
+    if (result.width() != region.width() || result.height() != region.height()) {
+        result = QImage(region.width(), region.height(), QImage::Format_RGB32);
+    }
+
+    //all transient data of this frame is allocated from the main thread's arena
+    Arena& arena = m_frameArena.ForThread(0);
+
+    UpdateShadowMaps();
+
+    if (m_renderScale >= 1.0f) {
+        DrawRegion(region, result, arena);
+    } else {
+        //REDUCED RESOLUTION: the frame is drawn exactly as a smaller one of the same view would be,
+        //just the part of it the upscaler reads for the region, then scaled up into the result
+        QSize outputFrame(m_width, m_height);
+        QSize renderFrame(std::max(1, static_cast<int>(std::lround(m_width * m_renderScale))),
+                          std::max(1, static_cast<int>(std::lround(m_height * m_renderScale))));
+        QRect renderRegion = LanczosSourceRegion(region, renderFrame, outputFrame);
+        if (m_lowResolutionTarget.width() != renderRegion.width() || m_lowResolutionTarget.height() != renderRegion.height()) {
+            m_lowResolutionTarget = QImage(renderRegion.width(), renderRegion.height(), QImage::Format_RGB32);
+        }
+        m_width = renderFrame.width();
+        m_height = renderFrame.height();
+        DrawRegion(renderRegion, m_lowResolutionTarget, arena);
+        m_width = outputFrame.width();
+        m_height = outputFrame.height();
+        UpscaleLanczos(m_lowResolutionTarget, renderFrame, result, region, outputFrame, arena);
+    }
+
+    //POST-PROCESSING: may swap the color target for the buffer it filtered into
+    m_postProcess.Run(result, m_postProcessTarget);
+
+    //the frame is finished, so all of its scratch memory can be reused by the next one
+    m_frameArena.Reset();
+    return result;
+}
+
+void Rasterizer::DrawRegion(const QRect& region, QImage& result, Arena& arena)
 {
-    QImage result(512, 512, QImage::Format_RGB32);
     // Fill the image with black pixels.
     // Note that qRgb creates a QColor,
     // and takes in values [0, 255] rather than [0, 1].
 
     result.fill(qRgb(0.f, 0.f, 0.f));
 
+    //the raster loop is compiled once per depth format, with its depth test and clear inlined
+    switch (m_depthFormat) {
+    case DepthFormat::Float32:
+        DrawScene<DepthFloat32>(region, result, arena);
+        break;
+    case DepthFormat::ReversedFloat32:
+        DrawScene<DepthReversedFloat32>(region, result, arena);
+        break;
+    case DepthFormat::Unorm24:
+        DrawScene<DepthUnorm24>(region, result, arena);
+        break;
+    case DepthFormat::Unorm16:
+        DrawScene<DepthUnorm16>(region, result, arena);
+        break;
+    }
+}
+
+template <typename Depth>
+void Rasterizer::DrawScene(const QRect& region, QImage& result, Arena& arena)
+{
+    //AOV buffers are cleared for this frame, and released if they are no longer wanted.
+    //An empty pixel's depth is the z-buffer's clear value when the two are one buffer
+    float emptyDepth = std::is_same<typename Depth::Value, float>::value ? static_cast<float>(Depth::Clear()) : std::numeric_limits<float>::max();
+    m_aovs.Reset(m_aovFlags, m_width, m_height, region, emptyDepth);
+
+    //MSAA: with several samples per pixel, coverage and depth are tested at every sample, and each
+    //sample keeps its own depth and color, but a triangle is still only shaded once per pixel.
+    //The samples of a pixel sit side by side in the z-buffer and sample colors, and the colors
+    //are averaged into the image once everything is drawn
+    const SamplePattern& pattern = SamplePattern::ForCount(m_sampleCount);
+    const int samples = pattern.m_count;
+    FrameVector<QRgb> sampleColors = FrameVector<QRgb>(ArenaAllocator<QRgb>(arena));
+    if (samples > 1) {
+        sampleColors.assign(region.width() * region.height() * samples, qRgb(0, 0, 0));
+    }
+
     //initializing Z buffer to store Z coordinates
-    //dimensions W x H pixels
-    std::array<float, 512 * 512> zBuffer;
-    std::fill(zBuffer.begin(), zBuffer.end(), std::numeric_limits<float>::max());
+    //dimensions W x H pixels of the region being drawn (times the samples per pixel).
+    //When depth is kept as an AOV and the format stores floats, the AOV buffer is the z-buffer, so keeping it costs no copy
+    typedef typename Depth::Value DepthValue;
+    const bool floatDepth = std::is_same<DepthValue, float>::value;
+    FrameVector<DepthValue> frameDepth = FrameVector<DepthValue>(ArenaAllocator<DepthValue>(arena));
+    DepthValue* zBuffer;
+    //other formats write the depth AOV separately, as the float the fragment had before it was encoded
+    //(as do multisampled frames, whose depth AOV is that of each pixel's first sample)
+    float* depthAOV = nullptr;
+    if ((m_aovFlags & AOV_DEPTH) && floatDepth && samples == 1) {
+        //only ever a cast from float* to float*
+        zBuffer = reinterpret_cast<DepthValue*>(m_aovs.m_depth.data());
+    } else {
+        frameDepth.assign(region.width() * region.height() * samples, Depth::Clear());
+        zBuffer = frameDepth.data();
+        depthAOV = (m_aovFlags & AOV_DEPTH) ? m_aovs.m_depth.data() : nullptr;
+    }
+    //coarse depth of every 8x8 tile, for throwing away hidden triangles and tiles before shading them.
+    //Multisampled, a tile is 8 samples wide, and a pixel's samples always share one
+    HiZBuffer<Depth> hiZ(zBuffer, region.width() * samples, region.height(), arena);
+
+    glm::uint* objectIDs = (m_aovFlags & AOV_OBJECT_ID) ? m_aovs.m_objectID.data() : nullptr;
+    glm::uint* triangleIDs = (m_aovFlags & AOV_TRIANGLE_ID) ? m_aovs.m_triangleID.data() : nullptr;
+    bool keepNormals = (m_aovFlags & AOV_NORMAL) != 0;
 
     //CAMERA: view and projection matrices
     glm::mat4 viewMatrix = getCamera().getViewMatrix();
-    glm::mat4 projectionMatrix = getCamera().getProjectionMatrix();
+    glm::mat4 projectionMatrix = Depth::Projection(getCamera());
+
+
+    glm::mat4 viewProjection = projectionMatrix * viewMatrix;
+    //LIGHTS: fragments are lit where they are in the world, found from their pixel and depth,
+    //by the lights binned into their tile of the screen
+    bool useLights = !m_lights.empty();
+    glm::mat4 inverseViewProjection = glm::inverse(viewProjection);
+    LightGrid lightGrid(m_lights, viewProjection, region, m_width, m_height, arena);
+    //without lights, the light at the camera shines the same way on every fragment
+    glm::vec4 cameraLight = glm::normalize(-(m_camera.forward));
+
+    const Scene& scene = *mp_scene;
+
+    //OCCLUSION CULLING: the depth of the frame's large occluders, drawn at low resolution up front
+    OcclusionBuffer<Depth> occlusion(region, m_width, m_height, arena, samples > 1 ? 0.5f : 0.0f);
+    FrameVector<ProjectedBox> screenBoxes = FrameVector<ProjectedBox>(ArenaAllocator<ProjectedBox>(arena));
+    bool occlusionCulling = m_occlusionCulling && DrawOccluders(region, occlusion, screenBoxes, viewMatrix, projectionMatrix, arena);
+
+    //DRAW ORDER: instances nearest the camera first, so the surfaces in front fill the z-buffer and
+    //Hi-Z before the ones they hide, whose triangles and fragments are then rejected rather than shaded
+    FrameVector<unsigned int> drawOrder(scene.m_drawOrder.begin(), scene.m_drawOrder.end(), ArenaAllocator<unsigned int>(arena));
+    if (m_drawSorting != DrawSorting::None) {
+        //the distance along the view to the nearest point of each instance's bounding sphere
+        FrameVector<float> distances(drawOrder.size(), 0.0f, ArenaAllocator<float>(arena));
+        for (unsigned int i = 0; i < drawOrder.size(); i++) {
+            const Instance& instance = scene.m_instances[drawOrder[i]];
+            const glm::vec4& bounds = scene.m_polygonBounds[instance.m_polygon];
+            glm::vec4 center = viewMatrix * instance.m_model * glm::vec4(glm::vec3(bounds), 1.0f);
+            float scale = std::max({glm::length(glm::vec3(instance.m_model[0])), glm::length(glm::vec3(instance.m_model[1])), glm::length(glm::vec3(instance.m_model[2]))});
+            distances[i] = center.z - bounds.w * scale;
+        }
+        SortNearestFirst(distances.data(), drawOrder.data(), drawOrder.size(), arena);
+    }
+    //whether smaller projected z is nearer, which reversed depth turns around
+    const float depthSign = Depth::Passes(Depth::Encode(0.25f), Depth::Encode(0.75f)) ? 1.0f : -1.0f;
+
+    //for each instance of a Polygon P (unsorted, instances of the same Polygon are adjacent in m_drawOrder)
+    for (unsigned int instanceIndex : drawOrder){
+        const Instance& instance = scene.m_instances[instanceIndex];
+        const Polygon& p = scene.m_polygons[instance.m_polygon];
+
+        //skip instances whose bounding sphere is entirely off screen, before touching their vertices
+        Frustum frustum(viewProjection * instance.m_model);
+        const glm::vec4& bounds = scene.m_polygonBounds[instance.m_polygon];
+        if (!frustum.intersectsSphere(glm::vec3(bounds), bounds.w)) {
+            continue;
+        }
+        //and those whose bounding box is entirely behind the occluders
+        if (occlusionCulling && occlusion.Hidden(screenBoxes[instanceIndex])) {
+            continue;
+        }
 
+        //LEVEL OF DETAIL: the coarsest triangles that stay within the threshold in pixels at this
+        //instance's distance, and only the vertices those use
+        int level = InstanceLOD(instance, viewMatrix, projectionMatrix);
+        const std::vector<Triangle>& triangles = level < 0 ? p.m_tris : p.m_lods[level].m_tris;
+        unsigned int vertexCount = level < 0 ? p.VertexCount() : p.m_lods[level].m_vertexCount;
+
+        //**3D Rasterization: CAMERA **
+        //transform every shared vertex once for this instance, rather than once per triangle using it.
+        //The buffer is released as soon as the instance is drawn so the next instance reuses its memory.
+        Arena::Marker instanceStart = arena.Mark();
+        FrameVector<Vertex> transformedVerts = TransformVertices(p, vertexCount, instance.m_model, viewMatrix, projectionMatrix, m_width, m_height, arena);
+        //NORMAL MAPPING: only polygons with both a normal map and tangents to orient it by
+        const NormalMap* normalMap = p.m_tangents.empty() ? nullptr : p.mp_packedNormalMap.get();
+        FrameVector<glm::vec4> transformedTangents = normalMap ? TransformTangents(p, vertexCount, instance.m_model, arena)
+                                                               : FrameVector<glm::vec4>(ArenaAllocator<glm::vec4>(arena));
+
+        //MESHLETS: the triangles left once whole meshlets off screen or facing away are dropped. Only
+        //backface culling or sorting triangles lists them meshlet by meshlet (nearest first when sorting,
+        //or for polygons without meshlets, in runs of consecutive triangles, which share vertices and lie
+        //close together). Otherwise meshlets off screen are only marked, and the rest of the triangles are
+        //drawn in their own order, which decides ties in depth. Meshlets divide the full detail
+        //triangles, so LODs are drawn without them
+        FrameVector<unsigned int> drawList = FrameVector<unsigned int>(ArenaAllocator<unsigned int>(arena));
+        FrameVector<unsigned char> meshletVisible = FrameVector<unsigned char>(ArenaAllocator<unsigned char>(arena));
+        bool listed = false;
+        bool culled = false;
+        bool useMeshlets = m_backfaceCulling || m_drawSorting == DrawSorting::FrontToBackClusters;
+        if (!p.m_meshlets.empty() && level < 0 && !useMeshlets) {
+            meshletVisible.resize(p.m_meshlets.size());
+            for (unsigned int m = 0; m < p.m_meshlets.size(); m++) {
+                const Meshlet& meshlet = p.m_meshlets[m];
+                meshletVisible[m] = frustum.intersectsSphere(glm::vec3(meshlet.m_bounds), meshlet.m_bounds.w);
+                culled = culled || !meshletVisible[m];
+            }
+        } else if (!p.m_meshlets.empty() && level < 0) {
+            listed = true;
+            glm::vec3 eye = glm::vec3(glm::inverse(instance.m_model) * m_camera.position);
+            float scale = std::max({glm::length(glm::vec3(instance.m_model[0])), glm::length(glm::vec3(instance.m_model[1])), glm::length(glm::vec3(instance.m_model[2]))});
+            FrameVector<unsigned int> meshlets = FrameVector<unsigned int>(ArenaAllocator<unsigned int>(arena));
+            FrameVector<float> distances = FrameVector<float>(ArenaAllocator<float>(arena));
+            for (unsigned int m = 0; m < p.m_meshlets.size(); m++) {
+                const Meshlet& meshlet = p.m_meshlets[m];
+                if (!frustum.intersectsSphere(glm::vec3(meshlet.m_bounds), meshlet.m_bounds.w)) {
+                    continue;
+                }
+                if (m_backfaceCulling && MeshletFacesAway(meshlet, eye)) {
+                    continue;
+                }
+                meshlets.push_back(m);
+                if (m_drawSorting == DrawSorting::FrontToBackClusters) {
+                    glm::vec4 center = viewMatrix * instance.m_model * glm::vec4(glm::vec3(meshlet.m_bounds), 1.0f);
+                    distances.push_back(center.z - meshlet.m_bounds.w * scale);
+                }
+            }
+            if (m_drawSorting == DrawSorting::FrontToBackClusters) {
+                SortNearestFirst(distances.data(), meshlets.data(), meshlets.size(), arena);
+            }
+            for (unsigned int m : meshlets) {
+                const Meshlet& meshlet = p.m_meshlets[m];
+                for (unsigned int i = 0; i < meshlet.m_triangleCount; i++) {
+                    drawList.push_back(p.m_meshletTriangles[meshlet.m_firstTriangle + i]);
+                }
+            }
+        } else if (m_drawSorting == DrawSorting::FrontToBackClusters && triangles.size() > TRIANGLE_CLUSTER_SIZE) {
+            listed = true;
+            unsigned int clusterCount = (triangles.size() + TRIANGLE_CLUSTER_SIZE - 1) / TRIANGLE_CLUSTER_SIZE;
+            FrameVector<float> distances(clusterCount, std::numeric_limits<float>::max(), ArenaAllocator<float>(arena));
+            for (unsigned int triangleIndex = 0; triangleIndex < triangles.size(); triangleIndex++) {
+                const Triangle& t = triangles[triangleIndex];
+                float& distance = distances[triangleIndex / TRIANGLE_CLUSTER_SIZE];
+                for (unsigned int corner = 0; corner < 3; corner++) {
+                    distance = std::min(distance, depthSign * transformedVerts[t.m_indices[corner]].m_pos.z);
+                }
+            }
+            FrameVector<unsigned int> clusterOrder(clusterCount, 0, ArenaAllocator<unsigned int>(arena));
+            for (unsigned int c = 0; c < clusterCount; c++) {
+                clusterOrder[c] = c;
+            }
+            SortNearestFirst(distances.data(), clusterOrder.data(), clusterCount, arena);
+            drawList.reserve(triangles.size());
+            for (unsigned int c : clusterOrder) {
+                unsigned int end = std::min<unsigned int>((c + 1) * TRIANGLE_CLUSTER_SIZE, triangles.size());
+                for (unsigned int triangleIndex = c * TRIANGLE_CLUSTER_SIZE; triangleIndex < end; triangleIndex++) {
+                    drawList.push_back(triangleIndex);
+                }
+            }
+        }
+        unsigned int drawCount = listed ? drawList.size() : triangles.size();
 
-    //for each Polygon P
-    for (Polygon p : this->m_polygons){
         //for each Triangle t
-        for (Triangle t :  p.m_tris) {
+        for (unsigned int drawIndex = 0; drawIndex < drawCount; drawIndex++) {
+            unsigned int triangleIndex = listed ? drawList[drawIndex] : drawIndex;
+            if (culled && !meshletVisible[p.m_triangleMeshlets[triangleIndex]]) {
+                continue;
+            }
+            const Triangle& t = triangles[triangleIndex];
             //get vertices of t
             unsigned int vertex_1_index = t.m_indices[0];
             unsigned int vertex_2_index = t.m_indices[1];
             unsigned int vertex_3_index = t.m_indices[2];
 
-
-            Vertex vertex1 = p.m_verts.at(vertex_1_index);
-            Vertex vertex2 = p.m_verts.at(vertex_2_index);
-            Vertex vertex3 = p.m_verts.at(vertex_3_index);
-
-            //**3D Rasterization: CAMERA [UNCOMMENT THE 3 LINES BELOW TO HAVE 2D RASTERIZATION RUN AGAIN] **
-            //transform vertices from world space to camera space
-            vertex1.m_pos = worldSpaceToScreenSpace(vertex1.m_pos, viewMatrix, projectionMatrix, 512, 512);
-            vertex2.m_pos = worldSpaceToScreenSpace(vertex2.m_pos, viewMatrix, projectionMatrix, 512, 512);
-            vertex3.m_pos = worldSpaceToScreenSpace(vertex3.m_pos, viewMatrix, projectionMatrix, 512, 512);
+            Vertex vertex1 = transformedVerts.at(vertex_1_index);
+            Vertex vertex2 = transformedVerts.at(vertex_2_index);
+            Vertex vertex3 = transformedVerts.at(vertex_3_index);
 
             //compute bounding box of T
             BoundingBox bb;
@@ -63,8 +496,217 @@ QImage Rasterizer::RenderScene()
             bb.maxX = std::max({vertex1.m_pos.x, vertex2.m_pos.x, vertex3.m_pos.x});
             bb.maxY = std::max({vertex1.m_pos.y, vertex2.m_pos.y, vertex3.m_pos.y});
 
-            //clamp bounding box to screen
-            bb.ClampToScreen(512, 512);
+            //SMALL TRIANGLES: most of a dense mesh's triangles cover a pixel or two, or none at all when
+            //they fall between pixel rows or columns. Their pixels are picked out directly: a pixel of one
+            //of their (at most two) rows is covered when [x, x + 1) meets the row's crossings, the same
+            //rule the scanlines below follow, so no Segments, clamped box or spans are set up for them.
+            //Those that cover no pixel are dropped before any depth or Hi-Z work
+            bool small = samples == 1 && bb.maxX - bb.minX < SMALL_TRIANGLE_SIZE && bb.maxY - bb.minY < SMALL_TRIANGLE_SIZE;
+            int smallX[MAX_SMALL_TRIANGLE_PIXELS], smallY[MAX_SMALL_TRIANGLE_PIXELS];
+            int smallCount = 0;
+            if (small) {
+                int top = std::max(region.top(), static_cast<int>(std::ceil(bb.minY)));
+                float bottom = std::min(static_cast<float>(region.bottom()), bb.maxY);
+                for (int y = top; y <= bottom; y++) {
+                    float xLeft = m_width;
+                    float xRight = 0;
+                    RowCrossings(vertex1.m_pos, vertex2.m_pos, vertex3.m_pos, y, &xLeft, &xRight);
+                    int first = static_cast<int>(std::max(static_cast<float>(region.left()), xLeft));
+                    int last = static_cast<int>(std::min(static_cast<float>(region.right()), xRight));
+                    for (int x = first; x <= last && smallCount < MAX_SMALL_TRIANGLE_PIXELS; x++) {
+                        smallX[smallCount] = x;
+                        smallY[smallCount] = y;
+                        smallCount++;
+                    }
+                }
+                if (smallCount == 0) {
+                    continue;
+                }
+            }
+
+            //MSAA: samples up to half a pixel from a pixel's point can be covered
+            if (samples > 1) {
+                bb.minX = std::floor(bb.minX - 0.5f);
+                bb.minY = std::floor(bb.minY - 0.5f);
+                bb.maxX += 0.5f;
+                bb.maxY += 0.5f;
+            }
+
+            //clamp bounding box to the region being drawn
+            if (!small) {
+                bb.ClampToRegion(region.left(), region.top(), region.right(), region.bottom());
+            }
+
+            //HI-Z: the nearest and farthest depth any fragment of T can have, widened a little to
+            //cover round-off in interpolating them
+            float minZ = std::min({vertex1.m_pos.z, vertex2.m_pos.z, vertex3.m_pos.z});
+            float maxZ = std::max({vertex1.m_pos.z, vertex2.m_pos.z, vertex3.m_pos.z});
+            float margin = 1e-6f * std::max(std::abs(minZ), std::abs(maxZ));
+            DepthValue lowDepth = Depth::Encode(minZ - margin);
+            DepthValue highDepth = Depth::Encode(maxZ + margin);
+            DepthValue nearestDepth = Depth::Passes(highDepth, lowDepth) ? highDepth : lowDepth;
+            DepthValue farthestDepth = Depth::Passes(highDepth, lowDepth) ? lowDepth : highDepth;
+
+            //skip T if every pixel it could cover already holds something closer.
+            //The pixels are those the scanlines below can reach, relative to the region.
+            //Small triangles test the tiles of their few pixels instead
+            if (!small && hiZ.RectHidden((static_cast<int>(bb.minX) - region.left()) * samples, static_cast<int>(bb.minY) - region.top(),
+                               (static_cast<int>(bb.maxX) - region.left()) * samples + samples - 1, static_cast<int>(bb.maxY) - region.top(), nearestDepth)) {
+                continue;
+            }
+
+            //a fragment's color, worked out only once it is known to be drawn, and the AOVs it leaves
+            auto shadeFragment = [&](int x, int y, glm::vec3& barycentric, float depth, const glm::vec4& normal) -> QRgb {
+                //** UV interpolation **
+                glm::vec2 interpolatedUV = interpolateUV(vertex1.m_uv, vertex2.m_uv, vertex3.m_uv, barycentric);
+                glm::vec3 textureColor = GetImageColor(interpolatedUV, p.mp_texture.get());
+
+                //lighting is only worked out for fragments that are drawn, and so is the normal map's
+                glm::vec4 shadingNormal = normal;
+                if (normalMap) {
+                    glm::vec4 tangent = barycentric.x * transformedTangents[vertex_1_index]
+                                        + barycentric.y * transformedTangents[vertex_2_index]
+                                        + barycentric.z * transformedTangents[vertex_3_index];
+                    shadingNormal = PerturbNormal(normal, tangent, normalMap->Sample(interpolatedUV));
+                }
+                glm::vec3 lambertTextureColor;
+                if (useLights) {
+                    glm::vec4 ndc((2.0f * x) / m_width - 1.0f, 1.0f - (2.0f * y) / m_height, depth, 1.0f);
+                    glm::vec4 world = inverseViewProjection * ndc;
+                    lambertTextureColor = ShadeLights(lightGrid, x, y, glm::vec3(world) / world.w, shadingNormal) * textureColor;
+                } else {
+                    float lambertColor = lambert(cameraLight, shadingNormal);
+
+                    lambertTextureColor = lambertColor * textureColor;
+                }
+                //clamp values
+                return qRgb(glm::clamp(lambertTextureColor.r, 0.0f, 255.0f), glm::clamp(lambertTextureColor.g, 0.0f, 255.0f), glm::clamp(lambertTextureColor.b, 0.0f, 255.0f));
+            };
+            //AOVs share the z-buffer's indexing (per pixel); IDs are offset by one so 0 means nothing was drawn
+            auto writeAOVs = [&](int pixelIndex, float depth, const glm::vec4& normal) {
+                if (depthAOV) {
+                    depthAOV[pixelIndex] = depth;
+                }
+                if (objectIDs) {
+                    objectIDs[pixelIndex] = instanceIndex + 1;
+                }
+                if (triangleIDs) {
+                    triangleIDs[pixelIndex] = triangleIndex + 1;
+                }
+                if (keepNormals && normal != glm::vec4(0.0f)) {
+                    glm::vec3 unitNormal = glm::normalize(glm::vec3(normal));
+                    m_aovs.m_normalX[pixelIndex] = unitNormal.x;
+                    m_aovs.m_normalY[pixelIndex] = unitNormal.y;
+                    m_aovs.m_normalZ[pixelIndex] = unitNormal.z;
+                }
+            };
+
+            //SMALL TRIANGLES: the depth test and shading of the scanlines below, for each pixel found above
+            if (small) {
+                for (int i = 0; i < smallCount; i++) {
+                    int x = smallX[i];
+                    int y = smallY[i];
+                    int tile = hiZ.TileAt(x - region.left(), y - region.top());
+                    if (hiZ.TileHidden(tile, nearestDepth)) {
+                        continue;
+                    }
+                    glm::vec4 point = glm::vec4(x, y, 0, 0);
+                    glm::vec3 barycentricinterpolation = BarycentricInterpolation3D(vertex1.m_pos, vertex2.m_pos, vertex3.m_pos, point);
+                    int zBufferIndex = (x - region.left()) + region.width() * (y - region.top());
+                    float interpolatedDepth = barycentricinterpolation.x * vertex1.m_pos.z
+                                              + barycentricinterpolation.y * vertex2.m_pos.z
+                                              + barycentricinterpolation.z * vertex3.m_pos.z;
+                    DepthValue encodedDepth = Depth::Encode(interpolatedDepth);
+                    if (hiZ.TileExposed(tile, farthestDepth) || Depth::Passes(encodedDepth, zBuffer[zBufferIndex])) {
+                        hiZ.Written(tile, x - region.left(), y - region.top(), zBuffer[zBufferIndex], encodedDepth);
+                        zBuffer[zBufferIndex] = encodedDepth;
+                        glm::vec4 normal = interpolateNormals(vertex1.m_normal, vertex2.m_normal, vertex3.m_normal, barycentricinterpolation);
+                        result.setPixel(x - region.left(), y - region.top(), shadeFragment(x, y, barycentricinterpolation, interpolatedDepth, normal));
+                        writeAOVs(zBufferIndex, interpolatedDepth, normal);
+                    }
+                }
+                continue;
+            }
+
+            if (samples > 1) {
+                //MSAA: coverage and depth at every sample of a pixel, one shading for the samples T wins
+                TriangleCoverage coverage(vertex1.m_pos, vertex2.m_pos, vertex3.m_pos);
+                if (!coverage.Valid()) {
+                    continue;
+                }
+                for (int y = bb.minY; y <= bb.maxY; y++) {
+                    int xMin, xMax;
+                    if (!coverage.RowSpan(y, &xMin, &xMax)) {
+                        continue;
+                    }
+                    xMin = std::max(xMin, region.left());
+                    xMax = std::min(xMax, region.right());
+                    for (int x = xMin; x <= xMax; x++) {
+                        int column = (x - region.left()) * samples;
+                        int tile = hiZ.TileAt(column, y - region.top());
+                        if (hiZ.TileHidden(tile, nearestDepth)) {
+                            continue;
+                        }
+                        unsigned int covered = coverage.Mask(x, y, pattern);
+                        if (covered == 0) {
+                            continue;
+                        }
+                        bool tileExposed = hiZ.TileExposed(tile, farthestDepth);
+                        int pixelIndex = (x - region.left()) + region.width() * (y - region.top());
+                        DepthValue* sampleDepth = zBuffer + pixelIndex * samples;
+                        unsigned int drawn = 0;
+                        float firstDepth = 0.0f;
+                        for (int s = 0; s < samples; s++) {
+                            if (!(covered & (1u << s))) {
+                                continue;
+                            }
+                            float depth = coverage.DepthAt(x + pattern.m_offsets[s].x, y + pattern.m_offsets[s].y);
+                            DepthValue encodedDepth = Depth::Encode(depth);
+                            if (tileExposed || Depth::Passes(encodedDepth, sampleDepth[s])) {
+                                hiZ.Written(tile, column + s, y - region.top(), sampleDepth[s], encodedDepth);
+                                sampleDepth[s] = encodedDepth;
+                                drawn |= 1u << s;
+                                firstDepth = s == 0 ? depth : firstDepth;
+                            }
+                        }
+                        if (drawn == 0) {
+                            continue;
+                        }
+
+                        //shaded where the pixel is inside T: its own point when fully covered (as
+                        //without MSAA), otherwise the middle of the samples T covers
+                        glm::vec4 point(x, y, 0, 0);
+                        if (covered != (1u << samples) - 1) {
+                            glm::vec2 center(0.0f);
+                            int count = 0;
+                            for (int s = 0; s < samples; s++) {
+                                if (covered & (1u << s)) {
+                                    center += pattern.m_offsets[s];
+                                    count++;
+                                }
+                            }
+                            point += glm::vec4(center / static_cast<float>(count), 0, 0);
+                        }
+                        glm::vec3 barycentricinterpolation = BarycentricInterpolation3D(vertex1.m_pos, vertex2.m_pos, vertex3.m_pos, point);
+                        float interpolatedDepth = barycentricinterpolation.x * vertex1.m_pos.z
+                                                  + barycentricinterpolation.y * vertex2.m_pos.z
+                                                  + barycentricinterpolation.z * vertex3.m_pos.z;
+                        glm::vec4 normal = interpolateNormals(vertex1.m_normal, vertex2.m_normal, vertex3.m_normal, barycentricinterpolation);
+                        QRgb color = shadeFragment(x, y, barycentricinterpolation, interpolatedDepth, normal);
+                        QRgb* colors = sampleColors.data() + pixelIndex * samples;
+                        for (int s = 0; s < samples; s++) {
+                            if (drawn & (1u << s)) {
+                                colors[s] = color;
+                            }
+                        }
+                        //the AOVs are those of whatever is drawn at the first sample
+                        if (drawn & 1u) {
+                            writeAOVs(pixelIndex, firstDepth, normal);
+                        }
+                    }
+                }
+                continue;
+            }
 
             //array of Segments representing 3 edges of triangle
             std::array<Segment, 3> segments = {
@@ -76,7 +718,7 @@ QImage Rasterizer::RenderScene()
             //iterate over y coordinates within bounding box (these are our pixel rows)
             for (int y = bb.minY; y <= bb.maxY; y++){
 
-                float xLeft = 512; //initialized to screenwidth
+                float xLeft = m_width; //initialized to screenwidth
                 float xRight = 0; //initialized to minimum screen
 
                 //iterate over a collection of line segments
@@ -98,14 +740,27 @@ QImage Rasterizer::RenderScene()
                         xRight = std::max(xRight, xIntersection);
                     }
                 }
-                //double check that values are not being drawn out of screen size of 512x512
-                //limit is (0, 512)
-                xLeft = std::max(0.0f, xLeft);
-                xRight = std::min(511.0f, xRight);
+                //double check that values are not being drawn outside of the region
+                xLeft = std::max(static_cast<float>(region.left()), xLeft);
+                xRight = std::min(static_cast<float>(region.right()), xRight);
 
                 //drawing pixels for particular row
+                int tile = 0;
+                bool tileExposed = false;
                 for (int x = static_cast<int>(xLeft); x <= static_cast<int>(xRight); x++){
 
+                    //HI-Z: on entering a tile, skip the rest of its row if it hides T, and note if T
+                    //is in front of everything in it, which makes the depth test below a sure pass
+                    int tileX = (x - region.left()) & (HiZBuffer<Depth>::TILE_SIZE - 1);
+                    if (tileX == 0 || x == static_cast<int>(xLeft)) {
+                        tile = hiZ.TileAt(x - region.left(), y - region.top());
+                        if (hiZ.TileHidden(tile, nearestDepth)) {
+                            x += HiZBuffer<Depth>::TILE_SIZE - 1 - tileX;
+                            continue;
+                        }
+                        tileExposed = hiZ.TileExposed(tile, farthestDepth);
+                    }
+
                     glm::vec4 point = glm::vec4(x, y, 0, 0);
 
                     //** 2D barycentric interpolation; UNCOMMENT for 2D RASTERIZATION **
@@ -118,48 +773,221 @@ QImage Rasterizer::RenderScene()
                     //interpolate color (used for 2D RASTERIZATION)
                     glm::vec3 colorinterpolation = interpolateColor(vertex1.m_color, vertex2.m_color, vertex3.m_color, barycentricinterpolation);
 
-                    //check Z values; access the element corresponding to (x, y) as array[x + W * y] for 2D
-                    int zBufferIndex = x + 512 * y;
+                    //check Z values; access the element corresponding to (x, y) as array[x + W * y] for 2D,
+                    //relative to the corner of the region
+                    int zBufferIndex = (x - region.left()) + region.width() * (y - region.top());
 
                     //calculate depth
                     float interpolatedDepth = barycentricinterpolation.x * vertex1.m_pos.z
                                               + barycentricinterpolation.y * vertex2.m_pos.z
                                               + barycentricinterpolation.z * vertex3.m_pos.z;
 
-                    //** UV interpolation **
-                    glm::vec2 uv1 = vertex1.m_uv;
-                    glm::vec2 uv2 = vertex2.m_uv;
-                    glm::vec2 uv3 = vertex3.m_uv;
-                    glm::vec2 interpolatedUV = interpolateUV(uv1, uv2, uv3, barycentricinterpolation);
-                    glm::vec3 textureColor = GetImageColor(interpolatedUV, p.mp_texture);
-
-                    //** LAMBERT **
-                    // Normal interpolation
-                    glm::vec4 normal = interpolateNormals(vertex1.m_normal, vertex2.m_normal, vertex3.m_normal, barycentricinterpolation);
+                    //use the color of the fragment closest to the camera
+                    DepthValue encodedDepth = Depth::Encode(interpolatedDepth);
+                    if (tileExposed || Depth::Passes(encodedDepth, zBuffer[zBufferIndex])){
+                        hiZ.Written(tile, x - region.left(), y - region.top(), zBuffer[zBufferIndex], encodedDepth);
+                        zBuffer[zBufferIndex] = encodedDepth;
 
-                    float lambertColor = lambert(m_camera, normal);
-
-                    glm::vec3 lambertTextureColor = lambertColor * textureColor;
-
-                    //use the color of the fragment with the smallest Z-coordinate
-                    if (interpolatedDepth < zBuffer[zBufferIndex]){
-                        zBuffer[zBufferIndex] = interpolatedDepth;
+                        //** LAMBERT **
+                        // Normal interpolation
+                        glm::vec4 normal = interpolateNormals(vertex1.m_normal, vertex2.m_normal, vertex3.m_normal, barycentricinterpolation);
 
                         // ** UNCOMMENT FOR 2D RASTERIZATION **
                         //result.setPixel(x, y, qRgb(colorinterpolation.r, colorinterpolation.g, colorinterpolation.b));
 
-                        //3D: [NO lambert shading]
-                        //result.setPixel(x, y, qRgb(textureColor.r, textureColor.g, textureColor.b));
-
                         //3D: lambert shading
-                        //clamp values
-                        result.setPixel(x, y, qRgb(glm::clamp(lambertTextureColor.r, 0.0f, 255.0f), glm::clamp(lambertTextureColor.g, 0.0f, 255.0f), glm::clamp(lambertTextureColor.b, 0.0f, 255.0f)));
+                        result.setPixel(x - region.left(), y - region.top(), shadeFragment(x, y, barycentricinterpolation, interpolatedDepth, normal));
+
+                        writeAOVs(zBufferIndex, interpolatedDepth, normal);
                     }
                 }
             }
         }
+        arena.Rewind(instanceStart);
     }
-    return result;
+
+    //MSAA resolve: each pixel is the average of its samples, written straight into the image's rows
+    if (samples > 1) {
+        for (int y = 0; y < region.height(); y++) {
+            QRgb* row = reinterpret_cast<QRgb*>(result.scanLine(y));
+            const QRgb* pixelSamples = sampleColors.data() + y * region.width() * samples;
+            for (int x = 0; x < region.width(); x++, pixelSamples += samples) {
+                row[x] = ResolveSamples(pixelSamples, samples);
+            }
+        }
+    }
+}
+
+// Draws the depth of one triangle, given in pixel space with the depth in z, into a depth map
+// by keeping the nearer depth at every pixel whose center lies inside the triangle.
+// Depth varies linearly across the screen, so it is found from the triangle's plane rather than
+// interpolated, and each row is a loop with no branches the compiler can vectorize.
+static void DrawTriangleDepth(const glm::vec3& v1, const glm::vec3& v2, const glm::vec3& v3, DepthMap* map)
+{
+    float area = (v2.x - v1.x) * (v3.y - v1.y) - (v3.x - v1.x) * (v2.y - v1.y);
+    if (area == 0.0f) {
+        return;
+    }
+    //depth gradient across the screen
+    float dzdx = ((v2.z - v1.z) * (v3.y - v1.y) - (v3.z - v1.z) * (v2.y - v1.y)) / area;
+    float dzdy = ((v3.z - v1.z) * (v2.x - v1.x) - (v2.z - v1.z) * (v3.x - v1.x)) / area;
+
+    const glm::vec3* edges[3][2] = {{&v1, &v2}, {&v2, &v3}, {&v3, &v1}};
+    int minY = std::max(0, static_cast<int>(std::ceil(std::min({v1.y, v2.y, v3.y}))));
+    int maxY = std::min(map->m_height - 1, static_cast<int>(std::floor(std::max({v1.y, v2.y, v3.y}))));
+    for (int y = minY; y <= maxY; y++) {
+        //span of the row inside the triangle
+        float xLeft = std::numeric_limits<float>::max();
+        float xRight = -std::numeric_limits<float>::max();
+        for (const auto& edge : edges) {
+            const glm::vec3& a = *edge[0];
+            const glm::vec3& b = *edge[1];
+            if (a.y == b.y || y < std::min(a.y, b.y) || y > std::max(a.y, b.y)) {
+                continue;
+            }
+            float x = a.x + (y - a.y) * (b.x - a.x) / (b.y - a.y);
+            xLeft = std::min(xLeft, x);
+            xRight = std::max(xRight, x);
+        }
+        int x0 = std::max(0, static_cast<int>(std::ceil(xLeft)));
+        int x1 = std::min(map->m_width - 1, static_cast<int>(std::floor(xRight)));
+
+        float* row = map->m_depth.data() + y * map->m_width;
+        float rowDepth = v1.z + dzdy * (y - v1.y) - dzdx * v1.x;
+        for (int x = x0; x <= x1; x++) {
+            row[x] = std::min(row[x], rowDepth + dzdx * x);
+        }
+    }
+}
+
+void Rasterizer::RenderDepth(const glm::mat4& view, const glm::mat4& projection, int width, int height, DepthMap* result)
+{
+    result->m_width = width;
+    result->m_height = height;
+    result->m_depth.assign(width * height, std::numeric_limits<float>::max());
+
+    //may be called while a frame is being drawn, so only what is allocated here is released
+    Arena& arena = m_frameArena.ForThread(0);
+    glm::mat4 viewProjection = projection * view;
+    const Scene& scene = *mp_scene;
+
+    for (unsigned int instanceIndex : scene.m_drawOrder) {
+        const Instance& instance = scene.m_instances[instanceIndex];
+        const Polygon& p = scene.m_polygons[instance.m_polygon];
+        glm::mat4 modelViewProjection = viewProjection * instance.m_model;
+
+        Frustum frustum(modelViewProjection);
+        const glm::vec4& bounds = scene.m_polygonBounds[instance.m_polygon];
+        if (!frustum.intersectsSphere(glm::vec3(bounds), bounds.w)) {
+            continue;
+        }
+
+        //only positions are transformed. Vertices behind the viewer get a w of 0 or less, and
+        //triangles using them are skipped rather than drawn inside out
+        Arena::Marker instanceStart = arena.Mark();
+        bool packed = p.IsPacked();
+        unsigned int count = p.VertexCount();
+        FrameVector<glm::vec4> screen(count, glm::vec4(), ArenaAllocator<glm::vec4>(arena));
+        for (unsigned int i = 0; i < count; i++) {
+            glm::vec4 clip = modelViewProjection * (packed ? p.VertAt(i).m_pos : p.m_verts[i].m_pos);
+            if (clip.w <= 0.0f) {
+                screen[i] = glm::vec4(0.0f);
+                continue;
+            }
+            glm::vec3 ndc = glm::vec3(clip) / clip.w;
+            screen[i] = glm::vec4(width * (ndc.x + 1.0f) * 0.5f, height * (1.0f - ndc.y) * 0.5f, ndc.z, clip.w);
+        }
+
+        for (const Triangle& t : p.m_tris) {
+            const glm::vec4& v1 = screen[t.m_indices[0]];
+            const glm::vec4& v2 = screen[t.m_indices[1]];
+            const glm::vec4& v3 = screen[t.m_indices[2]];
+            if (v1.w <= 0.0f || v2.w <= 0.0f || v3.w <= 0.0f) {
+                continue;
+            }
+            DrawTriangleDepth(glm::vec3(v1), glm::vec3(v2), glm::vec3(v3), result);
+        }
+        arena.Rewind(instanceStart);
+    }
+}
+
+template <typename Depth>
+bool Rasterizer::DrawOccluders(const QRect& region, OcclusionBuffer<Depth>& occlusion, FrameVector<ProjectedBox>& screenBoxes, const glm::mat4& view, const glm::mat4& projection, Arena& arena)
+{
+    const Scene& scene = *mp_scene;
+    glm::mat4 viewProjection = projection * view;
+    //a single instance has nothing to hide behind
+    if (scene.m_instances.size() < 2) {
+        return false;
+    }
+
+    //where every instance lands on screen
+    screenBoxes.resize(scene.m_instances.size());
+    for (unsigned int i = 0; i < scene.m_instances.size(); i++) {
+        const Instance& instance = scene.m_instances[i];
+        screenBoxes[i] = occlusion.Project(scene.m_polygonBoxes[instance.m_polygon], viewProjection * instance.m_model);
+    }
+
+    //flagged occluders, or failing those the largest instances on screen
+    FrameVector<unsigned int> occluders = FrameVector<unsigned int>(ArenaAllocator<unsigned int>(arena));
+    for (unsigned int i = 0; i < scene.m_instances.size(); i++) {
+        if (scene.m_instances[i].m_occluder) {
+            occluders.push_back(i);
+        }
+    }
+    if (occluders.empty()) {
+        float minArea = MIN_AUTO_OCCLUDER_COVERAGE * region.width() * region.height();
+        for (unsigned int i = 0; i < scene.m_instances.size(); i++) {
+            if (screenBoxes[i].Area() >= minArea
+                    && scene.m_polygons[scene.m_instances[i].m_polygon].m_tris.size() <= MAX_AUTO_OCCLUDER_TRIANGLES) {
+                occluders.push_back(i);
+            }
+        }
+        std::sort(occluders.begin(), occluders.end(), [&screenBoxes](unsigned int a, unsigned int b) {
+            return screenBoxes[a].Area() > screenBoxes[b].Area();
+        });
+        occluders.resize(std::min<size_t>(occluders.size(), MAX_AUTO_OCCLUDERS));
+    }
+    if (occluders.empty()) {
+        return false;
+    }
+
+    //depth-only pass over the occluders' triangles; their vertices only need clip space positions.
+    //Each is drawn at the LOD the main pass draws it with, since a coarser one can sit in front of
+    //the full detail surface and would hide what shows through around it
+    for (unsigned int occluder : occluders) {
+        const Instance& instance = scene.m_instances[occluder];
+        const Polygon& p = scene.m_polygons[instance.m_polygon];
+        int level = InstanceLOD(instance, view, projection);
+        const std::vector<Triangle>& triangles = level < 0 ? p.m_tris : p.m_lods[level].m_tris;
+        glm::mat4 modelViewProjection = viewProjection * instance.m_model;
+        Arena::Marker occluderStart = arena.Mark();
+        unsigned int count = level < 0 ? p.VertexCount() : p.m_lods[level].m_vertexCount;
+        FrameVector<glm::vec4> clipPositions(count, glm::vec4(), ArenaAllocator<glm::vec4>(arena));
+        for (unsigned int i = 0; i < count; i++) {
+            clipPositions[i] = modelViewProjection * (p.IsPacked() ? p.VertAt(i).m_pos : p.m_verts[i].m_pos);
+        }
+        //with backface culling, the meshlets the main pass skips for facing away are left out here
+        //too, or an open mesh's back faces would hide what shows through it
+        if (m_backfaceCulling && level < 0 && !p.m_meshlets.empty()) {
+            glm::vec3 eye = glm::vec3(glm::inverse(instance.m_model) * m_camera.position);
+            for (const Meshlet& meshlet : p.m_meshlets) {
+                if (MeshletFacesAway(meshlet, eye)) {
+                    continue;
+                }
+                for (unsigned int i = 0; i < meshlet.m_triangleCount; i++) {
+                    const Triangle& t = triangles[p.m_meshletTriangles[meshlet.m_firstTriangle + i]];
+                    occlusion.DrawTriangle(clipPositions[t.m_indices[0]], clipPositions[t.m_indices[1]], clipPositions[t.m_indices[2]]);
+                }
+            }
+        } else {
+            for (const Triangle& t : triangles) {
+                occlusion.DrawTriangle(clipPositions[t.m_indices[0]], clipPositions[t.m_indices[1]], clipPositions[t.m_indices[2]]);
+            }
+        }
+        arena.Rewind(occluderStart);
+    }
+    return true;
 }
 
 //Barycentric interpolation
@@ -254,20 +1082,153 @@ glm::vec4 Rasterizer::interpolateNormals(glm::vec4& v1normal, glm::vec4& v2norma
 }
 
 float Rasterizer::lambert(const Camera& camera, const glm::vec4& normal) {
-    float ambientTerm = 0.3f;
-
     //source of light will be the negative of the camera's vector
     glm::vec4 lightVector = -(camera.forward);
 
     //normalize camera's forward vector
     glm::vec4 normalizedForward = glm::normalize(lightVector);
 
-    float lightOnSinglePoint = glm::clamp(glm::dot(normalizedForward, normal), 0.0f, 1.0f);
+    return lambert(normalizedForward, normal);
+}
+
+float Rasterizer::lambert(const glm::vec4& lightDirection, const glm::vec4& normal) {
+    float ambientTerm = 0.3f;
+
+    float lightOnSinglePoint = glm::clamp(glm::dot(lightDirection, normal), 0.0f, 1.0f);
 
     return ambientTerm + lightOnSinglePoint;
 }
 
+glm::vec4 Rasterizer::PerturbNormal(const glm::vec4& normal, const glm::vec4& tangent, const glm::vec3& mapped) const {
+    if (normal == glm::vec4(0.0f)) {
+        return normal;
+    }
+    //Gram-Schmidt: interpolation leaves the tangent a little off perpendicular to the normal
+    glm::vec3 n = glm::normalize(glm::vec3(normal));
+    glm::vec3 t = glm::vec3(tangent) - n * glm::dot(n, glm::vec3(tangent));
+    float length = glm::length(t);
+    if (!(length > 1e-12f)) {
+        return glm::vec4(n, 0.0f);
+    }
+    t /= length;
+    glm::vec3 b = glm::cross(n, t) * (tangent.w < 0.0f ? -1.0f : 1.0f);
+    return glm::vec4(glm::normalize(t * mapped.x + b * mapped.y + n * mapped.z), 0.0f);
+}
+
+glm::vec3 Rasterizer::ShadeLights(const LightGrid& lights, int x, int y, const glm::vec3& position, const glm::vec4& normal) const {
+    glm::vec3 light(0.3f);
+    if (normal == glm::vec4(0.0f)) {
+        return light;
+    }
+    glm::vec3 n = glm::normalize(glm::vec3(normal));
+
+    for (const PreparedLight& l : lights.GlobalLights()) {
+        light += LightContribution(l, position, n);
+    }
+    //only the lights of limited range binned into this pixel's tile can reach it
+    unsigned int count;
+    const unsigned int* local = lights.LightsAt(x, y, &count);
+    for (unsigned int i = 0; i < count; i++) {
+        light += LightContribution(lights.LocalLights()[local[i]], position, n);
+    }
+    return light;
+}
+
+glm::vec3 Rasterizer::LightContribution(const PreparedLight& light, const glm::vec3& position, const glm::vec3& normal) const {
+    //direction from the surface toward the light
+    glm::vec3 toLight = -light.m_direction;
+    float falloff = 1.0f;
+    if (light.m_type != LightType::Directional) {
+        toLight = light.m_position - position;
+        float distanceSquared = glm::dot(toLight, toLight);
+        if (distanceSquared < MIN_LIGHT_DISTANCE_SQUARED) {
+            return glm::vec3(0.0f);
+        }
+        //lights with a range fade smoothly to nothing at it
+        if (light.m_inverseRangeSquared > 0.0f) {
+            falloff = 1.0f - distanceSquared * light.m_inverseRangeSquared;
+            if (falloff <= 0.0f) {
+                return glm::vec3(0.0f);
+            }
+            falloff *= falloff;
+        }
+        toLight /= std::sqrt(distanceSquared);
+    }
+    float diffuse = glm::dot(normal, toLight);
+    if (diffuse <= 0.0f) {
+        return glm::vec3(0.0f);
+    }
+    if (light.m_type == LightType::Spot) {
+        //fade out over the outer tenth of the cone
+        diffuse *= glm::smoothstep(light.m_cosOuter, light.m_cosInner, glm::dot(-toLight, light.m_direction));
+        if (diffuse <= 0.0f) {
+            return glm::vec3(0.0f);
+        }
+    }
+    if (light.m_shadowed) {
+        diffuse *= m_shadowMaps[light.m_index].Visibility(position, normal);
+    }
+    return light.m_radiance * (diffuse * falloff);
+}
+
+void Rasterizer::UpdateShadowMaps() {
+    for (unsigned int i = 0; i < m_lights.size(); i++) {
+        //point lights would need a map in every direction, and cast no shadows
+        bool shadowed = m_lights[i].m_castsShadows && m_lights[i].m_type != LightType::Point;
+        if (shadowed && !m_shadowMaps[i].IsCurrent(m_lights[i], mp_scene)) {
+            m_shadowMaps[i].Render(*this, m_lights[i], mp_scene, mp_scene->m_worldBounds);
+        }
+    }
+}
+
+void Rasterizer::SetLights(const std::vector<Light>& lights) {
+    m_lights = lights;
+    //maps already drawn for lights that stayed put are kept
+    m_shadowMaps.resize(m_lights.size());
+}
+
+void Rasterizer::SetResolution(int width, int height) {
+    m_width = width;
+    m_height = height;
+}
+
+void Rasterizer::SetDepthFormat(DepthFormat format) {
+    m_depthFormat = format;
+}
+
+void Rasterizer::SetSampleCount(int samples) {
+    m_sampleCount = samples >= 8 ? 8 : (samples >= 4 ? 4 : 1);
+}
+
+void Rasterizer::SetRenderScale(float scale) {
+    m_renderScale = std::min(std::max(scale, 0.125f), 1.0f);
+}
+
+void Rasterizer::SetOcclusionCulling(bool enabled) {
+    m_occlusionCulling = enabled;
+}
+
+void Rasterizer::SetDrawSorting(DrawSorting sorting) {
+    m_drawSorting = sorting;
+}
+
+void Rasterizer::SetBackfaceCulling(bool enabled) {
+    m_backfaceCulling = enabled;
+}
+
+void Rasterizer::SetLODThreshold(float pixels) {
+    m_lodThreshold = pixels;
+}
+
+void Rasterizer::SetPostProcess(const PostProcessChain& chain) {
+    m_postProcess = chain;
+}
+
+void Rasterizer::SetAOVs(unsigned int flags) {
+    m_aovFlags = flags;
+}
+
 void Rasterizer::ClearScene() {
-    m_polygons.clear();
+    mp_scene = std::make_shared<const Scene>(std::vector<Polygon>(), std::vector<Instance>());
 }
 
@@ -1,21 +1,231 @@
 #pragma once
 #include <polygon.h>
 #include <QImage>
+#include <QRect>
 #include <camera.h>
+#include <framearena.h>
+#include <aovbuffers.h>
+#include <depthformat.h>
+#include <depthmap.h>
+#include <light.h>
+#include <lightgrid.h>
+#include <postprocess.h>
+#include <shadowmap.h>
 
-class Rasterizer
+// One placement of a Polygon in the scene.
+// Many Instances may refer to the same Polygon, which stores its vertices only once.
+struct Instance
+{
+    // Index of the instanced Polygon in the Rasterizer's list of Polygons
+    unsigned int m_polygon;
+    // Transforms the Polygon's vertices from its own space into world space
+    glm::mat4 m_model;
+    // Whether the instance is large and solid enough to hide others (see SetOcclusionCulling)
+    bool m_occluder;
+
+    Instance(unsigned int polygon, const glm::mat4& model, bool occluder = false)
+        : m_polygon(polygon), m_model(model), m_occluder(occluder)
+    {}
+};
+
+// Everything a Rasterizer draws. A Scene is never modified once built,
+// so copies of a Rasterizer (e.g. one per rendering thread) all share a single one.
+struct Scene
 {
-private:
     //This is the set of Polygons loaded from a JSON scene file
     std::vector<Polygon> m_polygons;
+    //The placements of those Polygons that are actually drawn
+    std::vector<Instance> m_instances;
+    //Bounding sphere of each Polygon in its own space (center in xyz, radius in w)
+    std::vector<glm::vec4> m_polygonBounds;
+    //Axis-aligned bounding box of each Polygon in its own space
+    std::vector<AxisAlignedBox> m_polygonBoxes;
+    //Bounding sphere of every instance together, in world space (center in xyz, radius in w)
+    glm::vec4 m_worldBounds;
+    //Instance indices ordered so that every instance of a Polygon is drawn back to back
+    std::vector<unsigned int> m_drawOrder;
+
+    Scene(const std::vector<Polygon>& polygons, const std::vector<Instance>& instances);
+};
+
+// The order a frame's instances, and the triangles of each, are drawn in
+enum class DrawSorting
+{
+    // Instances by Polygon, in scene order, and triangles in the order they are listed
+    None,
+    // Instances nearest the camera first
+    FrontToBack,
+    // Instances nearest first, and each one's triangles nearest first in small clusters
+    FrontToBackClusters
+};
+
+template <typename Depth> class OcclusionBuffer;
+struct ProjectedBox;
+
+class Rasterizer
+{
+private:
+    std::shared_ptr<const Scene> mp_scene;
     Camera m_camera;
+    //Size of the full frame in pixels
+    int m_width;
+    int m_height;
+
+    //Which AOVs to keep (AOVFlags), and those kept for the last frame
+    unsigned int m_aovFlags;
+    AOVBuffers m_aovs;
+    //How the z-buffer stores depth
+    DepthFormat m_depthFormat;
+    //Samples per pixel coverage and depth are tested at: 1, 4 or 8
+    int m_sampleCount;
+    //Whether instances hidden behind occluders are skipped
+    bool m_occlusionCulling;
+    //Whether instances and triangles are sorted front to back before they are drawn
+    DrawSorting m_drawSorting;
+    //Whether meshlets facing entirely away from the camera are skipped
+    bool m_backfaceCulling;
+    //How many pixels a Polygon's LOD may be off by on screen (0 always draws full detail)
+    float m_lodThreshold;
+    //Fraction of the frame's width and height that is actually rasterized before upscaling
+    float m_renderScale;
+
+    //Lights of the scene, and the shadow map of each (unused for lights casting no shadows)
+    std::vector<Light> m_lights;
+    std::vector<ShadowMap> m_shadowMaps;
+
+    //Scratch memory for everything that only lives while a frame is rendered
+    FrameArena m_frameArena;
+    //Two color buffers rendered into alternately, so the image returned for the previous
+    //frame can still be in use while the next one is drawn without reallocating either
+    QImage m_colorTargets[2];
+    unsigned int m_currentColorTarget;
+    //What is rasterized when rendering at reduced resolution, before it is upscaled into a color target
+    QImage m_lowResolutionTarget;
+    //Full-screen passes run over each finished frame, and the buffer they filter into
+    PostProcessChain m_postProcess;
+    QImage m_postProcessTarget;
+
+    // Clears result, the given region of an m_width x m_height frame, and draws the scene into it
+    void DrawRegion(const QRect& region, QImage& result, Arena& arena);
+
+    // Draws every instance into the color target and z-buffer, with Depth (see depthformat.h)
+    // deciding how depth is stored and compared
+    template <typename Depth>
+    void DrawScene(const QRect& region, QImage& result, Arena& arena);
+
+    // Picks the occluders of the region and draws their depth into the occlusion buffer, after
+    // projecting the bounding box of every instance into screenBoxes. Returns false if there
+    // was nothing worth occluding with, in which case no instance should be tested.
+    template <typename Depth>
+    bool DrawOccluders(const QRect& region, OcclusionBuffer<Depth>& occlusion, FrameVector<ProjectedBox>& screenBoxes, const glm::mat4& view, const glm::mat4& projection, Arena& arena);
+
+    // The LOD of its Polygon an instance is drawn with from a camera with these matrices (see
+    // SetLODThreshold); -1 for the full detail triangles
+    int InstanceLOD(const Instance& instance, const glm::mat4& view, const glm::mat4& projection) const;
+
+    // Redraws the shadow maps of lights that moved since theirs were drawn
+    void UpdateShadowMaps();
+
+    // The light reaching a world space position with the given (interpolated) normal, seen
+    // at the pixel (x, y), from the scene's lights that can reach that pixel's tile, shadowed,
+    // plus the same ambient term as lambert
+    glm::vec3 ShadeLights(const LightGrid& lights, int x, int y, const glm::vec3& position, const glm::vec4& normal) const;
+    // The light reaching a position with the given unit normal from one light
+    glm::vec3 LightContribution(const PreparedLight& light, const glm::vec3& position, const glm::vec3& normal) const;
+
+    // Transforms the first vertexCount vertices of a Polygon for one instance into a buffer allocated from the arena
+    FrameVector<Vertex> TransformVertices(const Polygon& p, unsigned int vertexCount, const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection, int screenWidth, int screenHeight, Arena& arena);
+    // Transforms the tangents of the first vertexCount vertices of a normal mapped Polygon into world space for one instance
+    FrameVector<glm::vec4> TransformTangents(const Polygon& p, unsigned int vertexCount, const glm::mat4& model, Arena& arena);
+    // Bends an interpolated world space normal toward a normal map's tangent space normal,
+    // using the interpolated tangent (handedness in w). Returns a unit normal.
+    glm::vec4 PerturbNormal(const glm::vec4& normal, const glm::vec4& tangent, const glm::vec3& mapped) const;
 
 public:
+    // Draws every Polygon once, untransformed
     Rasterizer(const std::vector<Polygon>& polygons);
+    // Draws the Polygons only where they are placed by the given instances
+    Rasterizer(const std::vector<Polygon>& polygons, const std::vector<Instance>& instances);
 
-    QImage RenderScene();
+    // Renders the scene as seen by the camera. If a region of interest is given, only the pixels
+    // of the full frame inside it are drawn, and the returned image covers just that region.
+    QImage RenderScene(const QRect& regionOfInterest = QRect());
     void ClearScene();
 
+    // Sets the size of the full frame in pixels (512 x 512 by default)
+    void SetResolution(int width, int height);
+    int GetWidth() const { return m_width; }
+    int GetHeight() const { return m_height; }
+
+    // Chooses how the z-buffer stores depth (Float32 by default)
+    void SetDepthFormat(DepthFormat format);
+    DepthFormat GetDepthFormat() const { return m_depthFormat; }
+
+    // Chooses multisample anti-aliasing: 1 (the default, none), 4 or 8 samples per pixel, with
+    // other counts rounded down to one of those. Each sample has its own coverage, depth and color,
+    // but a triangle is shaded once per pixel, so edges are smoothed for far less than the cost of
+    // rendering at a higher resolution. A pixel covered entirely by one triangle keeps the color it has without.
+    void SetSampleCount(int samples);
+    int GetSampleCount() const { return m_sampleCount; }
+
+    // Chooses the fraction of the frame's width and height that is rasterized (from 1/8 to 1, the
+    // default). Below 1, a frame that much smaller is drawn, lit and anti-aliased as usual, then
+    // upscaled to the full resolution with a sharp Lanczos filter (see upscaler.h) before any
+    // post-processing. Rasterizing costs roughly the square of the scale, so this trades detail for
+    // speed, e.g. to keep an interactive view responsive or to draw thumbnails cheaply.
+    // AOVs are kept at the reduced resolution.
+    void SetRenderScale(float scale);
+    float GetRenderScale() const { return m_renderScale; }
+
+    // Draws only the depth of the scene as seen through the given view and projection matrices
+    // (which need not be the camera's) into a width x height depth map. Nothing but the depth is
+    // interpolated and no pixel is shaded, so this is much cheaper than RenderScene, for passes
+    // like shadow maps that need only depth. The projection must map depth from 0 on the near
+    // plane to 1 on the far one, as Camera::getProjectionMatrix and orthographic projections do.
+    void RenderDepth(const glm::mat4& view, const glm::mat4& projection, int width, int height, DepthMap* result);
+
+    // Lights the scene with the given lights, casting shadows from those that ask for them,
+    // instead of with a light at the camera
+    void SetLights(const std::vector<Light>& lights);
+    const std::vector<Light>& GetLights() const { return m_lights; }
+
+    // Chooses whether instances hidden behind occluders are skipped before their vertices are
+    // transformed (on by default). Occluders are the instances flagged as such, or if none are,
+    // the few largest on screen. Skipped instances could not have been seen, so the image is the same.
+    void SetOcclusionCulling(bool enabled);
+    bool GetOcclusionCulling() const { return m_occlusionCulling; }
+
+    // Chooses whether each frame sorts what it draws front to back (None, the default, draws in
+    // scene order). Drawn nearest first, the visible surfaces reach the z-buffer before the ones they
+    // hide, which are then rejected by the depth tests before being shaded, so scenes with many
+    // surfaces behind one another render faster. Only surfaces at exactly the same depth can come
+    // out differently, as whichever is drawn first still wins.
+    void SetDrawSorting(DrawSorting sorting);
+    DrawSorting GetDrawSorting() const { return m_drawSorting; }
+
+    // Chooses whether the meshlets (see Polygon::BuildMeshlets) whose triangles all face away from
+    // the camera are skipped (off by default). Triangles face the way their corners wind counterclockwise,
+    // and nothing else in the rasterizer culls back faces, so this only leaves the image the same for
+    // closed meshes wound that way, whose back faces are always hidden behind their front ones.
+    void SetBackfaceCulling(bool enabled);
+    bool GetBackfaceCulling() const { return m_backfaceCulling; }
+
+    // Sets how far, in pixels, the surface of a Polygon drawn at one of its LODs (see Polygon::BuildLODs)
+    // may be from where its full detail triangles would put it (1 by default). Each instance is drawn
+    // with the coarsest LOD within that at its distance from the camera; 0 always draws full detail.
+    void SetLODThreshold(float pixels);
+    float GetLODThreshold() const { return m_lodThreshold; }
+
+    // Sets the full-screen passes (e.g. FXAA, sharpening, gamma) run over every image RenderScene
+    // returns once it is rasterized. No passes are run by default.
+    void SetPostProcess(const PostProcessChain& chain);
+    const PostProcessChain& GetPostProcess() const { return m_postProcess; }
+
+    // Chooses which AOVs (a combination of AOVFlags) later frames keep besides the color image
+    void SetAOVs(unsigned int flags);
+    // The AOVs of the last frame rendered, valid until the next one is
+    const AOVBuffers& GetAOVs() const { return m_aovs; }
+
     //** 2D RASTERIZATION **
 
     // Barycentric interpolation for 2D Rasterization
@@ -33,6 +243,9 @@ public:
     Camera& getCamera() {
         return m_camera;
     }
+    const Camera& getCamera() const {
+        return m_camera;
+    }
 
     // Barycentric interpolation for 3D Rasterization
     glm::vec3 BarycentricInterpolation3D (glm::vec4& v1, glm::vec4& v2, glm::vec4& v3, glm::vec4& point);
@@ -44,6 +257,8 @@ public:
 
     // Calculate value for Lambert shading
     float lambert(const Camera& camera, const glm::vec4& normal);
+    // The same, with the unit direction toward the light already worked out
+    float lambert(const glm::vec4& lightDirection, const glm::vec4& normal);
 
     // Function to interpolate vector normals for Lambert shading
     glm::vec4 interpolateNormals(glm::vec4& v1normal, glm::vec4& v2normal, glm::vec4& v3normal, glm::vec3& barycentricInfluence);
@@ -13,15 +13,57 @@ TEMPLATE = app
 
 SOURCES += main.cpp\
         mainwindow.cpp \
+    aovbuffers.cpp \
+    batchrender.cpp \
+    framearena.cpp \
+    framewriter.cpp \
+    imageencoder.cpp \
+    lightgrid.cpp \
+    meshcache.cpp \
+    meshsimplifier.cpp \
+    normalmap.cpp \
     polygon.cpp \
+    postprocess.cpp \
     rasterizer.cpp \
-    tiny_obj_loader.cc
+    renderfarm.cpp \
+    resolutioncontroller.cpp \
+    sceneloader.cpp \
+    shadowmap.cpp \
+    texturecache.cpp \
+    tiny_obj_loader.cc \
+    upscaler.cpp
 
 HEADERS  += mainwindow.h \
+    aovbuffers.h \
+    batchrender.h \
     camera.h \
+    camerapath.h \
+    depthformat.h \
+    depthmap.h \
+    framearena.h \
+    framewriter.h \
+    frustum.h \
+    hizbuffer.h \
+    imageencoder.h \
+    light.h \
+    lightgrid.h \
+    meshcache.h \
+    meshsimplifier.h \
+    multisample.h \
+    normalmap.h \
+    occlusionbuffer.h \
+    packedvertex.h \
     polygon.h \
+    postprocess.h \
+    radixsort.h \
     rasterizer.h \
+    renderfarm.h \
+    resolutioncontroller.h \
+    sceneloader.h \
     segment.h \
-    tiny_obj_loader.h
+    shadowmap.h \
+    texturecache.h \
+    tiny_obj_loader.h \
+    upscaler.h
 
 FORMS    += mainwindow.ui
@@ -0,0 +1,285 @@
+#include "renderfarm.h"
+#include <QCoreApplication>
+#include <QEventLoop>
+#include <QStringList>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <sceneloader.h>
+#include <rasterizer.h>
+
+//a tile is handed out this many times at most before the render is given up on
+static const int MAX_TILE_ATTEMPTS = 3;
+
+// How far along a worker is with sending back its current tile
+enum class TileStatus { Pending, Done, Failed };
+
+// Reads whatever a worker has sent so far and, once the whole tile has arrived,
+// pastes it into the image. The part of the reply received so far is kept in pending.
+// The reply must be for exactly the tile the worker was sent, and that tile must lie
+// within the image, or nothing is pasted.
+static TileStatus ReadTileReply(QProcess& process, QByteArray& pending, const QRect& tile, QImage* image)
+{
+    if(process.state() == QProcess::NotRunning)
+    {
+        return TileStatus::Failed;
+    }
+    if(process.bytesAvailable() == 0)
+    {
+        return TileStatus::Pending;
+    }
+    pending.append(process.readAll());
+
+    int headerEnd = pending.indexOf('\n');
+    if(headerEnd < 0)
+    {
+        return TileStatus::Pending;
+    }
+    std::istringstream header(std::string(pending.constData(), headerEnd));
+    std::string tag;
+    int x, y, w, h;
+    if(!(header >> tag >> x >> y >> w >> h) || tag != "tile")
+    {
+        return TileStatus::Failed;
+    }
+    if(QRect(x, y, w, h) != tile || !image->rect().contains(tile))
+    {
+        std::cout << "A render worker replied with the wrong tile" << std::endl;
+        return TileStatus::Failed;
+    }
+    int payload = w * h * 4;
+    if(pending.size() < headerEnd + 1 + payload)
+    {
+        return TileStatus::Pending;
+    }
+
+    const char* pixels = pending.constData() + headerEnd + 1;
+    for(int row = 0; row < h; row++)
+    {
+        std::memcpy(image->scanLine(y + row) + x * 4, pixels + row * w * 4, w * 4);
+    }
+    pending.remove(0, headerEnd + 1 + payload);
+    return TileStatus::Done;
+}
+
+RenderFarm::RenderFarm(const QString& sceneFile, unsigned int workerCount)
+    : m_sceneFile(sceneFile), m_workers(), m_running(true)
+{
+    for(unsigned int i = 0; i < std::max(workerCount, 1u); i++)
+    {
+        Worker worker;
+        if(!StartWorker(worker))
+        {
+            std::cout << "Could not start render worker " << i << std::endl;
+            m_running = false;
+        }
+        m_workers.push_back(std::move(worker));
+    }
+}
+
+RenderFarm::~RenderFarm()
+{
+    //closing their input is the signal for workers to exit
+    for(Worker& worker : m_workers)
+    {
+        worker.process->closeWriteChannel();
+    }
+    for(Worker& worker : m_workers)
+    {
+        if(!worker.process->waitForFinished())
+        {
+            worker.process->kill();
+        }
+    }
+}
+
+bool RenderFarm::IsRunning() const
+{
+    return m_running;
+}
+
+bool RenderFarm::StartWorker(Worker& worker)
+{
+    if(worker.process)
+    {
+        worker.process->kill();
+        worker.process->waitForFinished();
+    }
+    worker.process.reset(new QProcess());
+    worker.busy = false;
+    worker.tile = 0;
+    worker.pending = QByteArray();
+    //worker log output (e.g. OBJ loading errors) goes to the coordinator's console
+    worker.process->setProcessChannelMode(QProcess::ForwardedErrorChannel);
+    worker.process->start(QCoreApplication::applicationFilePath(), QStringList() << QString("--worker") << m_sceneFile);
+    return worker.process->waitForStarted();
+}
+
+void RenderFarm::SendJob(Worker& worker, size_t tileIndex, const QRect& tile, const Camera& camera, int width, int height)
+{
+    std::ostringstream job;
+    job.precision(9);
+    job << width << ' ' << height << ' '
+        << tile.x() << ' ' << tile.y() << ' ' << tile.width() << ' ' << tile.height() << ' '
+        << camera.position.x << ' ' << camera.position.y << ' ' << camera.position.z << ' '
+        << camera.forward.x << ' ' << camera.forward.y << ' ' << camera.forward.z << ' '
+        << camera.up.x << ' ' << camera.up.y << ' ' << camera.up.z << ' '
+        << camera.right.x << ' ' << camera.right.y << ' ' << camera.right.z << ' '
+        << camera.fov << ' ' << camera.nearClip << ' ' << camera.farClip << ' ' << camera.aspectRatio << '\n';
+    std::string line = job.str();
+    worker.process->write(line.data(), line.size());
+    worker.busy = true;
+    worker.tile = tileIndex;
+}
+
+bool RenderFarm::ReceiveTile(Worker& worker, const QRect& tile, QImage* image)
+{
+    TileStatus status = ReadTileReply(*worker.process, worker.pending, tile, image);
+    if(status == TileStatus::Done)
+    {
+        worker.busy = false;
+    }
+    return status != TileStatus::Failed;
+}
+
+void RenderFarm::WaitForReplies()
+{
+    //the processes' pipes are only read while an event loop runs, so one runs until any of them
+    //has something new; the connections go away with the loop
+    QEventLoop loop;
+    for(Worker& worker : m_workers)
+    {
+        if(worker.busy)
+        {
+            if(worker.process->bytesAvailable() > 0 || worker.process->state() == QProcess::NotRunning)
+            {
+                return;
+            }
+            QObject::connect(worker.process.get(), &QProcess::readyRead, &loop, &QEventLoop::quit);
+            QObject::connect(worker.process.get(), &QProcess::stateChanged, &loop, &QEventLoop::quit);
+        }
+    }
+    loop.exec();
+}
+
+QImage RenderFarm::Render(const Camera& camera, int width, int height, int tileSize)
+{
+    if(!m_running || width <= 0 || height <= 0)
+    {
+        return QImage();
+    }
+    tileSize = std::max(tileSize, 1);
+
+    std::vector<QRect> tiles;
+    for(int y = 0; y < height; y += tileSize)
+    {
+        for(int x = 0; x < width; x += tileSize)
+        {
+            tiles.push_back(QRect(x, y, std::min(tileSize, width - x), std::min(tileSize, height - y)));
+        }
+    }
+
+    QImage image(width, height, QImage::Format_RGB32);
+    //tiles not handed out yet, including those whose worker failed them
+    std::deque<size_t> queue;
+    for(size_t i = 0; i < tiles.size(); i++)
+    {
+        queue.push_back(i);
+    }
+    std::vector<int> attempts(tiles.size(), 0);
+    while(true)
+    {
+        //keep every worker fed, then collect whatever has finished
+        bool anyBusy = false;
+        for(Worker& worker : m_workers)
+        {
+            if(!worker.busy && !queue.empty())
+            {
+                size_t tile = queue.front();
+                queue.pop_front();
+                attempts[tile]++;
+                SendJob(worker, tile, tiles[tile], camera, width, height);
+            }
+            if(!worker.busy)
+            {
+                continue;
+            }
+            if(!ReceiveTile(worker, tiles[worker.tile], &image))
+            {
+                //a worker that died or lost track of its jobs is replaced, and its tile goes to the back of the queue
+                std::cout << "A render worker failed its tile; restarting it" << std::endl;
+                if(attempts[worker.tile] >= MAX_TILE_ATTEMPTS)
+                {
+                    std::cout << "Giving up on tile " << worker.tile << " after " << MAX_TILE_ATTEMPTS << " attempts" << std::endl;
+                    m_running = false;
+                    return QImage();
+                }
+                queue.push_back(worker.tile);
+                if(!StartWorker(worker))
+                {
+                    std::cout << "Could not restart a render worker" << std::endl;
+                    m_running = false;
+                    return QImage();
+                }
+                continue;
+            }
+            anyBusy = anyBusy || worker.busy;
+        }
+        if(!anyBusy && queue.empty())
+        {
+            return image;
+        }
+        if(anyBusy)
+        {
+            WaitForReplies();
+        }
+    }
+}
+
+int RunRenderWorker(const QString& sceneFile)
+{
+    //standard output carries tiles, so anything else the program prints goes to standard error
+    std::cout.rdbuf(std::cerr.rdbuf());
+
+    SceneDescription scene;
+    if(!LoadSceneFile(sceneFile, &scene))
+    {
+        return 1;
+    }
+    //loaded once, then reused for every job this worker is given
+    Rasterizer rasterizer(scene.m_polygons, scene.m_instances);
+    rasterizer.SetLights(scene.m_lights);
+
+    std::string line;
+    while(std::getline(std::cin, line))
+    {
+        std::istringstream job(line);
+        int width, height, x, y, w, h;
+        Camera& camera = rasterizer.getCamera();
+        if(!(job >> width >> height >> x >> y >> w >> h
+                 >> camera.position.x >> camera.position.y >> camera.position.z
+                 >> camera.forward.x >> camera.forward.y >> camera.forward.z
+                 >> camera.up.x >> camera.up.y >> camera.up.z
+                 >> camera.right.x >> camera.right.y >> camera.right.z
+                 >> camera.fov >> camera.nearClip >> camera.farClip >> camera.aspectRatio))
+        {
+            std::cerr << "Render worker received a malformed job" << std::endl;
+            return 1;
+        }
+
+        rasterizer.SetResolution(width, height);
+        QImage tile = rasterizer.RenderScene(QRect(x, y, w, h));
+
+        std::fprintf(stdout, "tile %d %d %d %d\n", x, y, w, h);
+        for(int row = 0; row < h; row++)
+        {
+            std::fwrite(tile.constScanLine(row), 4, w, stdout);
+        }
+        std::fflush(stdout);
+    }
+    return 0;
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <QImage>
+#include <QProcess>
+#include <QRect>
+#include <QString>
+#include <memory>
+#include <vector>
+#include <camera.h>
+
+// Renders large images by splitting the frame into tiles and handing them to several
+// worker processes on this machine. Each worker is a copy of this program started in
+// worker mode (see RunRenderWorker): it loads the scene once, then renders tile after tile
+// as the coordinator asks, until the RenderFarm is destroyed. The coordinator pastes the
+// finished tiles into the full image.
+//
+// Workers talk to the coordinator over their standard input and output. A job is one line:
+//   width height tileX tileY tileWidth tileHeight  position(3) forward(3) up(3) right(3)  fov near far aspect
+// and the reply is the line "tile tileX tileY tileWidth tileHeight" followed by the tile's
+// pixels as raw 32-bit RGB, row by row. A worker that dies, or replies with anything but the
+// tile it was given, is restarted and the tile is handed out again.
+class RenderFarm
+{
+public:
+    // Starts workerCount workers, each loading the given scene file
+    RenderFarm(const QString& sceneFile, unsigned int workerCount);
+    // Tells the workers to exit and waits for them
+    ~RenderFarm();
+
+    // Returns false if any worker failed to start
+    bool IsRunning() const;
+
+    // Renders a width x height image seen by the camera, in square tiles of tileSize pixels.
+    // Returns a null image if a tile keeps failing or a worker cannot be restarted.
+    QImage Render(const Camera& camera, int width, int height, int tileSize);
+
+private:
+    // A worker process and the state of the tile it is currently rendering
+    struct Worker
+    {
+        std::unique_ptr<QProcess> process;
+        bool busy;
+        // Index of the tile the worker is rendering, while busy
+        size_t tile;
+        // The part of the worker's current reply received so far
+        QByteArray pending;
+    };
+
+    // Starts (or restarts) a worker process, idle. Returns false if it could not be started.
+    bool StartWorker(Worker& worker);
+    // Sends one tile job to an idle worker
+    void SendJob(Worker& worker, size_t tileIndex, const QRect& tile, const Camera& camera, int width, int height);
+    // Reads what a worker has sent so far, pasting its tile into the full image once complete.
+    // Returns false if the worker died or sent something other than its tile.
+    bool ReceiveTile(Worker& worker, const QRect& tile, QImage* image);
+    // Blocks until a busy worker has sent something more or stopped running
+    void WaitForReplies();
+
+    QString m_sceneFile;
+    std::vector<Worker> m_workers;
+    bool m_running;
+};
+
+// The main loop of a worker process: loads the scene, then answers tile jobs read
+// from standard input until it is closed. Returns the process exit code.
+int RunRenderWorker(const QString& sceneFile);
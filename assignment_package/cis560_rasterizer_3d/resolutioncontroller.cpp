@@ -0,0 +1,73 @@
+#include "resolutioncontroller.h"
+#include <algorithm>
+#include <cmath>
+
+static const float MIN_SCALE = 0.125f;
+//scales are kept to multiples of this, so small changes in frame time leave the scale (and the
+//size of the buffers the rasterizer allocates for it) as it is
+static const float SCALE_STEP = 1.0f / 16.0f;
+//how much of each new frame time goes into the smoothed one
+static const float SMOOTHING = 0.25f;
+//the scale is chosen to bring frames to this fraction of the budget, leaving headroom for spikes
+static const float TARGET_FRACTION = 0.85f;
+//frames under this fraction of the budget for this many frames in a row raise the scale, two steps at most
+static const float RAISE_FRACTION = 0.7f;
+static const int RAISE_DELAY_FRAMES = 8;
+static const float MAX_RAISE = 2.0f * SCALE_STEP;
+
+ResolutionController::ResolutionController(float frameBudget)
+    : m_frameBudget(frameBudget), m_scale(1.0f), m_smoothedFrameTime(0.0f), m_framesUnderBudget(0)
+{}
+
+void ResolutionController::SetFrameBudget(float frameBudget)
+{
+    m_frameBudget = std::max(frameBudget, 0.0f);
+    m_framesUnderBudget = 0;
+    if(m_frameBudget == 0.0f)
+    {
+        m_scale = 1.0f;
+    }
+}
+
+float ResolutionController::Update(float frameTime)
+{
+    m_smoothedFrameTime = m_smoothedFrameTime == 0.0f ? frameTime : m_smoothedFrameTime + SMOOTHING * (frameTime - m_smoothedFrameTime);
+    if(m_frameBudget == 0.0f || m_smoothedFrameTime <= 0.0f)
+    {
+        return m_scale;
+    }
+
+    //rasterizing costs about as much as the number of pixels drawn, the square of the scale
+    float ideal = m_scale * std::sqrt(TARGET_FRACTION * m_frameBudget / m_smoothedFrameTime);
+    float scale = m_scale;
+    //over budget: drop straight to the scale that should fit
+    if(m_smoothedFrameTime > m_frameBudget)
+    {
+        scale = std::floor(ideal / SCALE_STEP) * SCALE_STEP;
+        m_framesUnderBudget = 0;
+    }
+    //well under budget for long enough: creep back up
+    else if(m_smoothedFrameTime < RAISE_FRACTION * m_frameBudget)
+    {
+        if(++m_framesUnderBudget >= RAISE_DELAY_FRAMES)
+        {
+            scale = std::floor(std::min(ideal, m_scale + MAX_RAISE) / SCALE_STEP) * SCALE_STEP;
+            m_framesUnderBudget = 0;
+        }
+    }
+    //in between, the scale is fine as it is
+    else
+    {
+        m_framesUnderBudget = 0;
+    }
+    scale = std::min(std::max(scale, MIN_SCALE), 1.0f);
+
+    //the frames already averaged were drawn at the old scale; expect the new one to change them
+    //as much as it changes the pixels drawn, so the change is not made twice
+    if(scale != m_scale)
+    {
+        m_smoothedFrameTime *= (scale * scale) / (m_scale * m_scale);
+        m_scale = scale;
+    }
+    return m_scale;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+// Picks the render scale (see Rasterizer::SetRenderScale) that keeps frames within a time budget,
+// from how long the frames before took: lower when they run over it, higher when there is time to spare.
+//
+// The frame time is smoothed over several frames, and the scale only rises again once frames have
+// stayed well under the budget for a while, so a scene near the budget does not flicker between two
+// resolutions. It drops at once when frames run over, since a stutter is worse than a blurrier frame.
+class ResolutionController
+{
+public:
+    // A budget of 0, the default, keeps the full resolution
+    explicit ResolutionController(float frameBudget = 0.0f);
+
+    // Sets the time each frame should take to render, in milliseconds (0 turns scaling off)
+    void SetFrameBudget(float frameBudget);
+    float GetFrameBudget() const { return m_frameBudget; }
+
+    // Records how long the last frame took to render, in milliseconds, and returns the scale to
+    // render the next one at
+    float Update(float frameTime);
+
+    // The scale to render the next frame at, from 1/8 to 1
+    float GetScale() const { return m_scale; }
+    // The smoothed frame time the scale is chosen from, in milliseconds (0 before any frame)
+    float GetSmoothedFrameTime() const { return m_smoothedFrameTime; }
+
+private:
+    float m_frameBudget;
+    float m_scale;
+    float m_smoothedFrameTime;
+    //Frames in a row that took well under the budget
+    int m_framesUnderBudget;
+};
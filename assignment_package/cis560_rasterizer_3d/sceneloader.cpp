@@ -0,0 +1,387 @@
+#include "sceneloader.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonObject>
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <iostream>
+#include <map>
+#include <glm/gtx/transform.hpp>
+#include <tiny_obj_loader.h>
+#include <texturecache.h>
+#include <meshcache.h>
+
+//meshes with at least this many triangles are split into meshlets the rasterizer can cull whole;
+//for smaller ones the per-meshlet tests would cost about as much as the triangles they skip
+static const unsigned int MESHLET_MIN_TRIANGLES = 1024;
+
+//vertices closer than this fraction of a mesh's size are welded when it is cleaned
+static const float WELD_TOLERANCE = 1e-5f;
+
+// The memory a mesh with this many vertices and triangles takes
+static size_t MeshBytes(unsigned int vertexCount, unsigned int triangleCount)
+{
+    return static_cast<size_t>(vertexCount) * sizeof(Vertex) + static_cast<size_t>(triangleCount) * sizeof(Triangle);
+}
+
+// Reads an OBJ file and prepares its mesh (see MeshPreparation), or reads what preparing it the
+// same way gave before from the mesh cache
+static Polygon LoadPreparedOBJ(const QString& filename, const QString& name, unsigned int preparation)
+{
+    if(preparation == MESH_AS_LOADED)
+    {
+        return LoadOBJ(filename, name);
+    }
+    Polygon p(name);
+    if(LoadMeshCache(filename, preparation, &p))
+    {
+        return p;
+    }
+    p = LoadOBJ(filename, name);
+    if(preparation & MESH_CLEANED)
+    {
+        MeshCleanStats stats = p.Clean(WELD_TOLERANCE * p.BoundingSphere().w);
+        unsigned int trianglesAfter = stats.m_trianglesBefore - stats.m_degenerateTriangles - stats.m_duplicateTriangles;
+        std::cout << QFileInfo(filename).fileName().toStdString() << ": welded " << stats.m_verticesBefore << " vertices into "
+                  << stats.m_verticesAfter << ", removed " << stats.m_degenerateTriangles << " degenerate and "
+                  << stats.m_duplicateTriangles << " duplicate triangles of " << stats.m_trianglesBefore << " ("
+                  << MeshBytes(stats.m_verticesBefore, stats.m_trianglesBefore) / 1024 << " KB -> "
+                  << MeshBytes(stats.m_verticesAfter, trianglesAfter) / 1024 << " KB)" << std::endl;
+    }
+    if(preparation & MESH_OPTIMIZED)
+    {
+        p.OptimizeTriangleOrder();
+    }
+    if(preparation & MESH_SIMPLIFIED)
+    {
+        p.BuildLODs();
+    }
+    SaveMeshCache(filename, preparation, p);
+    return p;
+}
+
+// Reads the model matrix of an instance from either a "matrix" entry holding 16 numbers
+// in column-major order, or from optional "translate", "rotate" (degrees about X, Y then Z)
+// and "scale" entries.
+static glm::mat4 ReadModelMatrix(const QJsonObject& obj)
+{
+    if(obj.contains(QString("matrix")))
+    {
+        QJsonArray m = obj["matrix"].toArray();
+        glm::mat4 model(1.f);
+        for(int j = 0; j < 16 && j < m.size(); j++)
+        {
+            model[j / 4][j % 4] = m[j].toDouble();
+        }
+        return model;
+    }
+    glm::vec3 translate(0.f), rotate(0.f), scale(1.f);
+    if(obj.contains(QString("translate")))
+    {
+        QJsonArray arr = obj["translate"].toArray();
+        translate = glm::vec3(arr[0].toDouble(), arr[1].toDouble(), arr[2].toDouble());
+    }
+    if(obj.contains(QString("rotate")))
+    {
+        QJsonArray arr = obj["rotate"].toArray();
+        rotate = glm::vec3(arr[0].toDouble(), arr[1].toDouble(), arr[2].toDouble());
+    }
+    if(obj.contains(QString("scale")))
+    {
+        QJsonArray arr = obj["scale"].toArray();
+        scale = glm::vec3(arr[0].toDouble(), arr[1].toDouble(), arr[2].toDouble());
+    }
+    return glm::translate(translate)
+         * glm::rotate(rotate.z, glm::vec3(0.f, 0.f, 1.f))
+         * glm::rotate(rotate.y, glm::vec3(0.f, 1.f, 0.f))
+         * glm::rotate(rotate.x, glm::vec3(1.f, 0.f, 0.f))
+         * glm::scale(scale);
+}
+
+static glm::vec3 ReadVec3(const QJsonArray& arr)
+{
+    return glm::vec3(arr[0].toDouble(), arr[1].toDouble(), arr[2].toDouble());
+}
+
+// Reads a "cameraPath" entry: a number of "frames" and either a "turntable" orbit
+// (with optional "center", "radius", "height" and "degrees") or a list of "keyframes",
+// each with a "position", "forward" and "up" direction.
+static CameraPath ReadCameraPath(const QJsonObject& obj)
+{
+    CameraPath path;
+    path.frameCount = obj["frames"].toInt();
+    if(obj.contains(QString("turntable")))
+    {
+        QJsonObject orbit = obj["turntable"].toObject();
+        path.turntable = true;
+        if(orbit.contains(QString("center")))
+        {
+            path.orbitCenter = ReadVec3(orbit["center"].toArray());
+        }
+        path.orbitRadius = orbit["radius"].toDouble(path.orbitRadius);
+        path.orbitHeight = orbit["height"].toDouble(path.orbitHeight);
+        path.orbitDegrees = orbit["degrees"].toDouble(path.orbitDegrees);
+    }
+    QJsonArray keys = obj["keyframes"].toArray();
+    for(int i = 0; i < keys.size(); i++)
+    {
+        QJsonObject key = keys[i].toObject();
+        path.keyframes.push_back(CameraKeyframe{ReadVec3(key["position"].toArray()),
+                                                ReadVec3(key["forward"].toArray()),
+                                                ReadVec3(key["up"].toArray())});
+    }
+    return path;
+}
+
+// Reads one entry of a "lights" list: a "type" of "directional", "spot" or "point", a "direction"
+// the light travels in, a "position" for spot and point lights, and optional "color", "intensity",
+// "angle" (half the spot cone, in degrees), "range" (where spot and point lights fade out),
+// "shadows", "shadowMapSize", "shadowBias" (in texels) and "shadowFilter" (PCF radius in texels) entries
+static Light ReadLight(const QJsonObject& obj)
+{
+    Light light;
+    if(QString::compare(obj["type"].toString(), QString("spot")) == 0)
+    {
+        light.m_type = LightType::Spot;
+    }
+    else if(QString::compare(obj["type"].toString(), QString("point")) == 0)
+    {
+        light.m_type = LightType::Point;
+    }
+    if(obj.contains(QString("position")))
+    {
+        light.m_position = ReadVec3(obj["position"].toArray());
+    }
+    if(obj.contains(QString("direction")))
+    {
+        light.m_direction = ReadVec3(obj["direction"].toArray());
+    }
+    if(obj.contains(QString("color")))
+    {
+        light.m_color = ReadVec3(obj["color"].toArray());
+    }
+    light.m_intensity = obj["intensity"].toDouble(light.m_intensity);
+    light.m_spotAngle = obj["angle"].toDouble(light.m_spotAngle);
+    light.m_range = obj["range"].toDouble(light.m_range);
+    light.m_castsShadows = obj["shadows"].toBool(light.m_castsShadows);
+    light.m_shadowMapSize = obj["shadowMapSize"].toInt(light.m_shadowMapSize);
+    light.m_shadowBias = obj["shadowBias"].toDouble(light.m_shadowBias);
+    light.m_shadowFilterRadius = obj["shadowFilter"].toInt(light.m_shadowFilterRadius);
+    return light;
+}
+
+bool LoadSceneFile(const QString& filename, SceneDescription* scene)
+{
+    std::vector<Polygon>& polygons = scene->m_polygons;
+    //Placements of the polygons; meshes are only drawn where an instance puts them
+    std::vector<Instance>& instances = scene->m_instances;
+    //Index of each named polygon, so instances can refer to them
+    std::map<QString, unsigned int> polygonIndices;
+    //Instance entries are resolved once every mesh they may refer to is loaded
+    std::vector<QJsonObject> instanceObjects;
+
+    //paths inside the scene are relative to the folder holding it
+    QString local_path = QFileInfo(filename).absolutePath().append(QString("/"));
+
+    QFile file(filename);
+    if(!file.open(QIODevice::ReadOnly)){
+        qWarning("Could not open the JSON file.");
+        return false;
+    }
+    QByteArray file_data = file.readAll();
+
+    QJsonDocument jdoc(QJsonDocument::fromJson(file_data));
+    //An optional path to render the scene along in batch mode
+    scene->m_hasCameraPath = jdoc.object().contains(QString("cameraPath"));
+    if(scene->m_hasCameraPath)
+    {
+        scene->m_cameraPath = ReadCameraPath(jdoc.object()["cameraPath"].toObject());
+    }
+    //Optional lights; without them the scene is lit from the camera
+    QJsonArray lights = jdoc.object()["lights"].toArray();
+    for(int i = 0; i < lights.size(); i++)
+    {
+        scene->m_lights.push_back(ReadLight(lights[i].toObject()));
+    }
+    //Optional cap on the memory held by decoded textures, in megabytes (0 = unlimited)
+    if(jdoc.object().contains(QString("textureBudgetMB")))
+    {
+        TextureCache::Instance().SetBudget(static_cast<size_t>(jdoc.object()["textureBudgetMB"].toDouble() * 1024 * 1024));
+    }
+    //Read the mesh data in the file
+    QJsonArray objects = jdoc.object()["objects"].toArray();
+    for(int i = 0; i < objects.size(); i++)
+    {
+        std::vector<glm::vec4> vert_pos;
+        std::vector<glm::vec3> vert_col;
+        QJsonObject obj = objects[i].toObject();
+        QString type = obj["type"].toString();
+        //Custom Polygon case
+        if(QString::compare(type, QString("custom")) == 0)
+        {
+            QString name = obj["name"].toString();
+            QJsonArray pos = obj["vertexPos"].toArray();
+            for(int j = 0; j < pos.size(); j++)
+            {
+                QJsonArray arr = pos[j].toArray();
+                glm::vec4 p(arr[0].toDouble(), arr[1].toDouble(), arr[2].toDouble(), 1);
+                vert_pos.push_back(p);
+            }
+            QJsonArray col = obj["vertexCol"].toArray();
+            for(int j = 0; j < col.size(); j++)
+            {
+                QJsonArray arr = col[j].toArray();
+                glm::vec3 c(arr[0].toDouble(), arr[1].toDouble(), arr[2].toDouble());
+                vert_col.push_back(c);
+            }
+            Polygon p(name, vert_pos, vert_col);
+            polygonIndices[name] = polygons.size();
+            instances.push_back(Instance(polygons.size(), glm::mat4(1.f)));
+            polygons.push_back(p);
+        }
+        //Regular Polygon case
+        else if(QString::compare(type, QString("regular")) == 0)
+        {
+            QString name = obj["name"].toString();
+            int sides = obj["sides"].toInt();
+            QJsonArray colorA = obj["color"].toArray();
+            glm::vec3 color(colorA[0].toDouble(), colorA[1].toDouble(), colorA[2].toDouble());
+            QJsonArray posA = obj["pos"].toArray();
+            glm::vec4 pos(posA[0].toDouble(), posA[1].toDouble(), posA[2].toDouble(),1);
+            float rot = obj["rot"].toDouble();
+            QJsonArray scaleA = obj["scale"].toArray();
+            glm::vec4 scale(scaleA[0].toDouble(), scaleA[1].toDouble(), scaleA[2].toDouble(),1);
+            Polygon p(name, sides, color, pos, rot, scale);
+            polygonIndices[name] = polygons.size();
+            instances.push_back(Instance(polygons.size(), glm::mat4(1.f)));
+            polygons.push_back(p);
+        }
+        //OBJ file case. A "mesh" is loaded the same way but only drawn through instances.
+        else if(QString::compare(type, QString("obj")) == 0 || QString::compare(type, QString("mesh")) == 0)
+        {
+            QString name = obj["name"].toString();
+            QString filename = local_path;
+            filename.append(obj["filename"].toString());
+            //"clean" welds the mesh and drops triangles that draw nothing, "optimize" reorders it for
+            //locality, and "lods" simplifies it into coarser versions drawn when it is small on screen,
+            //all once, keeping the result in a cache file
+            unsigned int preparation = MESH_AS_LOADED;
+            if(obj["clean"].toBool())
+            {
+                preparation |= MESH_CLEANED;
+            }
+            if(obj["optimize"].toBool())
+            {
+                preparation |= MESH_OPTIMIZED;
+            }
+            if(obj["lods"].toBool())
+            {
+                preparation |= MESH_CLEANED | MESH_SIMPLIFIED;
+            }
+            Polygon p = LoadPreparedOBJ(filename, name, preparation);
+            QString texPath = local_path;
+            texPath.append(obj["texture"].toString());
+            p.SetTexture(TextureCache::Instance().Load(texPath));
+            if(obj.contains(QString("normalMap")))
+            {
+                QString norPath = local_path;
+                norPath.append(obj["normalMap"].toString());
+                p.SetNormalMap(TextureCache::Instance().Load(norPath));
+                //tangent frames are worked out once here rather than per frame
+                if(p.mp_packedNormalMap)
+                {
+                    p.ComputeTangents();
+                }
+            }
+            if(p.m_tris.size() >= MESHLET_MIN_TRIANGLES)
+            {
+                p.BuildMeshlets();
+            }
+            //Optionally keep the mesh in its compact quantized form
+            if(obj["compact"].toBool())
+            {
+                p.Pack();
+            }
+            polygonIndices[name] = polygons.size();
+            if(QString::compare(type, QString("obj")) == 0)
+            {
+                instances.push_back(Instance(polygons.size(), glm::mat4(1.f), obj["occluder"].toBool()));
+            }
+            polygons.push_back(p);
+        }
+        //Instance case: places an already named polygon with its own model matrix.
+        //Like "obj" entries, an instance may set "occluder" to mark it as large enough to hide others
+        else if(QString::compare(type, QString("instance")) == 0)
+        {
+            instanceObjects.push_back(obj);
+        }
+    }
+
+    for(const QJsonObject& obj : instanceObjects)
+    {
+        auto found = polygonIndices.find(obj["mesh"].toString());
+        if(found == polygonIndices.end())
+        {
+            qWarning("An instance refers to a mesh that is not in the scene.");
+            continue;
+        }
+        instances.push_back(Instance(found->second, ReadModelMatrix(obj), obj["occluder"].toBool()));
+    }
+    return true;
+}
+
+Polygon LoadOBJ(const QString &file, const QString &polyName)
+{
+    Polygon p(polyName);
+    QString filepath = file;
+    std::vector<tinyobj::shape_t> shapes; std::vector<tinyobj::material_t> materials;
+    std::string errors = tinyobj::LoadObj(shapes, materials, filepath.toStdString().c_str());
+    std::cout << errors << std::endl;
+    if(errors.size() == 0)
+    {
+        int min_idx = 0;
+        //Read the information from the vector of shape_ts
+        for(unsigned int i = 0; i < shapes.size(); i++)
+        {
+            std::vector<glm::vec4> pos, nor;
+            std::vector<glm::vec2> uv;
+            std::vector<float> &positions = shapes[i].mesh.positions;
+            std::vector<float> &normals = shapes[i].mesh.normals;
+            std::vector<float> &uvs = shapes[i].mesh.texcoords;
+            for(unsigned int j = 0; j < positions.size()/3; j++)
+            {
+                pos.push_back(glm::vec4(positions[j*3], positions[j*3+1], positions[j*3+2],1));
+            }
+            for(unsigned int j = 0; j < normals.size()/3; j++)
+            {
+                nor.push_back(glm::vec4(normals[j*3], normals[j*3+1], normals[j*3+2],0));
+            }
+            for(unsigned int j = 0; j < uvs.size()/2; j++)
+            {
+                uv.push_back(glm::vec2(uvs[j*2], uvs[j*2+1]));
+            }
+            for(unsigned int j = 0; j < pos.size(); j++)
+            {
+                p.AddVertex(Vertex(pos[j], glm::vec3(255,255,255), nor[j], uv[j]));
+            }
+
+            std::vector<unsigned int> indices = shapes[i].mesh.indices;
+            for(unsigned int j = 0; j < indices.size(); j += 3)
+            {
+                Triangle t;
+                t.m_indices[0] = indices[j] + min_idx;
+                t.m_indices[1] = indices[j+1] + min_idx;
+                t.m_indices[2] = indices[j+2] + min_idx;
+                p.AddTriangle(t);
+            }
+
+            min_idx += pos.size();
+        }
+    }
+    else
+    {
+        //An error loading the OBJ occurred!
+        std::cout << errors << std::endl;
+    }
+    return p;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <QString>
+#include <vector>
+#include <polygon.h>
+#include <rasterizer.h>
+#include <camerapath.h>
+#include <light.h>
+
+// Everything read from a scene JSON file
+struct SceneDescription
+{
+    std::vector<Polygon> m_polygons;
+    // Where each polygon is drawn; meshes only appear where an instance places them
+    std::vector<Instance> m_instances;
+    // Lights from the file's "lights" entry; empty if it has none
+    std::vector<Light> m_lights;
+    // Set if the file has a "cameraPath" entry to render the scene along
+    bool m_hasCameraPath;
+    CameraPath m_cameraPath;
+
+    SceneDescription()
+        : m_polygons(), m_instances(), m_lights(), m_hasCameraPath(false), m_cameraPath()
+    {}
+};
+
+// Reads a scene JSON file, along with every OBJ file and texture it refers to
+// (paths are relative to the JSON file). Returns false if the file cannot be opened.
+bool LoadSceneFile(const QString& filename, SceneDescription* scene);
+
+// Reads every shape in an OBJ file into a single Polygon
+Polygon LoadOBJ(const QString& file, const QString& polyName);
@@ -0,0 +1,131 @@
+#include "shadowmap.h"
+#include "rasterizer.h"
+#include <algorithm>
+#include <cmath>
+
+//Shadow map sizes are kept within these, which bounds what drawing one can cost
+static const int MIN_SHADOW_MAP_SIZE = 16;
+static const int MAX_SHADOW_MAP_SIZE = 4096;
+
+// A view matrix looking along forward from eye, built the same way as Camera::getViewMatrix
+static glm::mat4 LookAlong(const glm::vec3& eye, const glm::vec3& forward)
+{
+    glm::vec3 f = glm::normalize(forward);
+    //any up direction will do for a light, as long as it is not parallel to where it shines
+    glm::vec3 worldUp = std::abs(f.y) < 0.99f ? glm::vec3(0.f, 1.f, 0.f) : glm::vec3(1.f, 0.f, 0.f);
+    glm::vec3 right = glm::normalize(glm::cross(f, worldUp));
+    glm::vec3 up = glm::cross(right, f);
+
+    glm::mat4 O(1.0f);
+    O[0][0] = right.x; O[1][0] = right.y; O[2][0] = right.z;
+    O[0][1] = up.x;    O[1][1] = up.y;    O[2][1] = up.z;
+    O[0][2] = f.x;     O[1][2] = f.y;     O[2][2] = f.z;
+    glm::mat4 T(1.0f);
+    T[3][0] = -eye.x;
+    T[3][1] = -eye.y;
+    T[3][2] = -eye.z;
+    return O * T;
+}
+
+ShadowMap::ShadowMap()
+    : m_light(), m_scene(), m_valid(false), m_viewProjection(1.f), m_depth(), m_texelSize(0.f)
+{}
+
+bool ShadowMap::IsCurrent(const Light& light, const std::shared_ptr<const Scene>& scene) const
+{
+    //color and intensity do not change where shadows fall
+    return m_valid && m_scene.lock() == scene
+        && light.m_type == m_light.m_type
+        && light.m_direction == m_light.m_direction
+        && (light.m_type == LightType::Directional
+            || (light.m_position == m_light.m_position && light.m_spotAngle == m_light.m_spotAngle))
+        && light.m_shadowMapSize == m_light.m_shadowMapSize;
+}
+
+void ShadowMap::Render(Rasterizer& rasterizer, const Light& light, const std::shared_ptr<const Scene>& scene, const glm::vec4& sceneBounds)
+{
+    m_light = light;
+    m_scene = scene;
+    m_valid = true;
+
+    int size = std::max(MIN_SHADOW_MAP_SIZE, std::min(MAX_SHADOW_MAP_SIZE, light.m_shadowMapSize));
+    glm::vec3 center(sceneBounds);
+    float radius = std::max(sceneBounds.w, 1e-3f);
+    glm::vec3 direction = glm::normalize(light.m_direction);
+
+    glm::mat4 view, projection(0.f);
+    if(light.m_type == LightType::Directional)
+    {
+        //an orthographic box around the scene's bounding sphere, looking along the light
+        view = LookAlong(center - direction * (2.f * radius), direction);
+        float nearClip = radius, farClip = 3.f * radius;
+        projection[0][0] = 1.f / radius;
+        projection[1][1] = 1.f / radius;
+        projection[2][2] = 1.f / (farClip - nearClip);
+        projection[3][2] = -nearClip / (farClip - nearClip);
+        projection[3][3] = 1.f;
+        m_texelSize = 2.f * radius / size;
+    }
+    else
+    {
+        //a perspective frustum as wide as the cone, reaching just past the scene
+        view = LookAlong(light.m_position, direction);
+        float distance = glm::length(center - light.m_position);
+        float farClip = distance + radius;
+        float nearClip = std::max(farClip * 1e-3f, distance - radius);
+        float tanHalfAngle = std::tan(glm::radians(glm::clamp(light.m_spotAngle, 1.f, 89.f)));
+        projection[0][0] = 1.f / tanHalfAngle;
+        projection[1][1] = 1.f / tanHalfAngle;
+        projection[2][2] = farClip / (farClip - nearClip);
+        projection[2][3] = 1.f;
+        projection[3][2] = -farClip * nearClip / (farClip - nearClip);
+        m_texelSize = 2.f * tanHalfAngle / size;
+    }
+    m_viewProjection = projection * view;
+    rasterizer.RenderDepth(view, projection, size, size, &m_depth);
+}
+
+float ShadowMap::Visibility(const glm::vec3& position, const glm::vec3& normal) const
+{
+    //push the surface off itself by a few texels, measured at its distance from a spot light
+    float texelSize = m_texelSize;
+    if(m_light.m_type == LightType::Spot)
+    {
+        texelSize *= glm::length(position - m_light.m_position);
+    }
+    glm::vec4 clip = m_viewProjection * glm::vec4(position + normal * (texelSize * m_light.m_shadowBias), 1.f);
+    if(clip.w <= 0.f)
+    {
+        return 1.f;
+    }
+    glm::vec3 ndc = glm::vec3(clip) / clip.w;
+    if(ndc.z < 0.f || ndc.z > 1.f)
+    {
+        return 1.f;
+    }
+
+    //the texel under the position, in the same pixel space RenderDepth draws in
+    int size = m_depth.m_width;
+    int centerX = static_cast<int>(std::floor(size * (ndc.x + 1.f) * 0.5f + 0.5f));
+    int centerY = static_cast<int>(std::floor(size * (1.f - ndc.y) * 0.5f + 0.5f));
+    int radius = std::max(0, m_light.m_shadowFilterRadius);
+    int x0 = std::max(0, centerX - radius), x1 = std::min(size - 1, centerX + radius);
+    int y0 = std::max(0, centerY - radius), y1 = std::min(size - 1, centerY + radius);
+
+    //samples falling off the map are lit; the rest are counted with a branch-free compare per
+    //texel so each row of the filter vectorizes
+    int samples = (2 * radius + 1) * (2 * radius + 1);
+    int lit = samples - std::max(0, x1 - x0 + 1) * std::max(0, y1 - y0 + 1);
+    float reference = ndc.z - 1e-5f;
+    for(int y = y0; y <= y1; y++)
+    {
+        const float* row = m_depth.m_depth.data() + y * size;
+        int rowLit = 0;
+        for(int x = x0; x <= x1; x++)
+        {
+            rowLit += reference <= row[x];
+        }
+        lit += rowLit;
+    }
+    return static_cast<float>(lit) / samples;
+}
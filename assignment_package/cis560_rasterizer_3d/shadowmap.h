@@ -0,0 +1,39 @@
+#pragma once
+#include <memory>
+#include <glm/glm.hpp>
+#include <depthmap.h>
+#include <light.h>
+
+class Rasterizer;
+struct Scene;
+
+// The depth of a scene as seen from a Light, for telling which surfaces the light reaches.
+// The map is drawn by the Rasterizer's own depth-only pass and kept until the light moves
+// or the scene is replaced, so a static light costs nothing per frame after the first.
+class ShadowMap
+{
+public:
+    ShadowMap();
+
+    // Whether the map was drawn for this light and scene and can be reused as it is
+    bool IsCurrent(const Light& light, const std::shared_ptr<const Scene>& scene) const;
+
+    // Draws the map from the light, framing the scene's world space bounding sphere
+    // (center in xyz, radius in w)
+    void Render(Rasterizer& rasterizer, const Light& light, const std::shared_ptr<const Scene>& scene, const glm::vec4& sceneBounds);
+
+    // How much of the light reaches a world space position with the given unit normal,
+    // from 0 in full shadow to 1 fully lit. Positions outside the map are lit.
+    float Visibility(const glm::vec3& position, const glm::vec3& normal) const;
+
+private:
+    Light m_light;
+    //The scene the map was drawn for; expires if the scene is replaced
+    std::weak_ptr<const Scene> m_scene;
+    bool m_valid;
+
+    glm::mat4 m_viewProjection;
+    DepthMap m_depth;
+    //World space width of a texel: everywhere for a directional light, and one unit away from a spot light
+    float m_texelSize;
+};
@@ -0,0 +1,156 @@
+#include "texturecache.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QCryptographicHash>
+
+TextureCache::TextureCache()
+    : m_mutex(), m_paths(), m_entries(), m_lru(), m_budget(0), m_residentBytes(0)
+{}
+
+TextureCache& TextureCache::Instance()
+{
+    static TextureCache cache;
+    return cache;
+}
+
+std::shared_ptr<const QImage> TextureCache::Load(const QString& path)
+{
+    QFileInfo info(path);
+    if(!info.isFile())
+    {
+        return nullptr;
+    }
+    std::string pathKey = info.canonicalFilePath().toStdString();
+    qint64 lastModified = info.lastModified().toMSecsSinceEpoch();
+    qint64 fileSize = info.size();
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        //fast path: this exact file was loaded before and has not changed since
+        auto pathIt = m_paths.find(pathKey);
+        if(pathIt != m_paths.end()
+           && pathIt->second.lastModified == lastModified
+           && pathIt->second.fileSize == fileSize)
+        {
+            auto entryIt = m_entries.find(pathIt->second.contentKey);
+            if(entryIt != m_entries.end())
+            {
+                std::shared_ptr<const QImage> image = entryIt->second.image.lock();
+                if(image)
+                {
+                    Touch(entryIt->first, entryIt->second, image);
+                    return image;
+                }
+            }
+        }
+    }
+
+    //read and hash the file outside of the lock so other threads can keep hitting the cache
+    QFile file(path);
+    if(!file.open(QIODevice::ReadOnly))
+    {
+        return nullptr;
+    }
+    QByteArray bytes = file.readAll();
+    std::string contentKey = QCryptographicHash::hash(bytes, QCryptographicHash::Sha1).toStdString();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_paths[pathKey] = PathRecord{contentKey, lastModified, fileSize};
+
+    //a different path (or another thread) may already have decoded the same contents
+    auto entryIt = m_entries.find(contentKey);
+    if(entryIt != m_entries.end())
+    {
+        std::shared_ptr<const QImage> image = entryIt->second.image.lock();
+        if(image)
+        {
+            Touch(entryIt->first, entryIt->second, image);
+            return image;
+        }
+        if(entryIt->second.resident)
+        {
+            m_lru.erase(entryIt->second.lruPos);
+            m_residentBytes -= entryIt->second.bytes;
+        }
+        m_entries.erase(entryIt);
+    }
+
+    QImage decoded;
+    if(!decoded.loadFromData(bytes))
+    {
+        return nullptr;
+    }
+    //store in the format QImage::pixel reads without conversion
+    std::shared_ptr<const QImage> image = std::make_shared<const QImage>(decoded.convertToFormat(QImage::Format_RGB32));
+
+    Entry& entry = m_entries[contentKey];
+    entry.image = image;
+    entry.bytes = static_cast<size_t>(image->sizeInBytes());
+    entry.resident = false;
+    Touch(contentKey, entry, image);
+    return image;
+}
+
+void TextureCache::Touch(const std::string& contentKey, Entry& entry, const std::shared_ptr<const QImage>& image)
+{
+    if(entry.resident)
+    {
+        m_lru.splice(m_lru.begin(), m_lru, entry.lruPos);
+        return;
+    }
+    m_lru.emplace_front(contentKey, image);
+    entry.lruPos = m_lru.begin();
+    entry.resident = true;
+    m_residentBytes += entry.bytes;
+    EvictToBudget();
+}
+
+void TextureCache::EvictToBudget()
+{
+    if(m_budget == 0)
+    {
+        return;
+    }
+    //never evict the image that was just requested
+    while(m_residentBytes > m_budget && m_lru.size() > 1)
+    {
+        auto entryIt = m_entries.find(m_lru.back().first);
+        m_lru.pop_back();
+        m_residentBytes -= entryIt->second.bytes;
+        entryIt->second.resident = false;
+        //forget entries nobody else holds so the maps do not grow without bound
+        if(entryIt->second.image.expired())
+        {
+            m_entries.erase(entryIt);
+        }
+    }
+}
+
+void TextureCache::SetBudget(size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_budget = bytes;
+    EvictToBudget();
+}
+
+size_t TextureCache::GetBudget() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_budget;
+}
+
+size_t TextureCache::GetResidentBytes() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_residentBytes;
+}
+
+void TextureCache::Clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_lru.clear();
+    m_entries.clear();
+    m_paths.clear();
+    m_residentBytes = 0;
+}
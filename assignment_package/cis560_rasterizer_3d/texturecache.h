@@ -0,0 +1,73 @@
+#pragma once
+#include <QImage>
+#include <QString>
+#include <memory>
+#include <mutex>
+#include <list>
+#include <string>
+#include <unordered_map>
+
+// A process-wide cache of decoded texture images.
+// Every path is decoded at most once, and two paths whose files have identical
+// contents share one decoded image. Callers receive shared read-only handles, so
+// Polygons that use the same texture never hold their own copy of it.
+//
+// The cache can optionally be given a memory budget. When the decoded images held
+// by the cache exceed it, the least recently used ones are released. An evicted
+// image that is still referenced by a Polygon stays alive and is handed out again
+// on the next request instead of being decoded a second time.
+class TextureCache
+{
+public:
+    // Returns the cache shared by the whole process
+    static TextureCache& Instance();
+
+    // Returns a shared handle to the decoded image at the given path.
+    // Returns a null pointer if the file cannot be read or decoded.
+    std::shared_ptr<const QImage> Load(const QString& path);
+
+    // Sets the maximum number of bytes of decoded image data kept resident by the cache.
+    // A budget of 0 means the cache never evicts.
+    void SetBudget(size_t bytes);
+    size_t GetBudget() const;
+
+    // The number of bytes of decoded image data currently kept resident by the cache
+    size_t GetResidentBytes() const;
+
+    // Drops every entry. Handles already given out remain valid.
+    void Clear();
+
+private:
+    TextureCache();
+
+    // One decoded image, identified by a hash of its file contents
+    struct Entry
+    {
+        std::weak_ptr<const QImage> image;
+        size_t bytes;
+        // Position in m_lru while the cache holds a strong reference to the image
+        std::list<std::pair<std::string, std::shared_ptr<const QImage>>>::iterator lruPos;
+        bool resident;
+    };
+
+    // What we last learned about a path, so repeat loads skip reading the file
+    struct PathRecord
+    {
+        std::string contentKey;
+        qint64 lastModified;
+        qint64 fileSize;
+    };
+
+    // Marks an entry as most recently used, making it resident if it was evicted
+    void Touch(const std::string& contentKey, Entry& entry, const std::shared_ptr<const QImage>& image);
+    // Releases least recently used images until the budget is met
+    void EvictToBudget();
+
+    mutable std::mutex m_mutex;
+    std::unordered_map<std::string, PathRecord> m_paths;
+    std::unordered_map<std::string, Entry> m_entries;
+    // Most recently used images at the front
+    std::list<std::pair<std::string, std::shared_ptr<const QImage>>> m_lru;
+    size_t m_budget;
+    size_t m_residentBytes;
+};
@@ -0,0 +1,141 @@
+#include "upscaler.h"
+#include <algorithm>
+#include <cmath>
+
+//taps either side of an output pixel
+static const int LANCZOS_RADIUS = 2;
+static const int LANCZOS_TAPS = 2 * LANCZOS_RADIUS;
+static const float PI = 3.14159265358979f;
+
+static float Lanczos(float x)
+{
+    x = std::abs(x);
+    if(x < 1e-5f)
+    {
+        return 1.0f;
+    }
+    if(x >= LANCZOS_RADIUS)
+    {
+        return 0.0f;
+    }
+    float px = PI * x;
+    return LANCZOS_RADIUS * std::sin(px) * std::sin(px / LANCZOS_RADIUS) / (px * px);
+}
+
+//the input pixels one output pixel is made from, relative to the first pixel of the input, with
+//their weights; taps past the input's edges repeat its edge pixels
+struct LanczosTaps
+{
+    int m_index[LANCZOS_TAPS];
+    float m_weight[LANCZOS_TAPS];
+};
+
+//where the center of output pixel i falls among the input pixels, in input pixels
+static float SourceCoordinate(int i, int sourceFrame, int destinationFrame)
+{
+    return (i + 0.5f) * sourceFrame / destinationFrame - 0.5f;
+}
+
+static FrameVector<LanczosTaps> ComputeTaps(int destinationStart, int count, int sourceStart, int sourceCount,
+                                            int sourceFrame, int destinationFrame, Arena& arena)
+{
+    FrameVector<LanczosTaps> taps(count, LanczosTaps(), ArenaAllocator<LanczosTaps>(arena));
+    for(int i = 0; i < count; i++)
+    {
+        float u = SourceCoordinate(destinationStart + i, sourceFrame, destinationFrame);
+        int first = static_cast<int>(std::floor(u)) - (LANCZOS_RADIUS - 1);
+        float sum = 0.0f;
+        for(int k = 0; k < LANCZOS_TAPS; k++)
+        {
+            float weight = Lanczos(u - (first + k));
+            taps[i].m_index[k] = std::min(std::max(first + k - sourceStart, 0), sourceCount - 1);
+            taps[i].m_weight[k] = weight;
+            sum += weight;
+        }
+        for(int k = 0; k < LANCZOS_TAPS; k++)
+        {
+            taps[i].m_weight[k] /= sum;
+        }
+    }
+    return taps;
+}
+
+QRect LanczosSourceRegion(const QRect& destinationRegion, const QSize& sourceFrame, const QSize& destinationFrame)
+{
+    int left = static_cast<int>(std::floor(SourceCoordinate(destinationRegion.left(), sourceFrame.width(), destinationFrame.width()))) - (LANCZOS_RADIUS - 1);
+    int top = static_cast<int>(std::floor(SourceCoordinate(destinationRegion.top(), sourceFrame.height(), destinationFrame.height()))) - (LANCZOS_RADIUS - 1);
+    int right = static_cast<int>(std::floor(SourceCoordinate(destinationRegion.right(), sourceFrame.width(), destinationFrame.width()))) + LANCZOS_RADIUS;
+    int bottom = static_cast<int>(std::floor(SourceCoordinate(destinationRegion.bottom(), sourceFrame.height(), destinationFrame.height()))) + LANCZOS_RADIUS;
+    return QRect(QPoint(left, top), QPoint(right, bottom)).intersected(QRect(QPoint(0, 0), sourceFrame));
+}
+
+void UpscaleLanczos(const QImage& source, const QSize& sourceFrame,
+                    QImage& destination, const QRect& destinationRegion, const QSize& destinationFrame, Arena& arena)
+{
+    QRect sourceRegion = LanczosSourceRegion(destinationRegion, sourceFrame, destinationFrame);
+    int sourceWidth = source.width(), sourceHeight = source.height();
+    int width = destinationRegion.width(), height = destinationRegion.height();
+    FrameVector<LanczosTaps> columnTaps = ComputeTaps(destinationRegion.left(), width, sourceRegion.left(), sourceWidth,
+                                                      sourceFrame.width(), destinationFrame.width(), arena);
+    FrameVector<LanczosTaps> rowTaps = ComputeTaps(destinationRegion.top(), height, sourceRegion.top(), sourceHeight,
+                                                   sourceFrame.height(), destinationFrame.height(), arena);
+
+    //every row of the source, filtered along the row to the output's width, with the channels of each
+    //pixel side by side, so the pass down the columns below is one plain loop over a whole row of
+    //floats that the compiler can vectorize
+    int rowLength = 3 * width;
+    FrameVector<float> filteredRows(rowLength * sourceHeight, 0.0f, ArenaAllocator<float>(arena));
+    FrameVector<float> sourceRow(3 * sourceWidth, 0.0f, ArenaAllocator<float>(arena));
+    for(int y = 0; y < sourceHeight; y++)
+    {
+        const QRgb* row = reinterpret_cast<const QRgb*>(source.constScanLine(y));
+        float* in = sourceRow.data();
+        for(int x = 0; x < sourceWidth; x++)
+        {
+            in[3 * x] = static_cast<float>(qRed(row[x]));
+            in[3 * x + 1] = static_cast<float>(qGreen(row[x]));
+            in[3 * x + 2] = static_cast<float>(qBlue(row[x]));
+        }
+        float* out = filteredRows.data() + y * rowLength;
+        for(int x = 0; x < width; x++)
+        {
+            const LanczosTaps& t = columnTaps[x];
+            for(int c = 0; c < 3; c++)
+            {
+                float sum = 0.0f;
+                for(int k = 0; k < LANCZOS_TAPS; k++)
+                {
+                    sum += t.m_weight[k] * in[3 * t.m_index[k] + c];
+                }
+                //anti-ringing: no brighter or darker than the two nearest input pixels
+                float near1 = in[3 * t.m_index[LANCZOS_RADIUS - 1] + c], near2 = in[3 * t.m_index[LANCZOS_RADIUS] + c];
+                out[3 * x + c] = std::min(std::max(sum, std::min(near1, near2)), std::max(near1, near2));
+            }
+        }
+    }
+
+    //then down the columns, a whole output row at a time, with the four taps written out
+    static_assert(LANCZOS_TAPS == 4, "the column pass reads exactly four rows");
+    FrameVector<float> channels(rowLength, 0.0f, ArenaAllocator<float>(arena));
+    for(int y = 0; y < height; y++)
+    {
+        const LanczosTaps& t = rowTaps[y];
+        const float* row0 = filteredRows.data() + t.m_index[0] * rowLength;
+        const float* row1 = filteredRows.data() + t.m_index[1] * rowLength;
+        const float* row2 = filteredRows.data() + t.m_index[2] * rowLength;
+        const float* row3 = filteredRows.data() + t.m_index[3] * rowLength;
+        float w0 = t.m_weight[0], w1 = t.m_weight[1], w2 = t.m_weight[2], w3 = t.m_weight[3];
+        float* values = channels.data();
+        for(int i = 0; i < rowLength; i++)
+        {
+            float sum = w0 * row0[i] + w1 * row1[i] + w2 * row2[i] + w3 * row3[i];
+            //anti-ringing again, between the two nearest filtered rows
+            values[i] = std::min(std::max(sum, std::min(row1[i], row2[i])), std::max(row1[i], row2[i])) + 0.5f;
+        }
+        QRgb* out = reinterpret_cast<QRgb*>(destination.scanLine(y));
+        for(int x = 0; x < width; x++)
+        {
+            out[x] = qRgb(static_cast<int>(values[3 * x]), static_cast<int>(values[3 * x + 1]), static_cast<int>(values[3 * x + 2]));
+        }
+    }
+}
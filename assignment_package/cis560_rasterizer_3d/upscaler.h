@@ -0,0 +1,24 @@
+#pragma once
+#include <QImage>
+#include <QRect>
+#include <QSize>
+#include <framearena.h>
+
+// Upscaling of a frame rendered at reduced resolution to the resolution it is displayed at,
+// with a separable two-lobe Lanczos filter: each output pixel is a weighted sum of the 4 x 4 pixels
+// of the small frame around it, found as a pass along rows and then a pass down columns.
+// Each pass clamps its result between the two input pixels nearest the output one, which stops
+// the filter's negative lobes from ringing around hard edges while keeping them sharp.
+//
+// Both frames show the same view: pixel centers line up across their whole width and height.
+
+// The pixels of a sourceFrame-sized frame that are read to produce the given region of
+// a destinationFrame-sized one
+QRect LanczosSourceRegion(const QRect& destinationRegion, const QSize& sourceFrame, const QSize& destinationFrame);
+
+// Fills destination, the pixels of destinationRegion of a destinationFrame-sized frame, from source,
+// the pixels of LanczosSourceRegion(destinationRegion, ...) of a sourceFrame-sized frame.
+// Both images are Format_RGB32, and destination must already be the size of destinationRegion.
+// Intermediate results are allocated from the arena.
+void UpscaleLanczos(const QImage& source, const QSize& sourceFrame,
+                    QImage& destination, const QRect& destinationRegion, const QSize& destinationFrame, Arena& arena);